@@ -9,17 +9,11 @@
 #include <bpf/bpf_core_read.h>
 #include <bpf/bpf_tracing.h>
 #include "libseg6.c"
+#include "events.c"
 #include "decoder.h"
 #include "fec_framework/window_receiver.c"
 #include "fec_framework/block_receiver.c"
 
-// Perf even buffer 
-struct {
-    __uint(type, BPF_MAP_TYPE_PERF_EVENT_ARRAY);
-    __uint(key_size, sizeof(__u32));
-    __uint(value_size, sizeof(__u32));
-} events SEC(".maps");
-
 SEC("lwt_seg6local_convo")
 int decode_convo(struct __sk_buff *skb) {
     int err;
@@ -41,7 +35,7 @@ int decode_convo(struct __sk_buff *skb) {
 
     // Get the TLV from the SRH 
     __u8 tlv_type = 0; // Know whether the packet is a source or a repair symbol
-    long cursor = seg6_find_tlv2(skb, srh, &tlv_type, sizeof(struct tlvSource__block_t), sizeof(struct tlvRepair__block_t));
+    long cursor = seg6_find_tlv2(skb, srh, &tlv_type, sizeof(struct tlvSource__convo_t), sizeof(struct tlvRepair__convo_t));
     if (cursor < 0) {
         //if (DEBUG) bpf_printk("Receiver: impossible to get the TLV\n");
         return BPF_ERROR;
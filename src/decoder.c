@@ -7,13 +7,16 @@
 #include <strings.h>
 #include <sys/resource.h>
 #include <errno.h>
+#include <time.h>
 #include <getopt.h>
+#include <net/if.h>
 #include <bpf/libbpf.h>
 #include "decoder.skel.h"
 #include <bpf/bpf.h>
 #include "decoder.h"
 #include "raw_socket/raw_socket_receiver.h"
 #include "fec_scheme/window_rlc_gf256/rlc_gf256_decode.c"
+#include "events/events.c"
 #include <arpa/inet.h>
 #include <netinet/ip6.h>
 #include <netinet/ip.h>
@@ -31,17 +34,29 @@ typedef struct {
     enum fec_framework framework;
     bool attach;
     char interface[15];
+    bool ringbuf;
+    bool busy_poll;
+    uint32_t ringbuf_wakeup; // Bytes, 0 for the default wakeup
+    bool batch; // Send the generated packets with sendmmsg
+    char tx_ring_interface[IF_NAMESIZE]; // If set, send the generated packets through a PACKET_TX_RING on this interface
+    uint8_t tx_ring_mac[6]; // Next hop of the generated packets (with tx_ring_interface)
+    uint32_t streams; // Number of streams of the encoder (its maximum number of FEC contexts)
+    uint32_t contexts; // Maximum number of decoding contexts (streams of all the encoders), 0 for *streams*
+    bool kernel_recovery; // Recover the single losses of small symbols in the eBPF program
 } args_t;
 
 args_t plugin_arguments;
 
 // Used to detect the end of the program
-static volatile int exiting = 0;
+static volatile bool exiting = 0;
 
 static volatile int sfd = -1;
 
 static volatile int map_fd_fecConvolutionBuffer;
 
+// Owners of the shares of the decoding contexts, see evict_idle_contexts()
+static int map_fd_context_shares = -1;
+
 static struct sockaddr_in6 local_addr;
 static struct sockaddr_in6 encoder;
 
@@ -79,14 +94,22 @@ static void send_recovered_symbol_XOR(void *ctx, int cpu, void *data, __u32 data
     // ->packet_length: the length of the recovered packet
     const struct repairSymbol_t *repairSymbol = (struct repairSymbol_t *)data;
 
-    send_raw_socket_recovered(sfd, repairSymbol, local_addr);
+    if (rlc->batch) {
+        queue_raw_socket_recovered(rlc->batch, repairSymbol, local_addr);
+    } else {
+        send_raw_socket_recovered(sfd, repairSymbol, local_addr);
+    }
 }
 
 static void controller(void *data) {
     int err;
     controller_t *controller_info = (controller_t *)data;
 
-    err = send_raw_socket_controller(sfd, local_addr, encoder, controller_info);
+    if (rlc->batch) {
+        err = queue_raw_socket_controller(rlc->batch, local_addr, encoder, controller_info);
+    } else {
+        err = send_raw_socket_controller(sfd, local_addr, encoder, controller_info);
+    }
     if (err < 0) {
         fprintf(stderr, "Error while sending the control message\n");
     }
@@ -98,6 +121,12 @@ static void fecScheme_RLC(void *ctx, int cpu, void *data, __u32 data_sz) {
         // This is a controller message
         controller(data);
         return;
+    } else if ((*controller_message) & RLC_KERNEL_RECOVERED) {
+        // Already recovered by the kernel, only to be sent
+        if (rlc__send_kernel_recovered(rlc, (kernel_recovered_t *)data, sfd, local_addr) < 0) {
+            fprintf(stderr, "Error while sending a symbol recovered by the kernel\n");
+        }
+        return;
     }
 
     if (debug) {
@@ -117,37 +146,66 @@ static void fecScheme_RLC(void *ctx, int cpu, void *data, __u32 data_sz) {
     }
 }
 
-static void handle_events(int map_fd_events, enum fec_framework framework) {
-    // Define structure for the perf event
-    struct perf_buffer_opts pb_opts = {0};
-    if (framework == BLOCK) {
-        pb_opts.sample_cb = send_recovered_symbol_XOR;
-    } else {
-        pb_opts.sample_cb = fecScheme_RLC;
-    }
-    struct perf_buffer *pb = NULL;
-    int err;
+static int send_recovered_symbol_XOR_rb(void *ctx, void *data, size_t data_sz) {
+    send_recovered_symbol_XOR(ctx, 0, data, data_sz);
+    return 0;
+}
 
-    pb = perf_buffer__new(map_fd_events, 128, &pb_opts);
-    err = libbpf_get_error(pb);
-    if (err) {
-        pb = NULL;
-        fprintf(stderr, "Impossible to open perf event\n");
-        goto cleanup;
+static int fecScheme_RLC_rb(void *ctx, void *data, size_t data_sz) {
+    fecScheme_RLC(ctx, 0, data, data_sz);
+    return 0;
+}
+
+// Deletes the decoding contexts that did not receive a symbol for DECODE_CONTEXT_IDLE_TIMEOUT_NS, at most once per second.
+// Their shares of the symbol pools can then be claimed by the new contexts
+static void evict_idle_contexts() {
+    static __u64 last_run = 0;
+    static decode_context_key_t keys[MAX_DECODE_CONTEXTS];
+    decode_context_key_t key, prev_key;
+    fecConvolution_t context;
+    int nb_idle = 0;
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts); // Same clock as bpf_ktime_get_ns()
+    __u64 now = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    if (map_fd_context_shares < 0 || now - last_run < 1000000000ULL) {
+        return;
+    }
+    last_run = now;
+
+    // The contexts are deleted after the iteration to not disturb it
+    void *prev = NULL;
+    while (nb_idle < MAX_DECODE_CONTEXTS && bpf_map_get_next_key(map_fd_fecConvolutionBuffer, prev, &key) == 0) {
+        if (bpf_map_lookup_elem(map_fd_fecConvolutionBuffer, &key, &context) == 0 && now > context.last_seen &&
+                now - context.last_seen > DECODE_CONTEXT_IDLE_TIMEOUT_NS) {
+            keys[nb_idle++] = key;
+        }
+        prev_key = key;
+        prev = &prev_key;
     }
 
-    // Enter in loop until a signal is retrieved
-    // Poll the recovered packet from the BPF program
-    while (!exiting) {
-        err = perf_buffer__poll(pb, 100);
-        if (err < 0 && errno != EINTR) {
-            fprintf(stderr, "Error polling perf buffer: %d\n", err);
-            goto cleanup;
+    for (int i = 0; i < nb_idle; ++i) {
+        // Check again: a symbol may have used the context in the meantime
+        if (bpf_map_lookup_elem(map_fd_fecConvolutionBuffer, &keys[i], &context) < 0 || now < context.last_seen ||
+                now - context.last_seen <= DECODE_CONTEXT_IDLE_TIMEOUT_NS) {
+            continue;
+        }
+        bpf_map_delete_elem(map_fd_fecConvolutionBuffer, &keys[i]);
+        if (context.share < rlc->shares) {
+            // The share is released last: no new context uses it before it is cleared
+            rlc_decode__clear_share(rlc, context.share);
+            bpf_map_delete_elem(map_fd_context_shares, &context.share);
         }
     }
+}
 
-cleanup:
-    perf_buffer__free(pb);
+// Called after each poll of the events
+static void after_poll() {
+    // Send the packets generated by the events of this poll
+    if (rlc->batch) {
+        raw_socket_batch__flush(rlc->batch);
+    }
+    evict_idle_contexts();
 }
 
 void usage(char *prog_name) {
@@ -159,20 +217,31 @@ void usage(char *prog_name) {
     fprintf(stderr, "    -a attach: if set, attempts to attach the program to *encoder_ip*\n");
     fprintf(stderr, "    -i interface: the interface to which attach the program (if *attach* is set)\n");
     fprintf(stderr, "    -g: enable debug information\n");
+    fprintf(stderr, "    -r: use a ring buffer (5.8+ kernel) instead of per-CPU perf buffers to communicate with the kernel\n");
+    fprintf(stderr, "    -p: busy poll the events instead of waiting for a wakeup\n");
+    fprintf(stderr, "    -W bytes: with -r, only wake up user space when at least *bytes* are pending, below the size of the ring buffer (default: 0, every event)\n");
+    fprintf(stderr, "    -B: batch the generated packets and send them with sendmmsg after each poll of the events\n");
+    fprintf(stderr, "    -x interface: write the generated packets in a PACKET_TX_RING of *interface* instead of using the IPv6 stack (implies -B)\n");
+    fprintf(stderr, "    -m mac: with -x, MAC address of the next hop (default: 00:00:00:00:00:00, e.g. for lo)\n");
+    fprintf(stderr, "    -C streams: number of streams of encodingSymbolIDs of the encoder, i.e. its maximum number of FEC contexts (default: 1)\n");
+    fprintf(stderr, "    -K contexts: with the convo framework, maximum number of decoding contexts, i.e. of streams of all the encoders together (default: *streams*)\n");
+    fprintf(stderr, "    -k: with the convo framework, recover the single losses of the windows of symbols of at most %u bytes in the kernel\n", RLC_KERNEL_RECOVERY_SIZE);
 }
 
 int parse_args(args_t *args, int argc, char *argv[]) {
+    bool ringbuf_wakeup_given = false;
     memset(args, 0, sizeof(args_t));
     // Default values
     strcpy(args->decoder_ip, "fc00::9");
     strcpy(args->encoder_ip, "fc00::b");
     args->framework = CONVO;
     args->attach = false;
+    args->streams = 1;
 
     bool interface_if_attach = false;
 
     int opt;
-    while ((opt = getopt(argc, argv, "f:d:e:ai:g")) != -1) {
+    while ((opt = getopt(argc, argv, "f:d:e:ai:grpW:Bx:m:C:K:k")) != -1) {
         switch (opt) {
             case 'f':
                 if (strncmp(optarg, "block", 6) == 0) {
@@ -210,6 +279,50 @@ int parse_args(args_t *args, int argc, char *argv[]) {
             case 'g':
                 debug = true;
                 break;
+            case 'r':
+                args->ringbuf = true;
+                break;
+            case 'p':
+                args->busy_poll = true;
+                break;
+            case 'W':
+                args->ringbuf_wakeup = atoi(optarg);
+                if (atoi(optarg) < 0 || atoi(optarg) >= EVENTS_RINGBUF_SIZE) {
+                    fprintf(stderr, "Wrong wakeup threshold, needs to be in [0, %u[ bytes (size of the ring buffer)\n", EVENTS_RINGBUF_SIZE);
+                    return -1;
+                }
+                ringbuf_wakeup_given = true;
+                break;
+            case 'B':
+                args->batch = true;
+                break;
+            case 'x':
+                strncpy(args->tx_ring_interface, optarg, IF_NAMESIZE - 1);
+                break;
+            case 'm':
+                if (sscanf(optarg, "%hhx:%hhx:%hhx:%hhx:%hhx:%hhx", &args->tx_ring_mac[0], &args->tx_ring_mac[1], &args->tx_ring_mac[2],
+                           &args->tx_ring_mac[3], &args->tx_ring_mac[4], &args->tx_ring_mac[5]) != 6) {
+                    fprintf(stderr, "Wrong MAC address: %s\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'C':
+                args->streams = atoi(optarg);
+                if (atoi(optarg) <= 0 || atoi(optarg) > MAX_ENCODER_STREAMS) {
+                    fprintf(stderr, "Wrong number of streams, needs to be in [1, %u]\n", MAX_ENCODER_STREAMS);
+                    return -1;
+                }
+                break;
+            case 'K':
+                args->contexts = atoi(optarg);
+                if (atoi(optarg) <= 0 || atoi(optarg) > MAX_DECODE_CONTEXTS) {
+                    fprintf(stderr, "Wrong number of decoding contexts, needs to be in [1, %u]\n", MAX_DECODE_CONTEXTS);
+                    return -1;
+                }
+                break;
+            case 'k':
+                args->kernel_recovery = true;
+                break;
             case '?':
                 usage(argv[0]);
                 return 1;
@@ -218,6 +331,10 @@ int parse_args(args_t *args, int argc, char *argv[]) {
                 return 1;
         }
     }
+    if (ringbuf_wakeup_given && !args->ringbuf) {
+        fprintf(stderr, "The wakeup threshold only applies to the ring buffer (-W needs -r)\n");
+        return -1;
+    }
     if (args->attach && !interface_if_attach) {
             fprintf(stderr, "You need to specify an interface to plug the program\n");
             return -1;
@@ -269,6 +386,36 @@ int main(int argc, char **argv)
         return 1;
     }
 
+    // Select the transport of the events before loading the program
+    skel->rodata->use_ringbuf = plugin_arguments.ringbuf;
+    if (plugin_arguments.ringbuf && plugin_arguments.busy_poll) {
+        skel->rodata->ringbuf_wakeup_bytes = UINT64_MAX; // Never wake up, user space is always polling
+    } else {
+        skel->rodata->ringbuf_wakeup_bytes = plugin_arguments.ringbuf_wakeup;
+    }
+    // The unused ring buffer is reduced to one page
+    bpf_map__set_max_entries(skel->maps.events_rb, plugin_arguments.ringbuf ? EVENTS_RINGBUF_SIZE : getpagesize());
+
+    // The blocks of the streams of the encoder are interleaved in xorBuffer
+    uint32_t streams = plugin_arguments.streams;
+    skel->rodata->encoder_streams = streams;
+    bpf_map__set_max_entries(skel->maps.xorBuffer, streams * MAX_BLOCK);
+
+    // One share of the symbol pools per decoding context (stream of an encoder)
+    uint32_t contexts = plugin_arguments.contexts ? plugin_arguments.contexts : streams;
+    skel->rodata->decode_contexts = contexts;
+    bpf_map__set_max_entries(skel->maps.fecConvolutionInfoMap, contexts);
+    bpf_map__set_max_entries(skel->maps.sourceSymbolPool_small, contexts * RLC_RECEIVER_BUFFER_SIZE);
+    bpf_map__set_max_entries(skel->maps.sourceSymbolPool_medium, contexts * RLC_RECEIVER_BUFFER_SIZE);
+    bpf_map__set_max_entries(skel->maps.sourceSymbolPool_large, contexts * RLC_RECEIVER_BUFFER_SIZE);
+    bpf_map__set_max_entries(skel->maps.repairSymbolPool_small, contexts * RLC_RECEIVER_REPAIR_SLOTS);
+    bpf_map__set_max_entries(skel->maps.repairSymbolPool_medium, contexts * RLC_RECEIVER_REPAIR_SLOTS);
+    bpf_map__set_max_entries(skel->maps.repairSymbolPool_large, contexts * RLC_RECEIVER_REPAIR_SLOTS);
+
+    // The coefficients are only filled for the recovery in the kernel, the map is reduced to one entry otherwise
+    skel->rodata->kernel_recovery = plugin_arguments.kernel_recovery;
+    bpf_map__set_max_entries(skel->maps.rlcCoefs, plugin_arguments.kernel_recovery ? RLC_KERNEL_COEFS_KEYS : 1);
+
     // Load and verify BPF program
     err = decoder_bpf__load(skel);
     if (err) {
@@ -292,22 +439,28 @@ int main(int argc, char **argv)
     // Get file descriptor of maps and init the value of the structures
     struct bpf_map *map_xorBuffer = skel->maps.xorBuffer;
     int map_fd_xorBuffer = bpf_map__fd(map_xorBuffer);
-    for (int i = 0; i < MAX_BLOCK; ++i) {
+    for (int i = 0; i < MAX_BLOCK * streams; ++i) {
         xorStruct_t struct_zero = {};
         bpf_map_update_elem(map_fd_xorBuffer, &i, &struct_zero, BPF_ANY);
     }
 
-    int k0 = 0;
+    // The decoding contexts are created by the kernel from this template
     struct bpf_map *map_fecConvolutionBuffer = skel->maps.fecConvolutionInfoMap;
     map_fd_fecConvolutionBuffer = bpf_map__fd(map_fecConvolutionBuffer);
+    map_fd_context_shares = bpf_map__fd(skel->maps.contextShares);
     fecConvolution_t convo_struct_zero = {
         .controller_repair = 2,
+        .share = DECODE_CONTEXT_NO_SHARE,
     };
-    bpf_map_update_elem(map_fd_fecConvolutionBuffer, &k0, &convo_struct_zero, BPF_ANY);
+    uint32_t k0 = 0;
+    bpf_map_update_elem(bpf_map__fd(skel->maps.fecConvolutionTemplate), &k0, &convo_struct_zero, BPF_ANY);
 
     struct bpf_map *map_events = skel->maps.events;
     int map_fd_events = bpf_map__fd(map_events);
 
+    struct bpf_map *map_events_rb = skel->maps.events_rb;
+    int map_fd_events_rb = bpf_map__fd(map_events_rb);
+
     // Open raw socket
     sfd = socket(AF_INET6, SOCK_RAW, IPPROTO_RAW);
     if (sfd == -1) {
@@ -316,14 +469,69 @@ int main(int argc, char **argv)
     }
 
     // Initialize structure for RLC
-    rlc = initialize_rlc_decode();
+    rlc = initialize_rlc_decode(contexts);
     if (!rlc) {
         perror("Cannot create RLC structure");
         goto cleanup;
     }
 
+    // Give the tables of the decoding structure to the kernel
+    if (plugin_arguments.kernel_recovery) {
+        gf256_tables_t *gf256_tables = malloc(sizeof(gf256_tables_t));
+        if (!gf256_tables) {
+            perror("Cannot create the GF(256) tables");
+            goto cleanup;
+        }
+        memcpy(gf256_tables->mul, rlc->muls, sizeof(gf256_tables->mul));
+        memcpy(gf256_tables->inv, rlc->table_inv, sizeof(gf256_tables->inv));
+        err = bpf_map_update_elem(bpf_map__fd(skel->maps.gf256Tables), &k0, gf256_tables, BPF_ANY);
+        free(gf256_tables);
+        int map_fd_coefs = bpf_map__fd(skel->maps.rlcCoefs);
+        for (uint32_t repairKey = 0; repairKey < RLC_KERNEL_COEFS_KEYS && err == 0; ++repairKey) {
+            err = bpf_map_update_elem(map_fd_coefs, &repairKey, rlc_coefs__get(repairKey), BPF_ANY);
+        }
+        if (err < 0) {
+            perror("Cannot fill the tables of the kernel recovery");
+            goto cleanup;
+        }
+    }
+
+    // Map the symbols stored by the kernel to avoid copying them for each window
+    err = symbol_pool__mmap(&rlc->sourcePool, bpf_map__fd(skel->maps.sourceSymbolPool_small),
+                            bpf_map__fd(skel->maps.sourceSymbolPool_medium), bpf_map__fd(skel->maps.sourceSymbolPool_large), RLC_RECEIVER_BUFFER_SIZE, contexts);
+    if (err < 0) {
+        perror("Cannot mmap the source symbol pool");
+        goto cleanup;
+    }
+    err = symbol_pool__mmap(&rlc->repairPool, bpf_map__fd(skel->maps.repairSymbolPool_small),
+                            bpf_map__fd(skel->maps.repairSymbolPool_medium), bpf_map__fd(skel->maps.repairSymbolPool_large), RLC_RECEIVER_REPAIR_SLOTS, contexts);
+    if (err < 0) {
+        perror("Cannot mmap the repair symbol pool");
+        goto cleanup;
+    }
+
+    if (plugin_arguments.tx_ring_interface[0]) {
+        rlc->batch = raw_socket_batch__new_tx_ring(plugin_arguments.tx_ring_interface, plugin_arguments.tx_ring_mac);
+        if (!rlc->batch) {
+            fprintf(stderr, "Cannot create the TX ring on %s\n", plugin_arguments.tx_ring_interface);
+            goto cleanup;
+        }
+    } else if (plugin_arguments.batch) {
+        rlc->batch = raw_socket_batch__new(sfd);
+        if (!rlc->batch) {
+            perror("Cannot create the packet batch");
+            goto cleanup;
+        }
+    }
+
     // Enter perf event handling for packet recovering
-    handle_events(map_fd_events, plugin_arguments.framework);
+    if (plugin_arguments.ringbuf) {
+        events__handle_ringbuf(map_fd_events_rb, plugin_arguments.framework == BLOCK ? send_recovered_symbol_XOR_rb : fecScheme_RLC_rb,
+                               plugin_arguments.busy_poll, plugin_arguments.ringbuf_wakeup > 0, 100, after_poll, &exiting);
+    } else {
+        events__handle_perf(map_fd_events, plugin_arguments.framework == BLOCK ? send_recovered_symbol_XOR : fecScheme_RLC,
+                            plugin_arguments.busy_poll, 100, after_poll, &exiting);
+    }
 
     // Close socket
     if (close(sfd) == -1) {
@@ -337,8 +545,19 @@ cleanup:
     bpf_object__unpin_programs(skel->obj,  "/sys/fs/bpf/decoder");
     bpf_map__unpin(map_xorBuffer, "/sys/fs/bpf/decoder/xorBuffer");
     bpf_map__unpin(map_fecConvolutionBuffer, "/sys/fs/bpf/decoder/fecConvolutionInfoMap");
+    bpf_map__unpin(skel->maps.fecConvolutionTemplate, "/sys/fs/bpf/decoder/fecConvolutionTemplate");
+    bpf_map__unpin(skel->maps.contextShares, "/sys/fs/bpf/decoder/contextShares");
+    bpf_map__unpin(skel->maps.sourceSymbolPool_small, "/sys/fs/bpf/decoder/sourceSymbolPool_small");
+    bpf_map__unpin(skel->maps.sourceSymbolPool_medium, "/sys/fs/bpf/decoder/sourceSymbolPool_medium");
+    bpf_map__unpin(skel->maps.sourceSymbolPool_large, "/sys/fs/bpf/decoder/sourceSymbolPool_large");
+    bpf_map__unpin(skel->maps.repairSymbolPool_small, "/sys/fs/bpf/decoder/repairSymbolPool_small");
+    bpf_map__unpin(skel->maps.repairSymbolPool_medium, "/sys/fs/bpf/decoder/repairSymbolPool_medium");
+    bpf_map__unpin(skel->maps.repairSymbolPool_large, "/sys/fs/bpf/decoder/repairSymbolPool_large");
+    bpf_map__unpin(skel->maps.gf256Tables, "/sys/fs/bpf/decoder/gf256Tables");
+    bpf_map__unpin(skel->maps.rlcCoefs, "/sys/fs/bpf/decoder/rlcCoefs");
     // Do not know if I have to unpin the perf event too
     bpf_map__unpin(map_events, "/sys/fs/bpf/decoder/events");
+    bpf_map__unpin(map_events_rb, "/sys/fs/bpf/decoder/events_rb");
     decoder_bpf__destroy(skel);
     // Free memory of the RLC structure
     free_rlc_decode(rlc);
@@ -6,9 +6,25 @@
 #define BPF_ERROR BPF_OK  // Choose action when an error occurs in the process
 #define DEBUG 0
 
+// Size of the ring buffer used to communicate with user space (if enabled)
+#define EVENTS_RINGBUF_SIZE (1 << 22) // Must hold several block repair symbols
+
 #define RLC_RECEIVER_BUFFER_SIZE 32
+// The repair symbols of a window are stored next to each other in the repair symbol pool
+#define RLC_RECEIVER_REPAIR_SLOTS (RLC_RECEIVER_BUFFER_SIZE * MAX_RLC_RS_NUMBER)
+#define RLC_REPAIR_SYMBOL_ID(encodingSymbolID, index) ((encodingSymbolID) * MAX_RLC_RS_NUMBER + (index))
+#define MAX_WINDOW_CHECK 5 // Maximum number of consecutive windows combined to recover lost symbols
+
+// The eBPF program recovers the single losses of the symbols of at most this size (a power of 2 fitting the small class of the pools).
+// Its loops over the bytes of the symbols must stay small enough for the verifier
+#define RLC_KERNEL_RECOVERY_SIZE 512
+#define RLC_KERNEL_COEFS_KEYS (1 << 16) // One entry of coefficients per repairKey
+#define RLC_KERNEL_RECOVERED 0x8 // First byte of the messages of the source symbols recovered by the eBPF program
 
-#define MAX_BLOCK 5
+// Decoding contexts of the convolutional framework: one per stream of encodingSymbolIDs of each encoder
+#define MAX_DECODE_CONTEXTS 1024
+#define DECODE_CONTEXT_IDLE_TIMEOUT_NS 10000000000ULL // 10 seconds
+#define DECODE_CONTEXT_NO_SHARE 0xffffffff // Share of a context being created
 
 typedef struct sourceSymbol_t {
     __u8 packet[MAX_PACKET_SIZE];
@@ -36,10 +52,13 @@ typedef struct xorStruct {
     struct sourceBlock_t sourceBlocks;
 } xorStruct_t;
 
+// The payloads of the repair symbols are stored in the repairSymbolPool maps (see RLC_REPAIR_SYMBOL_ID)
 typedef struct {
-    struct repairSymbol_t repairSymbol;
+    struct tlvRepair__convo_t tlv[MAX_RLC_RS_NUMBER]; // By position of the repair symbol in the window
+    __u16 packet_length[MAX_RLC_RS_NUMBER];
     __u8 received_ss;
     __u8 received_rs;
+    __u8 repair_mask; // Bit i is set if the repair symbol at position i is received
     __u32 encodingSymbolID;
 } window_info_t;
 
@@ -48,15 +67,26 @@ typedef struct {
     __u32 encodingSymbolID; // Of the current repair symbol
     __u16 repairKey;
     __u8 ringBuffSize; // Number of packets for next coding in the ring buffer
-    struct sourceSymbol_t sourceRingBuffer[RLC_RECEIVER_BUFFER_SIZE];
+    struct tlvSource__convo_t sourceTlvBuffer[RLC_RECEIVER_BUFFER_SIZE]; // The packets are stored in the sourceSymbolPool maps
     window_info_t windowInfoBuffer[RLC_RECEIVER_BUFFER_SIZE];
     // Controller values
     __u32 most_recent_encodingSymbolID;
     __u32 last_encodingSymbolID; // Of the previous update
     __u16 received_counter;
+    __u16 loss_bursts; // Gaps in the encodingSymbolIDs of the received source symbols since the previous update
     __u16 controller_update;
+    __u32 share; // Share of the symbol pools and of the recovered symbols of user space used by the context
+    __u64 last_seen; // bpf_ktime_get_ns() of the last symbol of the context, for the eviction by user space
 } fecConvolution_t;
 
+// Key of a decoding context: SID of the encoder and stream of the encodingSymbolIDs in this encoder
+typedef struct {
+    __u64 encoder_hi;
+    __u64 encoder_lo;
+    __u32 stream;
+    __u32 padding;
+} decode_context_key_t;
+
 typedef struct {
     __u8 packet[MAX_PACKET_SIZE];
     __u16 packet_length;
@@ -66,13 +96,38 @@ typedef struct {
 typedef struct {
     __u8 *muls;
     __u8 *table_inv;
-    recoveredSource_t *recoveredSources[RLC_RECEIVER_BUFFER_SIZE];
+    recoveredSource_t **recoveredSources; // RLC_RECEIVER_BUFFER_SIZE entries per share (decoding context)
+    __u32 shares;
+    symbol_pool_t sourcePool; // mmapped sourceSymbolPool maps
+    symbol_pool_t repairPool; // mmapped repairSymbolPool maps
+    struct raw_socket_batch *batch; // Recovered symbols waiting for sendmmsg, NULL to send them one by one
+    struct rlc_decode_arena *arena; // Memory reused by each recovery
+    struct rlc_decode_system *systems; // Reduced system of each share (decoding context), updated by each recovery
 } decode_rlc_t;
 
+// Tables of GF(256) used by the eBPF program, filled by user space
+typedef struct {
+    __u8 mul[256 * 256]; // mul[a * 256 + b] = a * b
+    __u8 inv[256];
+} gf256_tables_t;
+
+// Coefficients of the source symbols of a window for a repairKey (see fec_scheme/window_rlc_gf256/rlc_coefs.c)
+typedef struct {
+    __u8 coefs[MAX_RLC_WINDOW_SIZE];
+} rlc_coefs_t;
+
+// Source symbol recovered by the eBPF program and stored in the source symbol pool: user space only sends it
+typedef struct {
+    __u8 message_type; // RLC_KERNEL_RECOVERED
+    __u32 share;
+    __u32 encodingSymbolID;
+} kernel_recovered_t;
+
 typedef struct {
     __u8 controller_repair;
     __u16 received_counter;
     __u16 theoretical_counter;
+    __u16 loss_bursts;
 } controller_t;
 
 #endif
\ No newline at end of file
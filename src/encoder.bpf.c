@@ -9,16 +9,11 @@
 #include <bpf/bpf_core_read.h>
 #include <bpf/bpf_tracing.h>
 #include "libseg6.c"
+#include "events.c"
 #include "encoder.bpf.h"
 #include "fec_framework/window_sender.c"
 #include "fec_framework/block_sender.c"
-
-// Perf even buffer to communicate with the user space 
-struct {
-    __uint(type, BPF_MAP_TYPE_PERF_EVENT_ARRAY);
-    __uint(key_size, sizeof(__u32));
-    __uint(value_size, sizeof(__u32));
-} events SEC(".maps");
+#include "fec_framework/rate_controller.c"
 
 SEC("lwt_seg6local_convo")
 int srv6_fec_encode_convo(struct __sk_buff *skb)
@@ -33,7 +28,6 @@ int srv6_fec_encode_convo(struct __sk_buff *skb)
     //if (DEBUG) bpf_printk("BPF triggered from packet with SRv6 !\n");
 
     int err;
-    int k = 0; // Key for hashmap
 
     // Get Segment Routing Header 
     struct ip6_srh_t *srh = seg6_get_srh(skb);
@@ -42,7 +36,7 @@ int srv6_fec_encode_convo(struct __sk_buff *skb)
         return BPF_ERROR;
     }
 
-    fecConvolution_t *fecConvolution = bpf_map_lookup_elem(&fecConvolutionInfoMap, &k);
+    fecConvolution_t *fecConvolution = fecFramework__context(skb);
     if (!fecConvolution) return BPF_ERROR;
 
     struct tlvSource__convo_t tlv;
@@ -72,7 +66,7 @@ int srv6_fec_encode_block(struct __sk_buff *skb)
     //if (DEBUG) bpf_printk("BPF triggered from packet with SRv6 !\n");
 
     int err;
-    int k = 0;  // Key for hashmap
+    __u32 k = sender_state_key(); // Key for the state map
 
     // Get Segment Routing Header 
     struct ip6_srh_t *srh = seg6_get_srh(skb);
@@ -98,14 +92,48 @@ int srv6_fec_encode_block(struct __sk_buff *skb)
 
     // Add the TLV to the current source symbol and forward 
     __u16 tlv_length = sizeof(struct tlvSource__block_t);
+    int repair = err == 1;
     err = seg6_add_tlv(skb, srh, (srh->hdrlen + 1) << 3, (struct sr6_tlv_t *)&tlv, tlv_length);
-    return (err) ? BPF_ERROR : BPF_OK;
+    if (err) {
+        return BPF_ERROR;
+    }
+
+    // The packet is complete: the tc egress program can recognize it and send the repair packet after it
+    if (repair && kernel_repair) {
+        kernel_repair__mark(skb);
+    }
+    return BPF_OK;
+}
+
+// Attached by user space to the egress of the output interface with the kernel repair mode of the block framework.
+// Sends the repair packet of the block after the source packet that completed it
+SEC("classifier_block_repair")
+int srv6_fec_repair_block(struct __sk_buff *skb)
+{
+    return kernel_repair__send(skb);
+}
+
+// Run by user space with BPF_PROG_TEST_RUN (see flush_idle_windows()), never attached.
+// The payload of the packet is the key of the FEC context to flush
+SEC("lwt_seg6local_flush")
+int srv6_fec_flush_convo(struct __sk_buff *skb)
+{
+    fec_context_key_t key;
+    if (bpf_skb_load_bytes(skb, 0, &key, sizeof(fec_context_key_t)) < 0) {
+        return BPF_DROP;
+    }
+
+    fecConvolution_t *fecConvolution = bpf_map_lookup_elem(&fecConvolutionInfoMap, &key);
+    if (!fecConvolution) {
+        return BPF_DROP;
+    }
+
+    fecFramework__flush(skb, fecConvolution, &events);
+    return BPF_DROP;
 }
 
 SEC("lwt_seg6local_controller")
 static int handle_controller(struct __sk_buff *skb) {
-    int k = 0;
-
     // Get Segment Routing Header 
     struct ip6_srh_t *srh = seg6_get_srh(skb);
     if (!srh) {
@@ -113,8 +141,15 @@ static int handle_controller(struct __sk_buff *skb) {
         return BPF_DROP;
     }
 
-    fecConvolution_t *fecConvolution = bpf_map_lookup_elem(&fecConvolutionInfoMap, &k);
-    if (!fecConvolution) return BPF_ERROR;
+    // The statistics come from the decoder: they apply to its contexts
+    struct ip6_t *ip6 = seg6_get_ipv6(skb);
+    if (!ip6) {
+        return BPF_DROP;
+    }
+    fec_context_key_t key;
+    memset(&key, 0, sizeof(fec_context_key_t));
+    key.sid_hi = ip6->src_hi;
+    key.sid_lo = ip6->src_lo;
 
     tlv_controller_t tlv;
     long cursor = seg6_find_tlv(skb, srh, TLV_CODING_SOURCE, sizeof(tlv));
@@ -125,19 +160,17 @@ static int handle_controller(struct __sk_buff *skb) {
 
     if (bpf_skb_load_bytes(skb, cursor, &tlv, sizeof(tlv)) < 0) return BPF_DROP;
 
-    bpf_spin_lock(&fecConvolution->lock);
-
-    fecConvolution->controller_repair = 2;
-
-    // Update internal value controlling the sending of repair symbol
-    // with the value of the tlv.
-    // We only update the last bit as the penultimate controls if we want to use the controller 
-    if ((tlv.received_counter * 100) / tlv.theoretical_counter <= 98) {
-        fecConvolution->controller_repair += 1;
+    // The decision applies to every flow (or CPU) toward this decoder.
+    // The contexts of the other CPUs apply it with their next packet (see rate_controller__update)
+    __u32 flows = per_cpu_state ? encoder_streams : context_flows;
+    for (__u32 flow = 0; flow < MAX_CONTEXT_FLOWS && flow < flows; ++flow) {
+        key.flow = flow;
+        fecConvolution_t *fecConvolution = bpf_map_lookup_elem(&fecConvolutionInfoMap, &key);
+        if (fecConvolution) {
+            rate_controller__update(fecConvolution, &tlv);
+        }
     }
 
-    bpf_spin_unlock(&fecConvolution->lock);
-
     return BPF_DROP;
 }
 
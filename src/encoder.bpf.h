@@ -4,20 +4,44 @@
 #include "encoder.h"
 
 typedef struct {
+    __u8 message_type; // RLC_WINDOW_DESCRIPTOR, first field of the descriptor sent to user space
     __u32 encodingSymbolID;
     __u16 repairKey;
     __u8 ringBuffSize; // Number of packets for next coding in the ring buffer
-    struct sourceSymbol_t sourceRingBuffer[RLC_BUFFER_SIZE];
-    struct tlvRepair__convo_t repairTlv[RLC_RS_NUMBER];
+    struct tlvRepair__convo_t repairTlv[MAX_RLC_RS_NUMBER];
     __u8 currentWindowSize;
     __u8 currentWindowSlide;
+    __u8 repairSymbols; // Number of repair symbols per window, at most MAX_RLC_RS_NUMBER
     // Controller parameters
     __u8 controller_repair; // Enabling or not the controller
     __u8 controller_threshold; // Threshold for the decision function
     __u16 controller_period; // Period between two statistics messages
+    __u64 decoder_hi; // SID of the decoder of the context, destination of the repair symbols
+    __u64 decoder_lo;
+    __u64 last_seen; // Time of the last packet protected by the context (bpf_ktime_get_ns)
+    __u64 first_unprotected; // Time of the first source symbol not covered by a repair symbol yet, 0 if none
+    // Adaptive controller, see rate_controller.c
+    __u16 loss_rate; // Smoothed loss rate of the channel toward the decoder, in 1/RATE_CONTROLLER_LOSS_ONE
+    __u16 burst_length; // Smoothed mean number of consecutive lost source symbols, in 1/RATE_CONTROLLER_BURST_ONE
+    __u8 nextWindowSize; // Parameters of the next windows, applied when the current window is closed. 0 if unchanged
+    __u8 nextWindowSlide;
+    __u8 nextRepairSymbols;
+    // Statistics of the decoder posted by the controller to a context with per-CPU state, applied by the CPU of the context
+    tlv_controller_t mailbox;
+    __u8 mailbox_full;
     struct bpf_spin_lock lock;
 } fecConvolution_t;
 
+// Stream of encodingSymbolIDs (see ESI_STREAM), claimed by a FEC context.
+// The stream keeps its sequence when its context is evicted: a new context of the stream continues it,
+// so that it does not reuse encodingSymbolIDs that the decoder may still know
+typedef struct {
+    fec_context_key_t owner;
+    __u32 next_id; // encodingSymbolID of the next symbol of the stream, 0 if the stream was never used
+    __u8 used; // The stream belongs to a FEC context
+    struct bpf_spin_lock lock;
+} context_stream_t;
+
 typedef struct {
     __u16 soubleBlock;
     __u16 sourceSymbolCount;
@@ -1,4 +1,5 @@
 // SPDX-License-Identifier: (LGPL-2.1 OR BSD-2-Clause)
+#define _GNU_SOURCE // pthread_setaffinity_np
 #include <stdio.h>
 #include <signal.h>
 #include <unistd.h>
@@ -8,14 +9,24 @@
 #include <sys/resource.h>
 #include <errno.h>
 #include <getopt.h>
+#include <net/if.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/epoll.h>
+#include <linux/if_ether.h>
 #include <bpf/libbpf.h>
 #include "encoder.skel.h"
 #include <bpf/bpf.h>
 #include "encoder.bpf.h"
 #include "raw_socket/raw_socket_sender.h"
 #include "fec_scheme/window_rlc_gf256/rlc_gf256.c"
+#include "events/events.c"
 
 #define MAX_CONTROLLER_UPDATE_LATENCY 10000
+#define MAX_FLUSH_TIMEOUT_US 10000000 // 10 seconds
+#define MAX_WORKERS 64
+#define MAX_WORKER_BUFFERS (MAX_WORKERS * 4) // Per-CPU perf buffers consumed by a worker
+#define REPAIR_TC_PREF 4076 // Priority of the tc filter of the repair program, to delete only this filter
 
 enum fec_framework {
     CONVO = 0,
@@ -25,27 +36,69 @@ enum fec_framework {
 typedef struct {
     char encoder_ip[48];
     char decoder_ip[48];
+    bool decoder_given; // -d given: the convo repair symbols go to decoder_ip instead of the decoder of their context
     enum fec_framework framework;
     uint8_t block_size;
     uint8_t window_size;
     uint8_t window_slide;
+    uint8_t repair_symbols; // Per window
     bool attach;
     char interface[15];
     char controller_ip[48];
     uint8_t controller;
     uint16_t controller_update_every;
     uint8_t controller_threshold; // Percentage
+    bool ringbuf;
+    bool busy_poll;
+    uint32_t ringbuf_wakeup; // Bytes, 0 for the default wakeup
+    bool batch; // Send the generated packets with sendmmsg
+    char tx_ring_interface[IF_NAMESIZE]; // If set, send the generated packets through a PACKET_TX_RING on this interface
+    uint8_t tx_ring_mac[6]; // Next hop of the generated packets (with tx_ring_interface)
+    uint8_t workers; // 0: everything is done by the main thread
+    bool per_cpu_state; // Each CPU encodes its own stream without sharing the state of the FEC Framework
+    uint32_t cpus; // Number of CPUs with their own state (per_cpu_state), else 1
+    uint32_t flows; // Number of flow buckets of the FEC contexts toward a decoder
+    uint32_t streams; // Number of streams of encodingSymbolIDs, i.e. maximum number of FEC contexts
+    bool incremental; // Fold the source symbols in the repair symbols of their windows as they arrive
+    uint32_t flush_timeout; // Microseconds before protecting an incomplete window, 0 to wait for a full window
+    bool adaptive; // The controller also tunes the window parameters to the losses reported by the decoder
+    char repair_interface[IF_NAMESIZE]; // If set, the block repair symbols are sent by the tc egress program of this interface
 } args_t;
 
+// Worker of the pool: consumes a subset of the per-CPU perf buffers with its own RLC structure and socket
+typedef struct {
+    pthread_t thread;
+    int id;
+    size_t buffers[MAX_WORKER_BUFFERS]; // Indexes of the per-CPU perf buffers consumed by the worker
+    int nb_buffers;
+    cpu_set_t cpuset; // CPUs of the buffers, to which the worker is pinned
+    int sfd;
+    encode_rlc_t *rlc;
+    struct perf_buffer *pb;
+    bool busy_poll;
+} worker_t;
+
 
 static volatile int sfd = -1;
 static volatile int first_sfd = 1;
 
+// FEC contexts of the convolutional framework and owners of their streams, see evict_idle_contexts()
+static int map_fd_contexts = -1;
+static int map_fd_context_streams = -1;
+
+// Program protecting the incomplete windows, see flush_idle_windows()
+static int prog_fd_flush = -1;
+static __u64 flush_timeout_ns = 0;
+
 static struct sockaddr_in6 src;
 static struct sockaddr_in6 dst;
+static bool context_decoder = false; // The convo repair symbols go to the decoder of their context instead of dst
 
 encode_rlc_t *rlc = NULL;
 
+// Worker running the perf buffer callbacks, NULL if they are called by the main thread
+static __thread worker_t *current_worker = NULL;
+
 // Used to detect the end of the program
 static volatile bool exiting = 0;
 
@@ -76,13 +129,37 @@ static void send_repairSymbol_XOR(void *ctx, int cpu, void *data, __u32 data_sz)
     // ->tlv: the TLV to be added in the SRH header 
      
     const struct repairSymbol_t *repairSymbol = (struct repairSymbol_t *)data;
-    send_raw_socket(sfd, repairSymbol, src, dst);
+    encode_rlc_t *worker_rlc = current_worker ? current_worker->rlc : rlc;
+    if (worker_rlc->batch) {
+        queue_raw_socket(worker_rlc->batch, repairSymbol, src, dst);
+    } else {
+        send_raw_socket(current_worker ? current_worker->sfd : sfd, repairSymbol, src, dst);
+    }
 }
 
 static void fecScheme(void *ctx, int cpu, void *data, __u32 data_sz) {
+    uint8_t *message_type = (uint8_t *)data;
+    // Incremental encoding: the kernel also notifies each protected source symbol
+    if (*message_type == RLC_SOURCE_NOTIFICATION) {
+        rlc__fold_source_symbol(current_worker ? current_worker->rlc : rlc, (source_notification_t *)data);
+        return;
+    } else if (*message_type != RLC_WINDOW_DESCRIPTOR) {
+        return;
+    }
     fecConvolution_user_t *fecConvolution = (fecConvolution_user_t *)data;
+    // Without -d, the repair symbols are sent to the decoder of the context of the window
+    struct sockaddr_in6 context_dst = dst;
+    if (context_decoder) {
+        memcpy(context_dst.sin6_addr.s6_addr, &fecConvolution->decoder_hi, sizeof(__u64));
+        memcpy(context_dst.sin6_addr.s6_addr + sizeof(__u64), &fecConvolution->decoder_lo, sizeof(__u64));
+    }
     // Generate the repair symbol 
-    int err = rlc__generate_repair_symbols(fecConvolution, rlc, sfd, &src, &dst);
+    int err;
+    if (current_worker) {
+        err = rlc__generate_repair_symbols(fecConvolution, current_worker->rlc, current_worker->sfd, &src, &context_dst);
+    } else {
+        err = rlc__generate_repair_symbols(fecConvolution, rlc, sfd, &src, &context_dst);
+    }
     if (err < 0) {
         printf("ERROR. TODO: handle\n");
         return;
@@ -91,19 +168,190 @@ static void fecScheme(void *ctx, int cpu, void *data, __u32 data_sz) {
     return;
 }
 
-static void handle_events(int map_fd_events, enum fec_framework framework) {
-    // Define structure for the perf event 
-    struct perf_buffer_opts pb_opts = {0};
-    if (framework == BLOCK) {
-        pb_opts.sample_cb = send_repairSymbol_XOR;
-    } else {
-        pb_opts.sample_cb = fecScheme;
+static int send_repairSymbol_XOR_rb(void *ctx, void *data, size_t data_sz) {
+    send_repairSymbol_XOR(ctx, 0, data, data_sz);
+    return 0;
+}
+
+static int fecScheme_rb(void *ctx, void *data, size_t data_sz) {
+    fecScheme(ctx, 0, data, data_sz);
+    return 0;
+}
+
+// Deletes the FEC contexts that did not protect any packet for CONTEXT_IDLE_TIMEOUT_NS and releases their stream.
+// Only runs once per second, so it can be called after each poll of the events
+static void evict_idle_contexts() {
+    static __u64 last_run = 0;
+    fec_context_key_t keys[MAX_ENCODER_STREAMS];
+    fec_context_key_t key, prev_key;
+    fecConvolution_t context;
+    int nb_idle = 0;
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts); // Same clock as bpf_ktime_get_ns()
+    __u64 now = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    if (map_fd_contexts < 0 || now - last_run < 1000000000ULL) {
+        return;
+    }
+    last_run = now;
+
+    // The contexts are deleted after the iteration to not disturb it
+    void *prev = NULL;
+    while (nb_idle < MAX_ENCODER_STREAMS && bpf_map_get_next_key(map_fd_contexts, prev, &key) == 0) {
+        if (bpf_map_lookup_elem(map_fd_contexts, &key, &context) == 0 && now > context.last_seen &&
+                now - context.last_seen > CONTEXT_IDLE_TIMEOUT_NS) {
+            keys[nb_idle++] = key;
+        }
+        prev_key = key;
+        prev = &prev_key;
+    }
+
+    for (int i = 0; i < nb_idle; ++i) {
+        // Check again: a packet may have used the context in the meantime
+        if (bpf_map_lookup_elem(map_fd_contexts, &keys[i], &context) < 0 || now < context.last_seen ||
+                now - context.last_seen <= CONTEXT_IDLE_TIMEOUT_NS) {
+            continue;
+        }
+        __u32 stream = ESI_STREAM(context.encodingSymbolID);
+        bpf_map_delete_elem(map_fd_contexts, &keys[i]);
+        // The next context of the stream continues its sequence
+        context_stream_t owner = {
+            .next_id = context.encodingSymbolID,
+            .used = 0,
+        };
+        bpf_map_update_elem(map_fd_context_streams, &stream, &owner, BPF_F_LOCK);
+    }
+}
+
+// Runs the flush program on the FEC contexts whose first unprotected source symbol waits for more than flush_timeout_ns,
+// so that the repair symbols of their partial window are generated although no new packet triggers the encoder.
+// Only scans the contexts every flush_timeout_ns / 2, so it can be called after each (busy) poll of the events
+static void flush_idle_windows() {
+    static __u64 last_run = 0;
+    fec_context_key_t key, prev_key;
+    fecConvolution_t context;
+    // The packet of BPF_PROG_TEST_RUN starts with an Ethernet header, the program reads the key after it
+    struct {
+        __u8 eth[ETH_HLEN];
+        fec_context_key_t key;
+    } request;
+    __u32 retval;
+
+    if (prog_fd_flush < 0 || map_fd_contexts < 0) {
+        return;
+    }
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts); // Same clock as bpf_ktime_get_ns()
+    __u64 now = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    if (now - last_run < flush_timeout_ns / 2) {
+        return;
+    }
+    last_run = now;
+
+    memset(&request, 0, sizeof(request));
+    void *prev = NULL;
+    while (bpf_map_get_next_key(map_fd_contexts, prev, &key) == 0) {
+        // The kernel checks the deadline again under the lock of the context
+        if (bpf_map_lookup_elem(map_fd_contexts, &key, &context) == 0 && context.first_unprotected &&
+                now >= context.first_unprotected + flush_timeout_ns) {
+            request.key = key;
+            bpf_prog_test_run(prog_fd_flush, 1, &request, sizeof(request), NULL, NULL, &retval, NULL);
+        }
+        prev_key = key;
+        prev = &prev_key;
     }
+}
 
-    struct perf_buffer *pb = NULL;
+// Maximum time to wait for events: the incomplete windows must be flushed in time
+static int poll_timeout_ms() {
+    if (prog_fd_flush < 0) {
+        return 100;
+    }
+    __u64 timeout_ms = flush_timeout_ns / 2000000ULL;
+    return timeout_ms < 1 ? 1 : (timeout_ms > 100 ? 100 : timeout_ms);
+}
+
+// Called after each poll of the events
+static void after_poll() {
+    // The descriptors of the flushed windows are consumed by the next poll
+    flush_idle_windows();
+    // Send the packets generated by the events of this poll
+    if (rlc->batch) {
+        raw_socket_batch__flush(rlc->batch);
+    }
+    evict_idle_contexts();
+}
+
+static void *worker_loop(void *arg) {
+    worker_t *worker = (worker_t *)arg;
+    current_worker = worker;
+    int efd = -1;
+    int nb_buffers = worker->nb_buffers;
+    struct epoll_event events[MAX_WORKER_BUFFERS];
+
+    // Pin the worker so that it stays close to the CPUs producing its events
+    if (CPU_COUNT(&worker->cpuset) > 0 && pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &worker->cpuset) != 0) {
+        fprintf(stderr, "Worker %d: cannot pin to the CPUs of its buffers\n", worker->id);
+    }
+
+    efd = epoll_create1(EPOLL_CLOEXEC);
+    if (efd < 0) {
+        perror("Cannot create epoll");
+        goto cleanup;
+    }
+
+    for (int i = 0; i < nb_buffers; ++i) {
+        struct epoll_event event = {
+            .events = EPOLLIN,
+            .data.u64 = worker->buffers[i],
+        };
+        if (epoll_ctl(efd, EPOLL_CTL_ADD, perf_buffer__buffer_fd(worker->pb, worker->buffers[i]), &event) < 0) {
+            perror("Cannot add perf buffer to epoll");
+            goto cleanup;
+        }
+    }
+
+    while (!exiting) {
+        if (worker->busy_poll) {
+            for (int i = 0; i < nb_buffers; ++i) {
+                perf_buffer__consume_buffer(worker->pb, worker->buffers[i]);
+            }
+            if (worker->rlc->batch) {
+                raw_socket_batch__flush(worker->rlc->batch);
+            }
+            continue;
+        }
+        int n = epoll_wait(efd, events, nb_buffers > 0 ? nb_buffers : 1, 100);
+        if (n < 0 && errno != EINTR) {
+            perror("Error polling perf buffers");
+            goto cleanup;
+        }
+        for (int i = 0; i < n; ++i) {
+            perf_buffer__consume_buffer(worker->pb, events[i].data.u64);
+        }
+        if (worker->rlc->batch) {
+            raw_socket_batch__flush(worker->rlc->batch);
+        }
+    }
+
+cleanup:
+    if (efd >= 0) close(efd);
+    return NULL;
+}
+
+// Same as events__handle_perf() but the per-CPU perf buffers are consumed by *nb_workers* pinned threads,
+// each one with its own RLC structure and raw socket
+static void handle_events_workers(int map_fd_events, enum fec_framework framework, args_t *args, int pool_fds[3]) {
+    bool busy_poll = args->busy_poll;
+    int nb_workers = args->workers;
+    struct perf_buffer_opts pb_opts = {0};
+    pb_opts.sample_cb = framework == BLOCK ? send_repairSymbol_XOR : fecScheme;
+    worker_t workers[MAX_WORKERS];
+    memset(workers, 0, sizeof(workers));
+    int started = 0;
     int err;
 
-    pb = perf_buffer__new(map_fd_events, 128, &pb_opts);
+    struct perf_buffer *pb = perf_buffer__new(map_fd_events, 128, &pb_opts);
     err = libbpf_get_error(pb);
     if (err) {
         pb = NULL;
@@ -111,18 +359,85 @@ static void handle_events(int map_fd_events, enum fec_framework framework) {
         goto cleanup;
     }
 
-    // Enter in loop until a signal is retrieved
-    // Poll the recovered packet from the BPF program
-     
-    while (!exiting) {
-        err = perf_buffer__poll(pb, 100);
-        if (err < 0 && errno != EINTR) {
-            fprintf(stderr, "Error polling perf buffer: %d\n", err);
+    // The per-CPU buffers are shared in a round-robin way between the workers.
+    // The buffer i receives the events of the CPU i (none if the CPU is offline)
+    size_t buffer_cnt = perf_buffer__buffer_cnt(pb);
+    int nb_buffers = 0;
+    for (size_t i = 0; i < buffer_cnt; ++i) {
+        if (perf_buffer__buffer_fd(pb, i) < 0) continue;
+        worker_t *worker = &workers[nb_buffers++ % nb_workers];
+        if (worker->nb_buffers == MAX_WORKER_BUFFERS || i >= CPU_SETSIZE) {
+            fprintf(stderr, "Cannot share %zu perf buffers between %d workers: at most %d buffers of the first %d CPUs per worker\n",
+                    buffer_cnt, nb_workers, MAX_WORKER_BUFFERS, CPU_SETSIZE);
+            goto cleanup;
+        }
+        worker->buffers[worker->nb_buffers++] = i;
+        CPU_SET(i, &worker->cpuset);
+    }
+
+    for (int i = 0; i < nb_workers; ++i) {
+        worker_t *worker = &workers[i];
+        worker->id = i;
+        worker->pb = pb;
+        worker->busy_poll = busy_poll;
+        worker->sfd = socket(AF_INET6, SOCK_RAW, IPPROTO_RAW);
+        if (worker->sfd == -1) {
+            perror("Cannot create socket");
             goto cleanup;
         }
+        worker->rlc = initialize_rlc();
+        if (!worker->rlc) {
+            perror("Cannot create structure");
+            goto cleanup;
+        }
+        err = symbol_pool__mmap(&worker->rlc->sourcePool, pool_fds[0], pool_fds[1], pool_fds[2], RLC_BUFFER_SIZE, args->streams);
+        if (err < 0) {
+            perror("Cannot mmap the source symbol pool");
+            goto cleanup;
+        }
+        if (args->incremental && rlc__enable_incremental(worker->rlc) < 0) {
+            perror("Cannot create the pending windows");
+            goto cleanup;
+        }
+        if (args->tx_ring_interface[0]) {
+            // Each worker has its own TX ring to avoid sharing the frames
+            worker->rlc->batch = raw_socket_batch__new_tx_ring(args->tx_ring_interface, args->tx_ring_mac);
+            if (!worker->rlc->batch) {
+                fprintf(stderr, "Cannot create the TX ring on %s\n", args->tx_ring_interface);
+                goto cleanup;
+            }
+        } else if (args->batch) {
+            worker->rlc->batch = raw_socket_batch__new(worker->sfd);
+            if (!worker->rlc->batch) {
+                perror("Cannot create the packet batch");
+                goto cleanup;
+            }
+        }
+    }
+
+    for (; started < nb_workers; ++started) {
+        if (pthread_create(&workers[started].thread, NULL, worker_loop, &workers[started]) != 0) {
+            perror("Cannot create worker");
+            exiting = 1;
+            break;
+        }
+    }
+
+    // The workers only consume the events, the main thread takes care of the idle contexts
+    while (!exiting) {
+        usleep(poll_timeout_ms() * 1000);
+        flush_idle_windows();
+        evict_idle_contexts();
     }
 
 cleanup:
+    for (int i = 0; i < started; ++i) {
+        pthread_join(workers[i].thread, NULL);
+    }
+    for (int i = 0; i < nb_workers; ++i) {
+        if (workers[i].rlc) free_rlc(workers[i].rlc);
+        if (workers[i].sfd > 0) close(workers[i].sfd);
+    }
     perf_buffer__free(pb);
 }
 
@@ -131,18 +446,34 @@ void usage(char *prog_name) {
     fprintf(stderr, "    %s [-f framework] [-e encoder ipv6] [-d decoder ipv6]\n", prog_name);
     fprintf(stderr, "    -f framework (default: convo): FEC Framework to use [convo, block]\n");
     fprintf(stderr, "    -e encoder_ip (default: fc00::a): IPv6 of the encoder router\n");
-    fprintf(stderr, "    -d decoder_ip (default: fc00::9): IPv6 of the decoder router\n");
+    fprintf(stderr, "    -d decoder_ip (default: fc00::9): IPv6 of the decoder router, destination of the repair symbols (if not given with the convo framework, the repair symbols of a context go to the next segment of its packets)\n");
     fprintf(stderr, "    -b block_size (default: 3): size of a FEC Block (used if framework is block)\n");
     fprintf(stderr, "    -w window_size (default: 4): size of the FEC Window (used if framework is convo)\n");
     fprintf(stderr, "    -s window_slide (default: 2) slide of the window after each repair symbol (used if framework is convo)\n");
+    fprintf(stderr, "    -R repair_symbols (default: 1): number of repair symbols generated for each window (used if framework is convo)\n");
     fprintf(stderr, "    -a attach: if set, attempts to attach the program to *encoder_ip*\n");
     fprintf(stderr, "    -i interface: the interface to which attach the program (if *attach* is set)\n");
     fprintf(stderr, "    -c controller_ip (default: fc00::b): activate the controller mechanism\n");
     fprintf(stderr, "    -l update_latency: the number of packets between two controller update (default: 1000)\n");
     fprintf(stderr, "    -t threshold: controller threshold below which repair symbols are forwarded (default: 98)\n");
+    fprintf(stderr, "    -A: with -c, adaptive code rate: the window size, slide and number of repair symbols follow the loss rate and burst length reported by the decoder\n");
+    fprintf(stderr, "    -r: use a ring buffer (5.8+ kernel) instead of per-CPU perf buffers to communicate with the kernel\n");
+    fprintf(stderr, "    -p: busy poll the events instead of waiting for a wakeup\n");
+    fprintf(stderr, "    -W bytes: with -r, only wake up user space when at least *bytes* are pending, below the size of the ring buffer (default: 0, every event)\n");
+    fprintf(stderr, "    -B: batch the generated packets and send them with sendmmsg after each poll of the events\n");
+    fprintf(stderr, "    -x interface: write the generated packets in a PACKET_TX_RING of *interface* instead of using the IPv6 stack (implies -B)\n");
+    fprintf(stderr, "    -m mac: with -x, MAC address of the next hop (default: 00:00:00:00:00:00, e.g. for lo)\n");
+    fprintf(stderr, "    -T workers: consume the per-CPU perf buffers with *workers* threads pinned to distinct CPUs (default: 0, single thread)\n");
+    fprintf(stderr, "    -C: per-CPU state: each CPU has its own window/block and encodingSymbolIDs instead of sharing them behind a lock\n");
+    fprintf(stderr, "    -F flows: with the convo framework, split the packets toward a decoder in *flows* FEC contexts by flow hash (default: 1)\n");
+    fprintf(stderr, "    -K contexts: maximum number of FEC contexts (decoder, flow or CPU), each one with its own window and source symbol pool (default: one per flow or CPU)\n");
+    fprintf(stderr, "    -D flush_timeout: with the convo framework, microseconds after which the source symbols of an incomplete window are protected by a repair symbol over the partial window (default: 0, wait for a full window)\n");
+    fprintf(stderr, "    -k interface: with the block framework, the repair packets are built and sent in the kernel by a tc egress program on *interface*, the output interface of the protected packets (no user space hop)\n");
+    fprintf(stderr, "    -I: incremental encoding: add each source symbol to the repair symbols of its windows when it is protected instead of when the window is complete (with -T, requires -C)\n");
 }
 
 int parse_args(args_t *args, int argc, char *argv[]) {
+    bool ringbuf_wakeup_given = false;
     memset(args, 0, sizeof(args_t));
     // Default values
     strcpy(args->encoder_ip, "fc00::a");
@@ -151,6 +482,7 @@ int parse_args(args_t *args, int argc, char *argv[]) {
     args->block_size = 3;
     args->window_size = 4;
     args->window_slide = 2;
+    args->repair_symbols = 1;
     args->attach = false;
     strcpy(args->controller_ip, "fc00::b");
     args->controller = 1;
@@ -160,7 +492,7 @@ int parse_args(args_t *args, int argc, char *argv[]) {
     bool interface_if_attach = false;
 
     int opt;
-    while ((opt = getopt(argc, argv, "f:e:d:b:w:s:ai:c:t:l:")) != -1) {
+    while ((opt = getopt(argc, argv, "f:e:d:b:w:s:R:ai:c:t:l:rpW:T:Bx:m:CF:K:ID:Ak:")) != -1) {
         switch (opt) {
             case 'f':
                 if (strncmp(optarg, "block", 6) == 0) {
@@ -185,6 +517,7 @@ int parse_args(args_t *args, int argc, char *argv[]) {
                     return -1;
                 }
                 strncpy(args->decoder_ip, optarg, 48);
+                args->decoder_given = true;
                 break;
             case 'b':
                 args->block_size = atoi(optarg);
@@ -207,6 +540,13 @@ int parse_args(args_t *args, int argc, char *argv[]) {
                     return -1;
                 }
                 break;
+            case 'R':
+                if (atoi(optarg) <= 0 || atoi(optarg) > MAX_RLC_RS_NUMBER) {
+                    fprintf(stderr, "Wrong number of repair symbols, needs to be in [1, %u]\n", MAX_RLC_RS_NUMBER);
+                    return -1;
+                }
+                args->repair_symbols = atoi(optarg);
+                break;
             case 'a':
                 args->attach = true;
                 break;
@@ -238,6 +578,73 @@ int parse_args(args_t *args, int argc, char *argv[]) {
                     return -1;
                 }
                 break;
+            case 'r':
+                args->ringbuf = true;
+                break;
+            case 'p':
+                args->busy_poll = true;
+                break;
+            case 'W':
+                args->ringbuf_wakeup = atoi(optarg);
+                if (atoi(optarg) < 0 || atoi(optarg) >= EVENTS_RINGBUF_SIZE) {
+                    fprintf(stderr, "Wrong wakeup threshold, needs to be in [0, %u[ bytes (size of the ring buffer)\n", EVENTS_RINGBUF_SIZE);
+                    return -1;
+                }
+                ringbuf_wakeup_given = true;
+                break;
+            case 'B':
+                args->batch = true;
+                break;
+            case 'x':
+                strncpy(args->tx_ring_interface, optarg, IF_NAMESIZE - 1);
+                break;
+            case 'm':
+                if (sscanf(optarg, "%hhx:%hhx:%hhx:%hhx:%hhx:%hhx", &args->tx_ring_mac[0], &args->tx_ring_mac[1], &args->tx_ring_mac[2],
+                           &args->tx_ring_mac[3], &args->tx_ring_mac[4], &args->tx_ring_mac[5]) != 6) {
+                    fprintf(stderr, "Wrong MAC address: %s\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'T':
+                args->workers = atoi(optarg);
+                if (atoi(optarg) < 0 || atoi(optarg) > MAX_WORKERS) {
+                    fprintf(stderr, "Wrong number of workers, needs to be in [0, %u]\n", MAX_WORKERS);
+                    return -1;
+                }
+                break;
+            case 'C':
+                args->per_cpu_state = true;
+                break;
+            case 'F':
+                args->flows = atoi(optarg);
+                if (atoi(optarg) <= 0 || atoi(optarg) > MAX_CONTEXT_FLOWS) {
+                    fprintf(stderr, "Wrong number of flows, needs to be in [1, %u]\n", MAX_CONTEXT_FLOWS);
+                    return -1;
+                }
+                break;
+            case 'K':
+                args->streams = atoi(optarg);
+                if (atoi(optarg) <= 0 || atoi(optarg) > MAX_ENCODER_STREAMS) {
+                    fprintf(stderr, "Wrong number of contexts, needs to be in [1, %u]\n", MAX_ENCODER_STREAMS);
+                    return -1;
+                }
+                break;
+            case 'I':
+                args->incremental = true;
+                break;
+            case 'A':
+                args->adaptive = true;
+                break;
+            case 'k':
+                strncpy(args->repair_interface, optarg, IF_NAMESIZE - 1);
+                break;
+            case 'D':
+                args->flush_timeout = atoi(optarg);
+                if (atoi(optarg) < 0 || atoi(optarg) > MAX_FLUSH_TIMEOUT_US) {
+                    fprintf(stderr, "Wrong flush timeout, needs to be in [0, %u] microseconds\n", MAX_FLUSH_TIMEOUT_US);
+                    return -1;
+                }
+                break;
             case '?':
                 usage(argv[0]);
                 return 1;
@@ -246,6 +653,56 @@ int parse_args(args_t *args, int argc, char *argv[]) {
                 return 1;
         }
     }
+    if (ringbuf_wakeup_given && !args->ringbuf) {
+        fprintf(stderr, "The wakeup threshold only applies to the ring buffer (-W needs -r)\n");
+        return -1;
+    }
+    if (args->workers > 0 && args->ringbuf) {
+        // The ring buffer is shared by all CPUs: there is no per-CPU buffer to give to the workers
+        fprintf(stderr, "The worker pool requires the per-CPU perf buffers (incompatible with -r)\n");
+        return -1;
+    }
+    if (args->workers > 0 && args->incremental && !args->per_cpu_state) {
+        // With a shared state, the source symbols of a context are notified from the perf buffers of all the CPUs,
+        // i.e. to distinct workers, while each worker folds them in its own pending windows
+        fprintf(stderr, "Incremental encoding with a worker pool requires per-CPU state (-I -T needs -C)\n");
+        return -1;
+    }
+    args->cpus = 1;
+    if (args->per_cpu_state) {
+        int nb_cpus = libbpf_num_possible_cpus();
+        if (nb_cpus <= 0 || nb_cpus > MAX_ENCODER_STREAMS) {
+            fprintf(stderr, "Per-CPU state supports up to %u CPUs\n", MAX_ENCODER_STREAMS);
+            return -1;
+        }
+        if (args->flows > 0) {
+            fprintf(stderr, "The FEC contexts are already per CPU with per-CPU state (incompatible with -F)\n");
+            return -1;
+        }
+        args->cpus = nb_cpus;
+    }
+    if (args->flows == 0) {
+        args->flows = 1;
+    }
+    // By default, one context per flow (or CPU) toward a single decoder
+    if (args->streams == 0) {
+        args->streams = args->per_cpu_state ? args->cpus : args->flows;
+    }
+    if (args->streams < args->cpus) {
+        // The block numbers of the CPUs are interleaved with a stride of the number of streams
+        fprintf(stderr, "Per-CPU state needs at least one context per CPU (%u)\n", args->cpus);
+        return -1;
+    }
+    if (args->repair_interface[0] && args->framework != BLOCK) {
+        // The repair symbols of the convolutional framework are encoded in user space
+        fprintf(stderr, "The kernel repair packets are only available with the block framework (-k requires -f block)\n");
+        return -1;
+    }
+    if (args->flush_timeout && args->per_cpu_state) {
+        // The flush runs on any CPU while the context of a CPU is only updated by this CPU, without lock
+        fprintf(stderr, "The flush of the incomplete windows requires a shared state (-D is incompatible with -C)\n");
+        return -1;
+    }
     if (args->attach && !interface_if_attach) {
             fprintf(stderr, "You need to specify an interface to plug the program\n");
             return -1;
@@ -279,6 +736,7 @@ int main(int argc, char *argv[]) {
 		perror("inet_ntop dst");
 		return -1;
 	}
+    context_decoder = !plugin_arguments.decoder_given;
 
     // Set up libbpf errors and debug info callback 
     libbpf_set_print(libbpf_print_fn);
@@ -297,6 +755,35 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
+    // Select the transport of the events before loading the program
+    skel->rodata->use_ringbuf = plugin_arguments.ringbuf;
+    if (plugin_arguments.ringbuf && plugin_arguments.busy_poll) {
+        skel->rodata->ringbuf_wakeup_bytes = UINT64_MAX; // Never wake up, user space is always polling
+    } else {
+        skel->rodata->ringbuf_wakeup_bytes = plugin_arguments.ringbuf_wakeup;
+    }
+    // The unused ring buffer is reduced to one page
+    bpf_map__set_max_entries(skel->maps.events_rb, plugin_arguments.ringbuf ? EVENTS_RINGBUF_SIZE : getpagesize());
+
+    // One block state per CPU with per-CPU state and one share of the source symbol pool per FEC context
+    skel->rodata->per_cpu_state = plugin_arguments.per_cpu_state;
+    skel->rodata->context_flows = plugin_arguments.flows;
+    skel->rodata->encoder_streams = plugin_arguments.streams;
+    skel->rodata->incremental_encoding = plugin_arguments.incremental;
+    flush_timeout_ns = plugin_arguments.flush_timeout * 1000ULL;
+    skel->rodata->flush_timeout_ns = flush_timeout_ns;
+    skel->rodata->adaptive_controller = plugin_arguments.adaptive;
+    // The repair packets of the block framework are sent by the tc egress program, one pending repair symbol per CPU
+    skel->rodata->kernel_repair = plugin_arguments.repair_interface[0] != 0;
+    memcpy((void *)skel->rodata->encoder_sid, src.sin6_addr.s6_addr, sizeof(src.sin6_addr.s6_addr));
+    memcpy((void *)skel->rodata->decoder_sid, dst.sin6_addr.s6_addr, sizeof(dst.sin6_addr.s6_addr));
+    bpf_map__set_max_entries(skel->maps.repairPending, plugin_arguments.repair_interface[0] ? libbpf_num_possible_cpus() : 1);
+    bpf_map__set_max_entries(skel->maps.fecBuffer, plugin_arguments.cpus);
+    bpf_map__set_max_entries(skel->maps.fecConvolutionInfoMap, plugin_arguments.streams);
+    bpf_map__set_max_entries(skel->maps.sourceSymbolPool_small, plugin_arguments.streams * RLC_BUFFER_SIZE);
+    bpf_map__set_max_entries(skel->maps.sourceSymbolPool_medium, plugin_arguments.streams * RLC_BUFFER_SIZE);
+    bpf_map__set_max_entries(skel->maps.sourceSymbolPool_large, plugin_arguments.streams * RLC_BUFFER_SIZE);
+
     // Load and verify BPF program 
     err = encoder_bpf__load(skel);
     if (err) {
@@ -306,6 +793,11 @@ int main(int argc, char *argv[]) {
 
     bpf_object__pin(skel->obj, "/sys/fs/bpf/encoder");
 
+    // The flush program is never attached, user space runs it when a window waits for too long
+    if (flush_timeout_ns && plugin_arguments.framework == CONVO) {
+        prog_fd_flush = bpf_program__fd(skel->progs.srv6_fec_flush_convo);
+    }
+
     if (plugin_arguments.attach) {
         char attach_cmd[200];
         memset(attach_cmd, 0, 200 * sizeof(char));
@@ -326,29 +818,51 @@ int main(int argc, char *argv[]) {
     }
 
 
-    int k0 = 0;
+    // The tc egress program sees the protected packets after the End.BPF program
+    if (plugin_arguments.repair_interface[0]) {
+        char tc_cmd[200];
+        // Fails without consequences if the interface already has a clsact qdisc
+        sprintf(tc_cmd, "tc qdisc add dev %s clsact", plugin_arguments.repair_interface);
+        fprintf(stderr, "Command used to add the clsact qdisc: %s\n", tc_cmd);
+        system(tc_cmd);
+        sprintf(tc_cmd, "tc filter add dev %s egress pref %u handle 1 bpf direct-action object-pinned /sys/fs/bpf/encoder/classifier_block_repair",
+            plugin_arguments.repair_interface, REPAIR_TC_PREF);
+        fprintf(stderr, "Command used to attach the repair program: %s\n", tc_cmd);
+        system(tc_cmd);
+    }
 
     // Get file descriptor of maps and init the value of the structures 
     struct bpf_map *map_fecBuffer = skel->maps.fecBuffer;
     int map_fd_fecBuffer = bpf_map__fd(map_fecBuffer);
     fecBlock_t block_init = {0};
     block_init.currentBlockSize = plugin_arguments.block_size;
-    bpf_map_update_elem(map_fd_fecBuffer, &k0, &block_init, BPF_ANY);
+    for (uint32_t k = 0; k < plugin_arguments.cpus; ++k) {
+        bpf_map_update_elem(map_fd_fecBuffer, &k, &block_init, BPF_ANY);
+    }
 
+    // The FEC contexts are created by the kernel from this configuration
     struct bpf_map *map_fecConvolutionBuffer = skel->maps.fecConvolutionInfoMap;
     int map_fd_fecConvolutionBuffer = bpf_map__fd(map_fecConvolutionBuffer);
-    fecConvolution_t convo_init = {
+    map_fd_contexts = map_fd_fecConvolutionBuffer;
+    map_fd_context_streams = bpf_map__fd(skel->maps.contextStreams);
+    fecConvolution_user_t convo_init = {
+        .message_type = RLC_WINDOW_DESCRIPTOR,
         .currentWindowSize = plugin_arguments.window_size,
         .currentWindowSlide = plugin_arguments.window_slide,
+        .repairSymbols = plugin_arguments.repair_symbols,
         .controller_repair = plugin_arguments.controller,
         .controller_threshold = plugin_arguments.controller_threshold,
         .controller_period = plugin_arguments.controller_update_every,
     };
-    bpf_map_update_elem(map_fd_fecConvolutionBuffer, &k0, &convo_init, BPF_ANY);
+    int k0 = 0;
+    bpf_map_update_elem(bpf_map__fd(skel->maps.fecConvolutionConfig), &k0, &convo_init, BPF_ANY);
 
     struct bpf_map *map_events = skel->maps.events;
     int map_fd_events = bpf_map__fd(map_events);
 
+    struct bpf_map *map_events_rb = skel->maps.events_rb;
+    int map_fd_events_rb = bpf_map__fd(map_events_rb);
+
     // Open raw socket 
     sfd = socket(AF_INET6, SOCK_RAW, IPPROTO_RAW);
 	if (sfd == -1) {
@@ -363,8 +877,53 @@ int main(int argc, char *argv[]) {
         goto cleanup;
     }
 
+    // Map the source symbols of the kernel to avoid copying them for each repair symbol
+    err = symbol_pool__mmap(&rlc->sourcePool, bpf_map__fd(skel->maps.sourceSymbolPool_small),
+                            bpf_map__fd(skel->maps.sourceSymbolPool_medium), bpf_map__fd(skel->maps.sourceSymbolPool_large), RLC_BUFFER_SIZE, plugin_arguments.streams);
+    if (err < 0) {
+        perror("Cannot mmap the source symbol pool");
+        goto cleanup;
+    }
+
+    if (plugin_arguments.incremental && rlc__enable_incremental(rlc) < 0) {
+        perror("Cannot create the pending windows");
+        goto cleanup;
+    }
+
+    if (plugin_arguments.tx_ring_interface[0]) {
+        rlc->batch = raw_socket_batch__new_tx_ring(plugin_arguments.tx_ring_interface, plugin_arguments.tx_ring_mac);
+        if (!rlc->batch) {
+            fprintf(stderr, "Cannot create the TX ring on %s\n", plugin_arguments.tx_ring_interface);
+            goto cleanup;
+        }
+    } else if (plugin_arguments.batch) {
+        rlc->batch = raw_socket_batch__new(sfd);
+        if (!rlc->batch) {
+            perror("Cannot create the packet batch");
+            goto cleanup;
+        }
+    }
+
     // Enter perf event handling for packet recovering 
-    handle_events(map_fd_events, plugin_arguments.framework);
+    if (plugin_arguments.repair_interface[0]) {
+        // Everything is done by the kernel, no event to handle
+        while (!exiting) {
+            sleep(1);
+        }
+    } else if (plugin_arguments.workers > 0) {
+        int pool_fds[3] = {
+            bpf_map__fd(skel->maps.sourceSymbolPool_small),
+            bpf_map__fd(skel->maps.sourceSymbolPool_medium),
+            bpf_map__fd(skel->maps.sourceSymbolPool_large),
+        };
+        handle_events_workers(map_fd_events, plugin_arguments.framework, &plugin_arguments, pool_fds);
+    } else if (plugin_arguments.ringbuf) {
+        events__handle_ringbuf(map_fd_events_rb, plugin_arguments.framework == BLOCK ? send_repairSymbol_XOR_rb : fecScheme_rb,
+                               plugin_arguments.busy_poll, plugin_arguments.ringbuf_wakeup > 0, poll_timeout_ms(), after_poll, &exiting);
+    } else {
+        events__handle_perf(map_fd_events, plugin_arguments.framework == BLOCK ? send_repairSymbol_XOR : fecScheme,
+                            plugin_arguments.busy_poll, poll_timeout_ms(), after_poll, &exiting);
+    }
 
     // Close socket 
     if (close(sfd) == -1) {
@@ -378,8 +937,15 @@ cleanup:
     bpf_object__unpin_programs(skel->obj, "/sys/fs/bpf/encoder");
     bpf_map__unpin(map_fecBuffer, "/sys/fs/bpf/encoder/fecBuffer");
     bpf_map__unpin(map_fecConvolutionBuffer, "/sys/fs/bpf/encoder/fecConvolutionInfoMap");
+    bpf_map__unpin(skel->maps.fecConvolutionConfig, "/sys/fs/bpf/encoder/fecConvolutionConfig");
+    bpf_map__unpin(skel->maps.contextStreams, "/sys/fs/bpf/encoder/contextStreams");
+    bpf_map__unpin(skel->maps.sourceSymbolPool_small, "/sys/fs/bpf/encoder/sourceSymbolPool_small");
+    bpf_map__unpin(skel->maps.sourceSymbolPool_medium, "/sys/fs/bpf/encoder/sourceSymbolPool_medium");
+    bpf_map__unpin(skel->maps.sourceSymbolPool_large, "/sys/fs/bpf/encoder/sourceSymbolPool_large");
+    bpf_map__unpin(skel->maps.repairPending, "/sys/fs/bpf/encoder/repairPending");
     // Do not know if I have to unpin the perf event too
     bpf_map__unpin(map_events, "/sys/fs/bpf/encoder/events");
+    bpf_map__unpin(map_events_rb, "/sys/fs/bpf/encoder/events_rb");
     encoder_bpf__destroy(skel);
     // Free memory of the RLC structure 
     free_rlc(rlc);
@@ -397,5 +963,13 @@ cleanup:
         system(detach_cmd);
         }
     }
+
+    // Detach the repair program. Only its filter is deleted: the clsact qdisc may be used by other filters
+    if (plugin_arguments.repair_interface[0]) {
+        char tc_cmd[200];
+        sprintf(tc_cmd, "tc filter del dev %s egress pref %u", plugin_arguments.repair_interface, REPAIR_TC_PREF);
+        fprintf(stderr, "Command used to detach the repair program: %s\n", tc_cmd);
+        system(tc_cmd);
+    }
     return 0;
 }
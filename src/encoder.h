@@ -6,18 +6,28 @@
 #define BPF_ERROR BPF_OK
 #define DEBUG 0
 
-#define RLC_BUFFER_SIZE MAX_RLC_WINDOW_SIZE
-#define RLC_RS_NUMBER 1
+// Size of the ring buffer used to communicate with user space (if enabled)
+#define EVENTS_RINGBUF_SIZE (1 << 22) // Must hold several window descriptors and block repair symbols
+
+// The source ring is shared with user space through mmapped maps, so it keeps
+// more symbols than a window to leave user space time to encode before a slot is reused
+#define RLC_BUFFER_SIZE (MAX_RLC_WINDOW_SIZE * 2)
+
+// Maximum number of flow buckets (or CPUs) of the FEC contexts, see fec_context_key_t
+#define MAX_CONTEXT_FLOWS MAX_ENCODER_STREAMS
+// A FEC context that did not protect any packet during this time is deleted by user space
+#define CONTEXT_IDLE_TIMEOUT_NS 10000000000ULL // 10 seconds
 
 typedef struct sourceSymbol_t {
     __u8 packet[MAX_PACKET_SIZE];
     __u16 packet_length;
 } source_symbol_t;
 
+// The packet is the last field so that only packet_length bytes of it can be sent to user space
 typedef struct repairSymbol_t {
     __u8 tlv[sizeof(struct tlvRepair__block_t)];
-    __u8 packet[MAX_PACKET_SIZE];
     __u16 packet_length;
+    __u8 packet[MAX_PACKET_SIZE];
 } repair_symbol_t;
 
 typedef struct {
@@ -29,23 +39,72 @@ typedef struct {
 } fecBlock_user_t;
 
 // CONVOLUTION
+// First byte (message_type) of the messages of the convolutional framework sent to user space
+#define RLC_WINDOW_DESCRIPTOR 0x1 // fecConvolution_user_t
+#define RLC_SOURCE_NOTIFICATION 0x2 // source_notification_t
+
+// Window descriptor sent to user space for each repair symbol.
+// The source symbols are not part of it: user space reads them from the mmapped sourceSymbolPool maps
 typedef struct {
+    __u8 message_type; // RLC_WINDOW_DESCRIPTOR
     __u32 encodingSymbolID;
     __u16 repairKey;
     __u8 ringBuffSize; // Number of packets for next coding in the ring buffer
-    struct sourceSymbol_t sourceRingBuffer[RLC_BUFFER_SIZE];
-    struct tlvRepair__convo_t repairTlv[RLC_RS_NUMBER];
+    struct tlvRepair__convo_t repairTlv[MAX_RLC_RS_NUMBER];
     __u8 currentWindowSize;
     __u8 currentWindowSlide;
+    __u8 repairSymbols; // Number of repair symbols per window, at most MAX_RLC_RS_NUMBER
     // Controller parameters
     __u8 controller_repair; // Enabling or not the controller
     __u8 controller_threshold; // Threshold for the decision function
     __u16 controller_period; // Period between two statistics messages
+    __u64 decoder_hi; // SID of the decoder of the context, destination of the repair symbols
+    __u64 decoder_lo;
 } fecConvolution_user_t;
 
+// Sent to user space for each source symbol in incremental encoding mode, see rlc__fold_source_symbol()
+typedef struct {
+    __u8 message_type; // RLC_SOURCE_NOTIFICATION
+    __u32 encodingSymbolID;
+    __u16 repairKey; // Of the context before the symbol: the windows containing it use the next keys
+    __u8 ringBuffSize; // Number of source symbols of the current window, including this one
+    __u8 windowSize;
+    __u8 windowSlide;
+    __u8 repairSymbols;
+} source_notification_t;
+
+// Key of a FEC context of the convolutional framework. Each context has its own window,
+// repair key, controller state and stream of encodingSymbolIDs
+typedef struct {
+    __u64 sid_hi; // SID of the decoder, i.e. destination of the packet once processed by the encoder
+    __u64 sid_lo;
+    __u32 flow; // Flow bucket of the packet (or CPU with per-CPU state), 0 if the contexts are per SID
+    __u32 padding;
+} fec_context_key_t;
+
+// A source symbol is in at most MAX_RLC_WINDOW_SIZE windows that are not closed yet
+#define RLC_PENDING_WINDOWS MAX_RLC_WINDOW_SIZE
+
+// Repair symbols of a window accumulated as its source symbols arrive (incremental encoding)
+typedef struct {
+    __u32 encodingSymbolID; // Of the last source symbol of the window
+    __u16 repairKey; // Of the first repair symbol of the window
+    __u8 windowSize;
+    __u8 repairSymbols;
+    __u8 folded; // Number of source symbols of the window already added to the repair symbols
+    __u8 valid; // 0 if a source symbol was overwritten by the kernel while being added
+    __u16 max_length; // Of the folded source symbols
+    __u16 coded_lengths[MAX_RLC_RS_NUMBER];
+    __u8 coefs[MAX_RLC_WINDOW_SIZE][MAX_RLC_RS_NUMBER]; // Coefficient of each source symbol for each repair symbol
+    __u8 *packets[MAX_RLC_RS_NUMBER]; // MAX_PACKET_SIZE bytes, allocated on the first use of the entry
+} rlc_pending_window_t;
+
 typedef struct {
     __u8 *muls;
-    struct repairSymbol_t *repairSymbol;
+    struct repairSymbol_t *repairSymbols[MAX_RLC_RS_NUMBER]; // Of the window being encoded
+    rlc_pending_window_t **pending; // Incremental encoding: RLC_PENDING_WINDOWS entries per stream, NULL if disabled
+    symbol_pool_t sourcePool; // mmapped sourceSymbolPool maps
+    struct raw_socket_batch *batch; // Repair symbols waiting for sendmmsg, NULL to send them one by one
 } encode_rlc_t;
 
 #endif
\ No newline at end of file
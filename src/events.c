@@ -0,0 +1,64 @@
+#ifndef EVENTS_H_
+#define EVENTS_H_
+
+#ifndef VMLINUX_H_
+#define VMLINUX_H_
+#include <linux/bpf.h>
+#endif
+
+#ifndef BPF_HELPERS_H_
+#define BPF_HELPERS_H_
+#include <bpf/bpf_helpers.h>
+#endif
+
+// Transport of the events from the eBPF programs to user space.
+// Set by user space before loading the program
+const volatile __u8 use_ringbuf = 0; // 0: per-CPU perf buffers, 1: single shared ring buffer
+const volatile __u64 ringbuf_wakeup_bytes = 0; // 0: default kernel wakeup, else wake up user space only above this amount of pending bytes
+
+// Perf event buffer to communicate with the user space
+struct {
+    __uint(type, BPF_MAP_TYPE_PERF_EVENT_ARRAY);
+    __uint(key_size, sizeof(__u32));
+    __uint(value_size, sizeof(__u32));
+} events SEC(".maps");
+
+// Ring buffer to communicate with the user space. Its size is set by user space
+// (the map is reduced to a single page if the perf event buffer is used)
+struct {
+    __uint(type, BPF_MAP_TYPE_RINGBUF);
+    __uint(max_entries, 1 << 12);
+} events_rb SEC(".maps");
+
+static __always_inline __u64 ringbuf_wakeup_flags() {
+    if (!ringbuf_wakeup_bytes) {
+        return 0;
+    }
+
+    // Batch the notifications: user space is only woken up when enough data is waiting
+    if (bpf_ringbuf_query(&events_rb, BPF_RB_AVAIL_DATA) >= ringbuf_wakeup_bytes) {
+        return BPF_RB_FORCE_WAKEUP;
+    }
+    return BPF_RB_NO_WAKEUP;
+}
+
+// Reserves a fixed-size record in the ring buffer (only if use_ringbuf is set).
+// Returns NULL if the ring buffer is full. The record must be given to submit_user_space()
+static __always_inline void *reserve_user_space(__u64 size) {
+    return bpf_ringbuf_reserve(&events_rb, size, 0);
+}
+
+static __always_inline void submit_user_space(void *record) {
+    bpf_ringbuf_submit(record, ringbuf_wakeup_flags());
+}
+
+// Copies *size* bytes of *data* to user space with the selected transport.
+// The size may be variable (but bounded) to send only the useful part of a record
+static __always_inline long send_to_user_space(void *ctx, void *map, void *data, __u64 size) {
+    if (use_ringbuf) {
+        return bpf_ringbuf_output(&events_rb, data, size, ringbuf_wakeup_flags());
+    }
+    return bpf_perf_event_output(ctx, map, BPF_F_CURRENT_CPU, data, size);
+}
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef EVENTS_USER_H_
+#define EVENTS_USER_H_
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <bpf/libbpf.h>
+
+// User space side of the transport of the events from the eBPF programs (see events.c).
+// Both loops stop when *exiting* is set and call *after_poll* after each poll,
+// e.g. to send the packets generated by the events of this poll
+typedef void (*events_after_poll_fn)(void);
+
+// Consumes the per-CPU perf buffers of *map_fd_events* with *sample_cb*, waiting at most *timeout_ms* for events
+void events__handle_perf(int map_fd_events, perf_buffer_sample_fn sample_cb, bool busy_poll, int timeout_ms,
+                         events_after_poll_fn after_poll, volatile bool *exiting) {
+    // Define structure for the perf event
+    struct perf_buffer_opts pb_opts = {0};
+    pb_opts.sample_cb = sample_cb;
+    struct perf_buffer *pb = NULL;
+    int err;
+
+    pb = perf_buffer__new(map_fd_events, 128, &pb_opts);
+    err = libbpf_get_error(pb);
+    if (err) {
+        pb = NULL;
+        fprintf(stderr, "Impossible to open perf event\n");
+        goto cleanup;
+    }
+
+    // Enter in loop until a signal is retrieved
+    while (!*exiting) {
+        // Busy polling avoids the wakeup latency at the cost of a full core
+        err = busy_poll ? perf_buffer__consume(pb) : perf_buffer__poll(pb, timeout_ms);
+        after_poll();
+        if (err < 0 && errno != EINTR) {
+            fprintf(stderr, "Error polling perf buffer: %d\n", err);
+            goto cleanup;
+        }
+    }
+
+cleanup:
+    perf_buffer__free(pb);
+}
+
+// Same as events__handle_perf with the ring buffer *map_fd_events_rb*.
+// With *batched_wakeup*, the kernel only wakes up user space above an amount of pending bytes (see ringbuf_wakeup_flags())
+void events__handle_ringbuf(int map_fd_events_rb, ring_buffer_sample_fn sample_cb, bool busy_poll, bool batched_wakeup, int timeout_ms,
+                            events_after_poll_fn after_poll, volatile bool *exiting) {
+    struct ring_buffer *rb = NULL;
+    int err;
+
+    rb = ring_buffer__new(map_fd_events_rb, sample_cb, NULL, NULL);
+    if (!rb) {
+        fprintf(stderr, "Impossible to open ring buffer\n");
+        goto cleanup;
+    }
+
+    // Enter in loop until a signal is retrieved
+    // Contrary to the perf buffer, all CPUs share the same ordered ring
+    while (!*exiting) {
+        if (busy_poll) {
+            err = ring_buffer__consume(rb);
+        } else {
+            err = ring_buffer__poll(rb, batched_wakeup ? 1 : timeout_ms);
+            // The kernel does not wake us up until enough bytes are pending:
+            // consume what is already there when the timeout expires
+            if (err == 0 && batched_wakeup) {
+                err = ring_buffer__consume(rb);
+            }
+        }
+        after_poll();
+        if (err < 0 && errno != EINTR) {
+            fprintf(stderr, "Error polling ring buffer: %d\n", err);
+            goto cleanup;
+        }
+    }
+
+cleanup:
+    ring_buffer__free(rb);
+}
+
+#endif
@@ -9,10 +9,13 @@
 #endif
 
 #include "../libseg6.c"
+#include "../events.c"
 #include "../decoder.h"
 #include "store_packet_receiver.c"
 #include "../fec_scheme/bpf/block_xor_receiver.c"
 
+// MAX_BLOCK blocks for each encoder stream, user space sets the number of streams.
+// An encoder with per-CPU state interleaves the block numbers of its CPUs, so their blocks use distinct entries
 struct {
     __uint(type, BPF_MAP_TYPE_HASH);
     __uint(max_entries, MAX_BLOCK);
@@ -48,8 +51,8 @@ static __always_inline int receiveSourceSymbol__block(struct __sk_buff *skb, str
     __u16 sourceSymbolNb = tlv.sourceSymbolNb;
 
     // Get index of the repair symbol based on the block
-    __u32 k_block = sourceBlockNb % MAX_BLOCK;
-    if (k_block < 0 || k_block >= MAX_BLOCK) { // TODO: remove this block because should be useless
+    __u32 k_block = sourceBlockNb % (MAX_BLOCK * encoder_streams);
+    if (k_block < 0 || k_block >= MAX_BLOCK * encoder_streams) { // TODO: remove this block because should be useless
         // if (DEBUG) bpf_printk("Receiver: wrong block index from source framework\n");
         return -1;
     }
@@ -61,8 +64,8 @@ static __always_inline int receiveSourceSymbol__block(struct __sk_buff *skb, str
     }
 
     // Get a pointer to the source symbol structure from map
+    // The source symbol is already cleared by the decoding functions after the previous packet
     struct sourceSymbol_t *sourceSymbol = &(xorStruct->sourceSymbol);
-    memset(sourceSymbol, 0, sizeof(struct sourceSymbol_t)); // Clean the source symbol from previous packet
 
     // Store source symbol
     err = storePacket_decode(skb, sourceSymbol);
@@ -99,6 +102,7 @@ static __always_inline int receiveSourceSymbol__block(struct __sk_buff *skb, str
     err = decoding_xor_on_the_line(skb, xorStruct, sourceBlock);
     if (err < 0) {
         // if (DEBUG) bpf_printk("Receiver: error confirmed from decodingXOR\n");
+        clear_source_symbol_xor(xorStruct);
         return -1;
     }
 
@@ -108,7 +112,7 @@ static __always_inline int receiveSourceSymbol__block(struct __sk_buff *skb, str
     // A source symbol is recovered, transmit it to user space
     if (err == 1) {
         struct repairSymbol_t *repairSymbol = &xorStruct->repairSymbols;
-        bpf_perf_event_output(skb, map, BPF_F_CURRENT_CPU, repairSymbol, sizeof(struct repairSymbol_t));
+        send_to_user_space(skb, map, repairSymbol, sizeof(struct repairSymbol_t));
     }
 
     return 0;
@@ -130,7 +134,7 @@ static __always_inline int receiveRepairSymbol__block(struct __sk_buff *skb, str
 
     // Retrieve the block number and the corresponding index
     __u16 blockID = tlv.sourceBlockNb;
-    int k_block = blockID % MAX_BLOCK;
+    __u32 k_block = blockID % (MAX_BLOCK * encoder_streams);
 
     // Get pointer to global structure
     xorStruct_t *xorStruct = bpf_map_lookup_elem(&xorBuffer, &k_block);
@@ -158,25 +162,30 @@ static __always_inline int receiveRepairSymbol__block(struct __sk_buff *skb, str
 
     // if != 0 => already received some source symbols that a deoced in the repairSymbol structure
     // => we copy the content of the repairSymbol in sourceSymbol
+    // Only the useful bytes are copied, the repair symbol is cleared at the same time
     if (sourceBlock->receivedSource != 0) {
-        memset(sourceSymbol, 0, sizeof(struct sourceSymbol_t));
-        memcpy(sourceSymbol->packet, repairSymbol->packet, MAX_PACKET_SIZE); // Copy decoded packet
         sourceSymbol->packet_length = repairSymbol->packet_length; // Copy decoded packet length
     }
-    memset(repairSymbol, 0, sizeof(struct repairSymbol_t));
+    move_symbol(sourceSymbol->packet, repairSymbol->packet, repairSymbol->packet_length, sourceBlock->receivedSource != 0);
+    memset(&repairSymbol->tlv, 0, sizeof(struct tlvRepair__block_t));
+    repairSymbol->packet_length = 0;
 
+    // On error, the decoded symbol moved in sourceSymbol is cleared: the next source symbol is stored over it
     err = storeRepairSymbol(skb, repairSymbol, srh);
     if (err < 0) {
         // if (DEBUG) bpf_printk("Receiver: error from storeRepairSymbol confirmed\n");
+        clear_source_symbol_xor(xorStruct);
         return -1;
     } else if (err > 0) {
         // if (DEBUG) bpf_printk("Receiver: confirmed packet too big for protection\n");
+        clear_source_symbol_xor(xorStruct);
         return -1;
     }
 
     err = decoding_xor_on_the_line_repair(skb, xorStruct, sourceBlock);
     if (err < 0) {
         // if (DEBUG) bpf_printk("Receiver: error confirmed from decodingXOR\n");
+        clear_source_symbol_xor(xorStruct);
         return -1;
     }
 
@@ -185,7 +194,7 @@ static __always_inline int receiveRepairSymbol__block(struct __sk_buff *skb, str
 
     // A source symbol is recovered, transmit it to user space
     if (err == 1) {
-        bpf_perf_event_output(skb, map, BPF_F_CURRENT_CPU, repairSymbol, sizeof(struct repairSymbol_t));
+        send_to_user_space(skb, map, repairSymbol, sizeof(struct repairSymbol_t));
     }
 
     return 0;
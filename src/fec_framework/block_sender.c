@@ -9,12 +9,16 @@
 #endif
 
 #include "../libseg6.c"
+#include "../events.c"
 #include "../encoder.h"
 #include "store_packet_sender.c"
+#include "sender_state.c"
+#include "kernel_repair_sender.c"
 #include "../fec_scheme/bpf/block_xor_sender.c"
 
+// State of the framework: a single entry shared by all CPUs, or one entry per CPU (see sender_state.c)
 struct {
-    __uint(type, BPF_MAP_TYPE_HASH);
+    __uint(type, BPF_MAP_TYPE_ARRAY);
     __uint(max_entries, 1);
     __type(key, __u32);
     __type(value, fecBlock_t);
@@ -24,11 +28,8 @@ static __always_inline int fecFramework__block(struct __sk_buff *skb, void *csh_
     int err;
 
     // Load the source symbol structure to store the packet
+    // (already cleared by the coding function after the previous packet)
     struct sourceSymbol_t *sourceSymbol = &mapStruct->sourceSymbol;
-    __u64 *ss64 = (__u64 *)sourceSymbol->packet;
-    for (int i = 0; i < MAX_PACKET_SIZE / 8; ++i) {
-        ss64[i] = 0;
-    }
 
     err = storePacket(skb, sourceSymbol);
     if (err < 0) {
@@ -39,10 +40,14 @@ static __always_inline int fecFramework__block(struct __sk_buff *skb, void *csh_
         return -1;
     }
 
-    bpf_spin_lock(&mapStruct->lock);
+    sender_state_lock(&mapStruct->lock);
 
     __u16 sourceBlock = mapStruct->soubleBlock; 
     __u16 sourceSymbolCount = mapStruct->sourceSymbolCount;
+    if (per_cpu_state) {
+        // The CPUs interleave their block numbers: the decoder keeps the blocks of each CPU apart
+        sourceBlock = sourceBlock * encoder_streams + bpf_get_smp_processor_id();
+    }
 
     struct tlvSource__block_t *csh = (struct tlvSource__block_t *)csh_void;
     
@@ -54,13 +59,15 @@ static __always_inline int fecFramework__block(struct __sk_buff *skb, void *csh_
     csh->sourceSymbolNb = sourceSymbolCount;
 
     if (sourceSymbolCount == mapStruct->currentBlockSize - 1) {
-        ++mapStruct->soubleBlock; // Next packet will belong to another source block
+        // Next packet will belong to another source block. The counter wraps before the interleaved block numbers overflow
+        __u32 blockNumbers = BLOCK_NUMBERS(per_cpu_state ? encoder_streams : 1);
+        mapStruct->soubleBlock = (mapStruct->soubleBlock + 1) % blockNumbers;
         mapStruct->sourceSymbolCount = 0;
     } else {
         ++mapStruct->sourceSymbolCount;
     }
 
-    bpf_spin_unlock(&mapStruct->lock);
+    sender_state_unlock(&mapStruct->lock);
 
     // Call coding function. This function:
     // 1) Stores the source symbol for coding (or directly codes if XOR-on-the-line)
@@ -79,8 +86,16 @@ static __always_inline int fecFramework__block(struct __sk_buff *skb, void *csh_
     }
 
     // A repair symbol is generated and will be forwarded to user space to be forwarded
+    // Only the useful bytes of the repair symbol are sent
+    // (or the tc egress program sends it after the current packet, see kernel_repair_sender.c)
     if (err == 1) {
-        bpf_perf_event_output(skb, map, BPF_F_CURRENT_CPU, &mapStruct->repairSymbol, sizeof(struct repairSymbol_t));
+        struct repairSymbol_t *repairSymbol = &mapStruct->repairSymbol;
+        if (kernel_repair) {
+            kernel_repair__handoff(skb, repairSymbol);
+        } else {
+            __u32 size = offsetof(struct repairSymbol_t, packet) + repairSymbol->packet_length;
+            send_to_user_space(skb, map, repairSymbol, size);
+        }
     }
 
     return err;
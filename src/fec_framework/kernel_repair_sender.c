@@ -0,0 +1,262 @@
+#ifndef KERNEL_REPAIR_SENDER_H_
+#define KERNEL_REPAIR_SENDER_H_
+
+#ifndef VMLINUX_H_
+#define VMLINUX_H_
+#include <linux/bpf.h>
+#endif
+
+#ifndef BPF_HELPERS_H_
+#define BPF_HELPERS_H_
+#include <bpf/bpf_helpers.h>
+#endif
+
+#include <bpf/bpf_endian.h>
+#include "../libseg6.c"
+#include "../encoder.h"
+#include "../fec_scheme/bpf/block_xor_symbol.c"
+
+// Emission of the repair symbols of the block framework without user space.
+// The End.BPF program cannot create packets: it hands the repair symbol over to its CPU in repairPending
+// and marks the source packet that completed the block. The tc egress program of the output interface
+// (srv6_fec_repair_block) sends a clone of this source packet and rewrites the packet itself in the repair
+// packet, i.e. the same packet as build_raw_socket() in user space.
+// The mark is a single bit of skb->mark, the other bits are left to their owners. A marked packet is only
+// followed by the repair packet if it is also the source packet recorded in the slot of its CPU
+#define KERNEL_REPAIR_MARK 0x80000000 // Bit of skb->mark of a source packet followed by a repair packet
+#define KERNEL_REPAIR_MAX_L2_LENGTH 64 // Link-layer header kept from the source packet, derived from its length
+#define KERNEL_REPAIR_CSUM_CHUNK 512 // Maximum size of bpf_csum_diff
+
+#define TC_ACT_OK 0
+#define TC_ACT_SHOT 2
+
+// Set by user space before loading the program
+const volatile __u8 kernel_repair = 0; // 0: the repair symbols are sent to user space, 1: sent by the tc egress program
+const volatile __u8 decoder_sid[16] = {0}; // Destination of the repair packets
+
+// Repair symbol waiting for its source packet to reach the tc egress program
+struct kernel_repair_pending_t {
+    // Source packet followed by the repair symbol, set when it is marked
+    __u32 source_length; // From the IPv6 header, 0 if no packet is marked
+    __u32 source_flow_label;
+    __u64 source_src_hi;
+    __u64 source_src_lo;
+    struct repairSymbol_t symbol;
+};
+
+// One pending repair symbol per CPU (the source packet goes from the End.BPF program to the output
+// interface on the same CPU). An array map with one entry per CPU because the value is too large for a per-CPU map
+struct {
+    __uint(type, BPF_MAP_TYPE_ARRAY);
+    __uint(max_entries, 1);
+    __type(key, __u32);
+    __type(value, struct kernel_repair_pending_t);
+} repairPending SEC(".maps");
+
+// Headers of the repair packet, from the IPv6 header to the UDP header
+struct repairHeaders__block_t {
+    __u32 ip6_flow; // Version, traffic class and flow label
+    __u16 ip6_plen;
+    __u8 ip6_nxt;
+    __u8 ip6_hops;
+    __u8 ip6_src[16];
+    __u8 ip6_dst[16];
+    __u8 srh_nexthdr;
+    __u8 srh_hdrlen;
+    __u8 srh_type;
+    __u8 srh_segments_left;
+    __u8 srh_first_segment;
+    __u8 srh_flags;
+    __u16 srh_tag;
+    __u8 segments[2][16];
+    struct tlvRepair__block_t tlv;
+    struct udp_t udp;
+} BPF_PACKET_HEADER;
+
+// UDP pseudo-header of the checksum, followed by the UDP header (aligned for bpf_csum_diff)
+struct repairPseudoHeader__block_t {
+    __u8 src[16];
+    __u8 dst[16];
+    __u32 length;
+    __u32 nxt;
+    __be32 udp[2];
+};
+
+// Moves the repair symbol of the block in the slot of the current CPU.
+// The repair symbol is cleared for the next block
+static __always_inline int kernel_repair__handoff(struct __sk_buff *skb, struct repairSymbol_t *repairSymbol) {
+    __u32 cpu = bpf_get_smp_processor_id();
+    struct kernel_repair_pending_t *pending = bpf_map_lookup_elem(&repairPending, &cpu);
+    if (!pending) {
+        return -1;
+    }
+
+    // The previous repair symbol is lost if its source packet did not leave from this CPU
+    if (pending->symbol.packet_length) {
+        move_symbol(pending->symbol.packet, pending->symbol.packet, pending->symbol.packet_length, 0);
+    }
+
+    __u16 length = repairSymbol->packet_length;
+    memcpy(pending->symbol.tlv, repairSymbol->tlv, sizeof(struct tlvRepair__block_t));
+    move_symbol(pending->symbol.packet, repairSymbol->packet, length, 1);
+    pending->symbol.packet_length = length;
+    pending->source_length = 0;
+    repairSymbol->packet_length = 0;
+    return 0;
+}
+
+// Records *skb* as the source packet of the repair symbol handed over by kernel_repair__handoff() and marks it.
+// Called once the End.BPF program does not modify the packet anymore
+static __always_inline int kernel_repair__mark(struct __sk_buff *skb) {
+    __u32 cpu = bpf_get_smp_processor_id();
+    struct kernel_repair_pending_t *pending = bpf_map_lookup_elem(&repairPending, &cpu);
+    if (!pending || pending->symbol.packet_length == 0) {
+        return -1;
+    }
+
+    struct ip6_t ip6;
+    if (bpf_skb_load_bytes(skb, 0, &ip6, sizeof(ip6)) < 0) {
+        return -1;
+    }
+    pending->source_length = skb->len;
+    pending->source_flow_label = ip6.flow_label;
+    pending->source_src_hi = ip6.src_hi;
+    pending->source_src_lo = ip6.src_lo;
+
+    skb->mark |= KERNEL_REPAIR_MARK;
+    return 0;
+}
+
+static __always_inline __u16 kernel_repair__csum_fold(__s64 csum) {
+    __u32 sum = (__u32)csum;
+    sum = (sum & 0xffff) + (sum >> 16);
+    sum = (sum & 0xffff) + (sum >> 16);
+    return (__u16)~sum;
+}
+
+// Rewrites *skb* in the repair packet of *pending*, after its *l2_length* bytes of link-layer header
+static __always_inline int kernel_repair__build(struct __sk_buff *skb, __u32 l2_length, struct repairSymbol_t *pending) {
+    __u16 pay_length = pending->packet_length;
+    if (pay_length == 0) {
+        return -1;
+    }
+    __u32 headers_length = sizeof(struct repairHeaders__block_t);
+
+    struct repairHeaders__block_t hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.ip6_flow = bpf_htonl(6 << 28);
+    hdr.ip6_plen = bpf_htons(headers_length - 40 + pay_length);
+    hdr.ip6_nxt = 43; // Routing header
+    hdr.ip6_hops = 44;
+    #pragma clang loop unroll(full)
+    for (int i = 0; i < 16; ++i) {
+        hdr.ip6_src[i] = encoder_sid[i];
+        hdr.ip6_dst[i] = decoder_sid[i];
+        hdr.segments[0][i] = encoder_sid[i];
+        hdr.segments[1][i] = decoder_sid[i];
+    }
+    hdr.srh_nexthdr = 17; // UDP
+    hdr.srh_hdrlen = 4 + 2;
+    hdr.srh_type = 4;
+    hdr.srh_segments_left = 1;
+    hdr.srh_first_segment = 1;
+    memcpy(&hdr.tlv, pending->tlv, sizeof(struct tlvRepair__block_t));
+    hdr.udp.sport = bpf_htons(50);
+    hdr.udp.dport = bpf_htons(50);
+    hdr.udp.length = bpf_htons(pay_length);
+
+    // UDP checksum over exactly *pay_length* bytes of the repair symbol: the whole chunks,
+    // then the whole words of the remainder, then its last bytes padded with 0
+    struct repairPseudoHeader__block_t pseudo;
+    memcpy(pseudo.src, hdr.ip6_src, 16);
+    memcpy(pseudo.dst, hdr.ip6_dst, 16);
+    pseudo.length = bpf_htonl(sizeof(struct udp_t) + pay_length);
+    pseudo.nxt = bpf_htonl(17);
+    memcpy(pseudo.udp, &hdr.udp, sizeof(struct udp_t));
+    __s64 csum = bpf_csum_diff(NULL, 0, (__be32 *)&pseudo, sizeof(pseudo), 0);
+    __u32 offset = 0;
+    for (__u32 i = 0; i < MAX_PACKET_SIZE / KERNEL_REPAIR_CSUM_CHUNK; ++i) {
+        if (offset + KERNEL_REPAIR_CSUM_CHUNK > pay_length || csum < 0) break;
+        csum = bpf_csum_diff(NULL, 0, (__be32 *)&pending->packet[offset], KERNEL_REPAIR_CSUM_CHUNK, csum);
+        offset += KERNEL_REPAIR_CSUM_CHUNK;
+    }
+    offset &= MAX_PACKET_SIZE - KERNEL_REPAIR_CSUM_CHUNK;
+    __u32 words = (pay_length - offset) & (KERNEL_REPAIR_CSUM_CHUNK - 4);
+    if (csum >= 0 && words) {
+        csum = bpf_csum_diff(NULL, 0, (__be32 *)&pending->packet[offset], words, csum);
+    }
+    __u32 tail = (pay_length - offset) & 3;
+    __be32 last = 0;
+    #pragma clang loop unroll(full)
+    for (__u32 j = 0; j < 3; ++j) {
+        if (j < tail) {
+            ((__u8 *)&last)[j] = pending->packet[(offset + words + j) & (MAX_PACKET_SIZE - 1)];
+        }
+    }
+    if (csum >= 0) {
+        csum = bpf_csum_diff(NULL, 0, &last, sizeof(last), csum);
+    }
+    if (csum < 0) {
+        return -1;
+    }
+    hdr.udp.crc = kernel_repair__csum_fold(csum);
+
+    // The link-layer header of the source packet is kept: the repair packet goes to the same next hop
+    if (bpf_skb_change_tail(skb, l2_length + headers_length + pay_length, 0) < 0) {
+        return -1;
+    }
+    if (bpf_skb_store_bytes(skb, l2_length, &hdr, sizeof(hdr), 0) < 0) {
+        return -1;
+    }
+    if (bpf_skb_store_bytes(skb, l2_length + headers_length, pending->packet, pay_length, 0) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+// Called by the tc egress program for each packet.
+// Returns TC_ACT_OK to send *skb*, TC_ACT_SHOT to drop it
+static __always_inline int kernel_repair__send(struct __sk_buff *skb) {
+    if (!(skb->mark & KERNEL_REPAIR_MARK) || skb->protocol != bpf_htons(0x86DD)) {
+        return TC_ACT_OK;
+    }
+
+    __u32 cpu = bpf_get_smp_processor_id();
+    struct kernel_repair_pending_t *pending = bpf_map_lookup_elem(&repairPending, &cpu);
+    if (!pending || pending->symbol.packet_length == 0 || pending->source_length == 0) {
+        return TC_ACT_OK;
+    }
+
+    // The packet must be the recorded source packet. Its link-layer header is what precedes its IPv6 header
+    __u32 l2_length = skb->len - pending->source_length;
+    if (skb->len < pending->source_length || l2_length > KERNEL_REPAIR_MAX_L2_LENGTH) {
+        return TC_ACT_OK;
+    }
+    struct ip6_t ip6;
+    if (bpf_skb_load_bytes(skb, l2_length, &ip6, sizeof(ip6)) < 0) {
+        return TC_ACT_OK;
+    }
+    if (ip6.ver != 6 || bpf_ntohs(ip6.payload_len) + 40 != pending->source_length ||
+            ip6.flow_label != pending->source_flow_label ||
+            ip6.src_hi != pending->source_src_hi || ip6.src_lo != pending->source_src_lo) {
+        return TC_ACT_OK;
+    }
+
+    // The source packet leaves first, unchanged (without the mark bit, so that its clone is not processed again).
+    // If it cannot be cloned, it is sent instead of the repair packet
+    skb->mark &= ~KERNEL_REPAIR_MARK;
+    pending->source_length = 0;
+    int cloned = bpf_clone_redirect(skb, skb->ifindex, 0) == 0;
+    int err = cloned ? kernel_repair__build(skb, l2_length, &pending->symbol) : -1;
+
+    // The slot is cleared for the next repair symbol of this CPU
+    move_symbol(pending->symbol.packet, pending->symbol.packet, pending->symbol.packet_length, 0);
+    pending->symbol.packet_length = 0;
+
+    if (cloned && err < 0) {
+        return TC_ACT_SHOT; // Partially rewritten packet, the source packet already left with the clone
+    }
+    return TC_ACT_OK;
+}
+
+#endif
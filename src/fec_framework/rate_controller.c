@@ -0,0 +1,131 @@
+#ifndef RATE_CONTROLLER_H_
+#define RATE_CONTROLLER_H_
+
+#ifndef VMLINUX_H_
+#define VMLINUX_H_
+#include <linux/bpf.h>
+#endif
+
+#ifndef BPF_HELPERS_H_
+#define BPF_HELPERS_H_
+#include <bpf/bpf_helpers.h>
+#endif
+
+#include "../encoder.bpf.h"
+#include "sender_state.c"
+
+// Adaptive code rate: the statistics of the decoder are used to estimate the channel as a Gilbert-Elliott model
+// (loss rate and mean length of the loss bursts) and to choose the parameters of the next windows of the context.
+// Set by user space before loading the program. 0: the window parameters of the command line are kept
+const volatile __u8 adaptive_controller = 0;
+
+#define RATE_CONTROLLER_LOSS_ONE 65536 // Fixed point unit of the loss rate
+#define RATE_CONTROLLER_BURST_ONE 256 // Fixed point unit of the burst length
+#define RATE_CONTROLLER_SMOOTHING 2 // The estimations move by 1/4 of the difference with each new period
+#define RATE_CONTROLLER_MARGIN 2 // Repair symbols per expected lost source symbol
+
+// Updates the estimation of the channel of the context with the statistics of one period of the decoder
+static __always_inline void rate_controller__estimate(fecConvolution_t *fecConvolution, tlv_controller_t *tlv) {
+    __u32 theoretical = tlv->theoretical_counter;
+    __u32 received = tlv->received_counter < theoretical ? tlv->received_counter : theoretical;
+    __u32 lost = theoretical - received;
+    if (theoretical == 0) {
+        return;
+    }
+
+    // Exponentially weighted moving averages, from the first period
+    __u32 period_loss = (lost * RATE_CONTROLLER_LOSS_ONE) / theoretical;
+    __s32 loss = fecConvolution->loss_rate;
+    loss += ((__s32)period_loss - loss) >> RATE_CONTROLLER_SMOOTHING;
+    fecConvolution->loss_rate = loss < RATE_CONTROLLER_LOSS_ONE ? loss : RATE_CONTROLLER_LOSS_ONE - 1;
+
+    // Without loss, the period says nothing about the bursts. A decoder not counting the bursts reports 0: isolated losses
+    if (lost > 0) {
+        __u32 bursts = tlv->loss_bursts > 0 && tlv->loss_bursts <= lost ? tlv->loss_bursts : lost;
+        __u32 period_burst = (lost * RATE_CONTROLLER_BURST_ONE) / bursts;
+        __s32 burst = fecConvolution->burst_length ? fecConvolution->burst_length : RATE_CONTROLLER_BURST_ONE;
+        burst += ((__s32)period_burst - burst) >> RATE_CONTROLLER_SMOOTHING;
+        fecConvolution->burst_length = burst < 0xffff ? burst : 0xffff;
+    }
+}
+
+// Chooses the window parameters for the estimated channel, applied when the current window is closed (see fecScheme__convoRLC):
+//  - one repair symbol per symbol of the mean burst, so that a burst can be recovered from a single window,
+//  - the slide gives RATE_CONTROLLER_MARGIN times more repair symbols than the expected lost source symbols,
+//  - the window covers two slides so that each source symbol is protected by two windows
+static __always_inline void rate_controller__tune(fecConvolution_t *fecConvolution) {
+    __u32 repairSymbols = (fecConvolution->burst_length + RATE_CONTROLLER_BURST_ONE - 1) / RATE_CONTROLLER_BURST_ONE;
+    if (repairSymbols < 1) {
+        repairSymbols = 1;
+    } else if (repairSymbols > MAX_RLC_RS_NUMBER) {
+        repairSymbols = MAX_RLC_RS_NUMBER;
+    }
+
+    __u32 windowSlide = MAX_RLC_WINDOW_SLIDE - 1;
+    __u32 loss = fecConvolution->loss_rate * RATE_CONTROLLER_MARGIN;
+    if (loss > 0 && (repairSymbols * RATE_CONTROLLER_LOSS_ONE) / loss < windowSlide) {
+        windowSlide = (repairSymbols * RATE_CONTROLLER_LOSS_ONE) / loss;
+    }
+    if (windowSlide < 1) {
+        windowSlide = 1;
+    }
+
+    __u32 windowSize = 2 * windowSlide > repairSymbols ? 2 * windowSlide : repairSymbols;
+    if (windowSize > MAX_RLC_WINDOW_SIZE - 1) {
+        windowSize = MAX_RLC_WINDOW_SIZE - 1;
+    }
+
+    fecConvolution->nextWindowSize = windowSize;
+    fecConvolution->nextWindowSlide = windowSlide;
+    fecConvolution->nextRepairSymbols = repairSymbols;
+}
+
+// Updates the repair decision of a state of the convolutional framework with the statistics of the controller.
+// The repair symbols are only sent while the delivery ratio is at most controller_threshold percent.
+// The caller must own the state (lock or CPU of a per-CPU state)
+static __always_inline void rate_controller__apply(fecConvolution_t *fecConvolution, tlv_controller_t *tlv) {
+    fecConvolution->controller_repair = 2;
+
+    // Update internal value controlling the sending of repair symbol
+    // with the value of the tlv.
+    // We only update the last bit as the penultimate controls if we want to use the controller
+    if (tlv->theoretical_counter == 0 ||
+            (tlv->received_counter * 100) / tlv->theoretical_counter <= fecConvolution->controller_threshold) {
+        fecConvolution->controller_repair += 1;
+    }
+
+    if (adaptive_controller) {
+        rate_controller__estimate(fecConvolution, tlv);
+        rate_controller__tune(fecConvolution);
+    }
+}
+
+// Called by the controller program, on any CPU. A shared state is updated under its lock.
+// A per-CPU state is only modified by its CPU: the statistics are posted to its mailbox (see rate_controller__receive)
+static __always_inline void rate_controller__update(fecConvolution_t *fecConvolution, tlv_controller_t *tlv) {
+    bpf_spin_lock(&fecConvolution->lock);
+    if (per_cpu_state) {
+        fecConvolution->mailbox = *tlv; // The statistics of the previous period are replaced if not applied yet
+        fecConvolution->mailbox_full = 1;
+    } else {
+        rate_controller__apply(fecConvolution, tlv);
+    }
+    bpf_spin_unlock(&fecConvolution->lock);
+}
+
+// Called by the CPU of a per-CPU state for each packet: applies the statistics posted by the controller, if any
+static __always_inline void rate_controller__receive(fecConvolution_t *fecConvolution) {
+    if (!per_cpu_state || !fecConvolution->mailbox_full) {
+        return;
+    }
+
+    tlv_controller_t tlv;
+    bpf_spin_lock(&fecConvolution->lock);
+    tlv = fecConvolution->mailbox;
+    fecConvolution->mailbox_full = 0;
+    bpf_spin_unlock(&fecConvolution->lock);
+
+    rate_controller__apply(fecConvolution, &tlv);
+}
+
+#endif
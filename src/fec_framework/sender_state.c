@@ -0,0 +1,52 @@
+#ifndef SENDER_STATE_H_
+#define SENDER_STATE_H_
+
+#ifndef VMLINUX_H_
+#define VMLINUX_H_
+#include <linux/bpf.h>
+#endif
+
+#ifndef BPF_HELPERS_H_
+#define BPF_HELPERS_H_
+#include <bpf/bpf_helpers.h>
+#endif
+
+#include "symbol_pool.c"
+
+// Location of the state of the FEC Frameworks (fecConvolutionInfoMap and fecBuffer).
+// Set by user space before loading the program
+const volatile __u8 per_cpu_state = 0; // 0: single state shared by all CPUs behind a spin lock, 1: one state per CPU
+const volatile __u32 context_flows = 1; // Number of flow buckets of the FEC contexts (ignored with per-CPU state)
+const volatile __u8 encoder_sid[16] = {0}; // SID of the encoder, source of the repair packets
+
+// Returns the key of the state used by the current CPU in fecBuffer.
+// The lookup fails if user space did not create a state for this CPU
+static __always_inline __u32 sender_state_key() {
+    return per_cpu_state ? bpf_get_smp_processor_id() : 0;
+}
+
+// Returns the flow of the packet in the key of its FEC context: the CPU with per-CPU state,
+// else the bucket of the flow hash of the packet
+static __always_inline __u32 sender_state_flow(struct __sk_buff *skb) {
+    if (per_cpu_state) {
+        return bpf_get_smp_processor_id();
+    } else if (context_flows > 1) {
+        return bpf_get_hash_recalc(skb) % context_flows;
+    }
+    return 0;
+}
+
+// A per-CPU state is only used by its CPU (the program cannot migrate while it runs): no need to lock it
+static __always_inline void sender_state_lock(struct bpf_spin_lock *lock) {
+    if (!per_cpu_state) {
+        bpf_spin_lock(lock);
+    }
+}
+
+static __always_inline void sender_state_unlock(struct bpf_spin_lock *lock) {
+    if (!per_cpu_state) {
+        bpf_spin_unlock(lock);
+    }
+}
+
+#endif
@@ -13,6 +13,32 @@
 
 #include "../libseg6.c"
 #include "../decoder.h"
+#include "symbol_pool.c"
+
+// Sets to 0 the fields of the stored packet that may vary in the network.
+// *tlv_length* is the length of the source TLV removed from the packet by the decoder
+static __always_inline int cleanPacket_decode(__u8 *packet, __u32 tlv_length) {
+    // Get the IPv6 header from the sourceSymbol pointer.
+    // We must put the fields that may vary in the network to 0 because coding to ensure that the
+    // decoded values on the decoder will be the same.
+    // Destination address
+    // Hot Limit
+    struct ip6_t *source_ipv6 = (struct ip6_t *)packet;
+    source_ipv6->dst_hi    = 0;
+    source_ipv6->dst_lo    = 0;
+    source_ipv6->hop_limit = 0;
+
+    // Also get the Segment Routing header. We must set the value of segment_left to 0
+    // as it will also be modified for the decoder
+    struct ip6_srh_t *srh = (struct ip6_srh_t *)(packet + 40);
+    srh->segments_left = 0;
+    // Unfortunately, the seg6_delete_tlv function does not update the length of the SRH when we
+    // remove the TLV. We need to locally update this value in the sourceSymbol version of the packet.
+    // We cannot use seg6_get_srh because we work with local structure and not with __sk_buff
+    srh->hdrlen -= tlv_length >> 3;
+
+    return 0;
+}
 
 static __always_inline int storePacket_decode(struct __sk_buff *skb, struct sourceSymbol_t *sourceSymbol) {
     int err;
@@ -21,7 +47,7 @@ static __always_inline int storePacket_decode(struct __sk_buff *skb, struct sour
     __u32 packet_len = skb->len;
 
     // Ensures that we do not try to protect a too big packet
-    if (packet_len > MAX_PACKET_SIZE) {
+    if (packet_len > MAX_SYMBOL_LENGTH) {
         // if (DEBUG) bpf_printk("Receiver: too big packet, does not protect\n");
         return 1;
     }
@@ -46,31 +72,8 @@ static __always_inline int storePacket_decode(struct __sk_buff *skb, struct sour
     // Store the length of the packet that will also be coded
     sourceSymbol->packet_length = packet_len;
 
-    // Get the IPv6 header from the sourceSymbol pointer.
-    // We must put the fields that may vary in the network to 0 because coding to ensure that the
-    // decoded values on the decoder will be the same.
-    // Destination address
-    // Hot Limit
-    struct ip6_t *source_ipv6 = (struct ip6_t *)sourceSymbol->packet;
-    source_ipv6->dst_hi    = 0;
-    source_ipv6->dst_lo    = 0;
-    source_ipv6->hop_limit = 0;
-
-    // Also get the Segment Routing header. We must set the value of segment_left to 0
-    // as it will also be modified for the decoder
-    if (40 + sizeof(struct ip6_srh_t) > sizeof(sourceSymbol->packet)) {
-        // if (DEBUG) bpf_printk("Receiver: cannot get the SRH from the sourceSymbol\n");
-        return -1;
-    }
-    struct ip6_srh_t *srh = (struct ip6_srh_t *)(sourceSymbol->packet + 40);
-    srh->segments_left = 0;
-    // Unfortunately, the seg6_delete_tlv function does not update the length of the SRH when we
-    // remove the TLV. We need to locally update this value in the sourceSymbol version of the packet.
-    // We cannot use seg6_get_srh because we work with local structure and not with __sk_buff
-    srh->hdrlen -= 1; // TODO: more clean ?
-
     // if (DEBUG) bpf_printk("Receiver: storePacket done\n");
-    return 0;
+    return cleanPacket_decode(sourceSymbol->packet, sizeof(struct tlvSource__block_t));
 }
 
 static __always_inline int storeRepairSymbol(struct __sk_buff *skb, struct repairSymbol_t *repairSymbol, struct ip6_srh_t *srh) {
@@ -113,4 +116,69 @@ static __always_inline int storeRepairSymbol(struct __sk_buff *skb, struct repai
     return 0;
 }
 
+// Same as storePacket_decode but stores the packet (with its convolutional source TLV removed) in the share *share*
+// of the size-classed pool (small, medium, large) of *slots* symbols per share
+static __always_inline int storePacket_decode_pool(struct __sk_buff *skb, __u32 encodingSymbolID, __u32 share, void *small, void *medium, void *large, __u32 slots) {
+    // Get the packet length from the IPv6 header to the end of the payload
+    __u32 packet_len = skb->len;
+
+    // Ensures that we do not try to protect a too big packet
+    if (packet_len > MAX_SYMBOL_LENGTH) {
+        // if (DEBUG) bpf_printk("Receiver: too big packet, does not protect\n");
+        return 1;
+    }
+
+    // Get pointer to the IPv6 header of the packet, i.e. the beginning of the source symbol
+    struct ip6_t *ip6 = seg6_get_ipv6(skb);
+    if (!ip6) {
+        // if (DEBUG) bpf_printk("Receiver: impossible to get the IPv6 header\n");
+        return -1;
+    }
+
+    __u32 ipv6_offset = (__u64)ip6 - (__u64)skb->data;
+    if (ipv6_offset < 0 || ipv6_offset > MAX_PACKET_SIZE) return -1;
+
+    // The slots of the smallest class are large enough for the IPv6 header and the SRH
+    symbol_slot_t *slot = symbol_pool_store(skb, ipv6_offset, packet_len - ipv6_offset, encodingSymbolID, share, small, medium, large, slots);
+    if (!slot) {
+        // if (DEBUG) bpf_printk("Receiver: impossible to load bytes from packet\n");
+        return -1;
+    }
+
+    return cleanPacket_decode(slot->packet, sizeof(struct tlvSource__convo_t));
+}
+
+// Same as storeRepairSymbol but stores the payload in the share *share* of the size-classed pool (small, medium, large) of *slots* symbols per share.
+// Returns the length of the stored payload or -1 in case of error
+static __always_inline int storeRepairSymbol_pool(struct __sk_buff *skb, struct ip6_srh_t *srh, __u32 encodingSymbolID, __u32 share, void *small, void *medium, void *large, __u32 slots) {
+    void *data = (void *)(long)skb->data;
+    void *data_end = (void *)(long)skb->data_end;
+
+    // Get pointer to the payload of the packet
+    void *payload_pointer = seg6_find_payload(skb, srh);
+    if (!payload_pointer) {
+        // if (DEBUG) bpf_printk("Receiver: impossible to get a pointer to the repair symbol payload\n");
+        return -1;
+    }
+
+    // The payload contains the repair symbol, but also the transport header which must be skipped
+    // By construction, this transport header is a simple UDP transport header
+    if (payload_pointer + 8 > data_end) {
+        // if (DEBUG) bpf_printk("Receiver: cannot get passed the transport header\n");
+        return -1;
+    }
+    payload_pointer += 8;
+
+    __u32 payload_offset = (long)payload_pointer - (long)data;
+    if (payload_offset > skb->len) return -1;
+
+    symbol_slot_t *slot = symbol_pool_store(skb, payload_offset, skb->len - payload_offset, encodingSymbolID, share, small, medium, large, slots);
+    if (!slot) {
+        // if (DEBUG) bpf_printk("Receiver: impossible to load bytes\n");
+        return -1;
+    }
+
+    return slot->packet_length;
+}
+
 #endif
\ No newline at end of file
@@ -13,6 +13,27 @@
 
 #include "../libseg6.c"
 #include "../encoder.h"
+#include "symbol_pool.c"
+
+// Sets to 0 the fields of the stored packet that may vary in the network
+static __always_inline int cleanPacket(__u8 *packet) {
+    // Get the IPv6 header from the sourceSymbol pointer.
+    // We must put the fields that may vary in the network to 0 because coding to ensure that the
+    // decoded values on the decoder will be the same.
+    // Destination address
+    // Hot Limit
+    struct ip6_t *source_ipv6 = (struct ip6_t *)packet;
+    source_ipv6->dst_hi    = 0;
+    source_ipv6->dst_lo    = 0;
+    source_ipv6->hop_limit = 0;
+
+    // Also get the Segment Routing header. We must set the value of segment_left to 0
+    // as it will also be modified for the decoder */
+    struct ip6_srh_t *srh = (struct ip6_srh_t *)(packet + 40);
+    srh->segments_left = 0;
+
+    return 0;
+}
 
 static __always_inline int storePacket(struct __sk_buff *skb, struct sourceSymbol_t *sourceSymbol) {
     int err;
@@ -22,7 +43,7 @@ static __always_inline int storePacket(struct __sk_buff *skb, struct sourceSymbo
     __u32 packet_len = skb->len;
 
     // Ensures that we do not try to protect a too big packet
-    if (packet_len > MAX_PACKET_SIZE) {
+    if (packet_len > MAX_SYMBOL_LENGTH) {
         return 1;
     }
 
@@ -44,25 +65,36 @@ static __always_inline int storePacket(struct __sk_buff *skb, struct sourceSymbo
 
     sourceSymbol->packet_length = packet_len;
 
-    // Get the IPv6 header from the sourceSymbol pointer.
-    // We must put the fields that may vary in the network to 0 because coding to ensure that the
-    // decoded values on the decoder will be the same.
-    // Destination address
-    // Hot Limit
-    struct ip6_t *source_ipv6 = (struct ip6_t *)sourceSymbol->packet;
-    source_ipv6->dst_hi    = 0;
-    source_ipv6->dst_lo    = 0;
-    source_ipv6->hop_limit = 0;
+    return cleanPacket(sourceSymbol->packet);
+}
 
-    // Also get the Segment Routing header. We must set the value of segment_left to 0
-    // as it will also be modified for the decoder */
-    if (40 + sizeof(struct ip6_srh_t) > sizeof(sourceSymbol->packet)) {
+// Same as storePacket but stores the packet in the size-classed pool (small, medium, large) of *slots* symbols per share.
+// The share is the stream of the encodingSymbolID
+static __always_inline int storePacket_pool(struct __sk_buff *skb, __u32 encodingSymbolID, void *small, void *medium, void *large, __u32 slots) {
+    // Get the packet length from the IPv6 header to the end of the payload
+    __u32 packet_len = skb->len;
+
+    // Ensures that we do not try to protect a too big packet
+    if (packet_len > MAX_SYMBOL_LENGTH) {
+        return 1;
+    }
+
+    // Get pointer to the IPv6 header of the packet, i.e. the beginning of the source symbol
+    struct ip6_t *ip6 = seg6_get_ipv6(skb);
+    if (!ip6) {
         return -1;
     }
-    struct ip6_srh_t *srh = (struct ip6_srh_t *)(sourceSymbol->packet + 40);
-    srh->segments_left = 0;
 
-    return 0;
+    __u64 ipv6_offset = (__u64)ip6 - (__u64)skb->data;
+    if (ipv6_offset < 0 || ipv6_offset > MAX_PACKET_SIZE) return -1;
+
+    // The slots of the smallest class are large enough for the IPv6 header and the SRH
+    symbol_slot_t *slot = symbol_pool_store(skb, ipv6_offset, packet_len - ipv6_offset, encodingSymbolID, ESI_STREAM(encodingSymbolID), small, medium, large, slots);
+    if (!slot) {
+        return -1;
+    }
+
+    return cleanPacket(slot->packet);
 }
 
 #endif
\ No newline at end of file
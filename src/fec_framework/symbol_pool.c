@@ -0,0 +1,80 @@
+#ifndef SYMBOL_POOL_H_
+#define SYMBOL_POOL_H_
+
+#ifndef VMLINUX_H_
+#define VMLINUX_H_
+#include <linux/bpf.h>
+#endif
+
+#ifndef BPF_HELPERS_H_
+#define BPF_HELPERS_H_
+#include <bpf/bpf_helpers.h>
+#endif
+
+#include "../fec_srv6.h"
+
+// Number of streams of encodingSymbolIDs of the encoder (see ESI_STREAM). Set by user space before loading the program
+const volatile __u32 encoder_streams = 1;
+
+// Declares the three size-classed maps of a pool of *slots* symbols (per share): name_small, name_medium and name_large.
+// User space multiplies the max_entries of the maps by the number of shares
+// The maps are mmapped by user space to read the symbols without copying them through the perf buffer
+#define SYMBOL_POOL(name, slots) \
+struct { \
+    __uint(type, BPF_MAP_TYPE_ARRAY); \
+    __uint(max_entries, slots); \
+    __uint(map_flags, BPF_F_MMAPABLE); \
+    __type(key, __u32); \
+    __type(value, symbol_small_t); \
+} name##_small SEC(".maps"); \
+struct { \
+    __uint(type, BPF_MAP_TYPE_ARRAY); \
+    __uint(max_entries, slots); \
+    __uint(map_flags, BPF_F_MMAPABLE); \
+    __type(key, __u32); \
+    __type(value, symbol_medium_t); \
+} name##_medium SEC(".maps"); \
+struct { \
+    __uint(type, BPF_MAP_TYPE_ARRAY); \
+    __uint(max_entries, slots); \
+    __uint(map_flags, BPF_F_MMAPABLE); \
+    __type(key, __u32); \
+    __type(value, symbol_large_t); \
+} name##_large SEC(".maps");
+
+// Loads *length* bytes of the packet from *offset* in the slot of the class of size *size*
+static __always_inline symbol_slot_t *symbol_pool_load(struct __sk_buff *skb, __u32 offset, __u32 length, __u32 encodingSymbolID, __u32 share, void *pool, __u32 slots, __u32 size) {
+    __u32 k = SYMBOL_POOL_INDEX(encodingSymbolID, slots, share);
+    symbol_slot_t *slot = bpf_map_lookup_elem(pool, &k);
+    if (!slot) {
+        return 0;
+    }
+
+    // Mark the slot before overwriting it, user space checks this value after reading the symbol
+    slot->encodingSymbolID = encodingSymbolID;
+    slot->packet_length = length;
+
+    if (bpf_skb_load_bytes(skb, offset, slot->packet, ((length - 1) & (size - 1)) + 1) < 0) {
+        slot->packet_length = 0;
+        return 0;
+    }
+
+    return slot;
+}
+
+// Stores *length* bytes of the packet from *offset* in the smallest class of the pool that can hold them, in the share *share*.
+// Returns a pointer to the slot or 0 if the symbol cannot be stored
+static __always_inline symbol_slot_t *symbol_pool_store(struct __sk_buff *skb, __u32 offset, __u32 length, __u32 encodingSymbolID, __u32 share, void *small, void *medium, void *large, __u32 slots) {
+    if (length == 0) {
+        return 0;
+    } else if (length <= SYMBOL_SMALL_SIZE) {
+        return symbol_pool_load(skb, offset, length, encodingSymbolID, share, small, slots, SYMBOL_SMALL_SIZE);
+    } else if (length <= SYMBOL_MEDIUM_SIZE) {
+        return symbol_pool_load(skb, offset, length, encodingSymbolID, share, medium, slots, SYMBOL_MEDIUM_SIZE);
+    } else if (length <= MAX_SYMBOL_LENGTH) {
+        return symbol_pool_load(skb, offset, length, encodingSymbolID, share, large, slots, SYMBOL_LARGE_SIZE);
+    }
+    return 0;
+}
+
+#endif
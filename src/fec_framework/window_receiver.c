@@ -9,20 +9,105 @@
 #endif
 
 #include "../libseg6.c"
+#include "../events.c"
 #include "../decoder.h"
 #include "store_packet_receiver.c"
 #include "../fec_scheme/bpf/convo_rlc_receiver.c"
 
+// Number of decoding contexts, i.e. of shares of the symbol pools. Set by user space before loading the program
+const volatile __u32 decode_contexts = 1;
+
+// Decoding contexts, one per stream of encodingSymbolIDs (ESI_STREAM) of each encoder. Created by the first
+// symbol of their key and deleted by user space when idle. User space sets the maximum number of contexts
 struct {
     __uint(type, BPF_MAP_TYPE_HASH);
     __uint(max_entries, 1);
-    __type(key, __u32);
+    __type(key, decode_context_key_t);
     __type(value, fecConvolution_t);
 } fecConvolutionInfoMap SEC(".maps");
 
+// Initial value of the new contexts, set by user space (too large for the stack)
+struct {
+    __uint(type, BPF_MAP_TYPE_ARRAY);
+    __uint(max_entries, 1);
+    __type(key, __u32);
+    __type(value, fecConvolution_t);
+} fecConvolutionTemplate SEC(".maps");
+
+// Owner of each share of the symbol pools: a new context claims a free share
+struct {
+    __uint(type, BPF_MAP_TYPE_HASH);
+    __uint(max_entries, MAX_DECODE_CONTEXTS);
+    __type(key, __u32);
+    __type(value, decode_context_key_t);
+} contextShares SEC(".maps");
+
+// Storage of the received source and repair symbols, mmapped by user space for decoding.
+// Each decoding context uses its own share of the pools
+SYMBOL_POOL(sourceSymbolPool, RLC_RECEIVER_BUFFER_SIZE)
+SYMBOL_POOL(repairSymbolPool, RLC_RECEIVER_REPAIR_SLOTS)
+
+// Sets the encoder in the key of the decoding context of a repair symbol: the encoder sends them from its SID,
+// the same SID as in the TLV of its source symbols (see receiveSourceSymbol__convolution)
+static __always_inline int decodeContext__encoder(struct __sk_buff *skb, decode_context_key_t *key) {
+    memset(key, 0, sizeof(decode_context_key_t));
+    struct ip6_t *ip6 = seg6_get_ipv6(skb);
+    if (!ip6) {
+        return -1;
+    }
+    key->encoder_hi = ip6->src_hi;
+    key->encoder_lo = ip6->src_lo;
+    return 0;
+}
+
+// Creates the decoding context of *key* with a free share of the symbol pools.
+// Returns 0 if there is no share left
+static __always_inline fecConvolution_t *decodeContext__create(decode_context_key_t *key) {
+    __u32 k0 = 0;
+    fecConvolution_t *template = bpf_map_lookup_elem(&fecConvolutionTemplate, &k0);
+    if (!template) {
+        return 0;
+    }
+
+    // Claim a free share, starting from a position depending on the key to limit the collisions
+    __u32 first = (__u32)(key->encoder_lo ^ key->stream) % decode_contexts;
+    for (__u32 i = 0; i < MAX_DECODE_CONTEXTS && i < decode_contexts; ++i) {
+        __u32 share = (first + i) % decode_contexts;
+        if (bpf_map_update_elem(&contextShares, &share, key, BPF_NOEXIST) < 0) {
+            continue;
+        }
+
+        // The template has no share: the context cannot be used until it is set below
+        if (bpf_map_update_elem(&fecConvolutionInfoMap, key, template, BPF_NOEXIST) < 0) {
+            // Created by another CPU in the meantime
+            bpf_map_delete_elem(&contextShares, &share);
+            return bpf_map_lookup_elem(&fecConvolutionInfoMap, key);
+        }
+        fecConvolution_t *fecConvolution = bpf_map_lookup_elem(&fecConvolutionInfoMap, key);
+        if (fecConvolution) {
+            fecConvolution->share = share;
+        }
+        return fecConvolution;
+    }
+
+    return 0;
+}
+
+// Returns the decoding context of *key*, created if needed. Returns 0 if it cannot be used (yet)
+static __always_inline fecConvolution_t *decodeContext__get(decode_context_key_t *key) {
+    fecConvolution_t *fecConvolution = bpf_map_lookup_elem(&fecConvolutionInfoMap, key);
+    if (!fecConvolution) {
+        fecConvolution = decodeContext__create(key);
+    }
+    if (!fecConvolution || fecConvolution->share >= decode_contexts) {
+        return 0;
+    }
+    fecConvolution->last_seen = bpf_ktime_get_ns();
+    return fecConvolution;
+}
+
 static __always_inline int receiveSourceSymbol__convolution(struct __sk_buff *skb, struct ip6_srh_t *srh, int tlv_offset, void *map) {
     int err;
-    int k = 0;
 
     // Load the TLV in the structure
     struct tlvSource__convo_t tlv;
@@ -32,6 +117,11 @@ static __always_inline int receiveSourceSymbol__convolution(struct __sk_buff *sk
         return 0;
     }
 
+    // The encoder is carried in the TLV, whatever its position in the SRH
+    decode_context_key_t key;
+    memset(&key, 0, sizeof(decode_context_key_t));
+    memcpy(&key.encoder_hi, tlv.encoder, sizeof(tlv.encoder));
+
     // Remove the TLV from the packet as we have a local copy
     err = seg6_delete_tlv2(skb, srh, tlv_offset);
     if (err != 0) {
@@ -46,8 +136,9 @@ static __always_inline int receiveSourceSymbol__convolution(struct __sk_buff *sk
         return -1;
     }
 
-    // Get pointer to global stucture
-    fecConvolution_t *fecConvolution = bpf_map_lookup_elem(&fecConvolutionInfoMap, &k);
+    // Get pointer to the context of the stream of the symbol
+    key.stream = ESI_STREAM(encodingSymbolID);
+    fecConvolution_t *fecConvolution = decodeContext__get(&key);
     if (!fecConvolution) {
         //bpf_printk("Receiver: impossible to get pointer to the structure\n");
         return BPF_ERROR;
@@ -60,9 +151,8 @@ static __always_inline int receiveSourceSymbol__convolution(struct __sk_buff *sk
         return -1;
     }
 
-    struct sourceSymbol_t *sourceSymbol = &fecConvolution->sourceRingBuffer[ringBufferIndex & (RLC_RECEIVER_BUFFER_SIZE - 1)];
     // See if the packet is already in the buffer
-    struct tlvSource__convo_t *tlv_ss = (struct tlvSource__convo_t *)&sourceSymbol->tlv;
+    struct tlvSource__convo_t *tlv_ss = &fecConvolution->sourceTlvBuffer[ringBufferIndex & (RLC_RECEIVER_BUFFER_SIZE - 1)];
     // Second condition to ensure that this is not the initialization
     if (tlv_ss->encodingSymbolID == encodingSymbolID && tlv_ss->tlv_type != 0) {
         // bpf_printk("Receiver: source symbol already in the buffer: %d %d\n", tlv_ss->encodingSymbolID, encodingSymbolID);
@@ -70,7 +160,7 @@ static __always_inline int receiveSourceSymbol__convolution(struct __sk_buff *sk
     }
 
     // Store source symbol
-    err = storePacket_decode(skb, sourceSymbol);
+    err = storePacket_decode_pool(skb, encodingSymbolID, fecConvolution->share, &sourceSymbolPool_small, &sourceSymbolPool_medium, &sourceSymbolPool_large, RLC_RECEIVER_BUFFER_SIZE);
     if (err < 0) {
         // bpf_printk("Receiver: error from storePacket confirmed\n");
         return -1;
@@ -80,7 +170,7 @@ static __always_inline int receiveSourceSymbol__convolution(struct __sk_buff *sk
     }
 
     // Copy the TLV for later use
-    memcpy(&sourceSymbol->tlv, &tlv, sizeof(struct tlvSource__convo_t));
+    memcpy(tlv_ss, &tlv, sizeof(struct tlvSource__convo_t));
 
     // Update the controller update period
     fecConvolution->controller_update = tlv.controller_update;
@@ -96,31 +186,46 @@ static __always_inline int receiveSourceSymbol__convolution(struct __sk_buff *sk
 
         // The following lines update the encodingSymbolID only if it is more recent than what we have
         // => take into account reordering that could jeopardize the good statistics
-        if ((fecConvolution->most_recent_encodingSymbolID < encodingSymbolID && 
-                encodingSymbolID - fecConvolution->most_recent_encodingSymbolID < RLC_RECEIVER_BUFFER_SIZE) ||
-                (fecConvolution->most_recent_encodingSymbolID > encodingSymbolID && 
-                encodingSymbolID - fecConvolution->most_recent_encodingSymbolID > RLC_RECEIVER_BUFFER_SIZE)) {
+        __u32 ahead = ESI_DIFF(encodingSymbolID, fecConvolution->most_recent_encodingSymbolID);
+        if (ahead > 0 && ahead < RLC_RECEIVER_BUFFER_SIZE) {
             fecConvolution->most_recent_encodingSymbolID = encodingSymbolID;
+            // The symbols skipped form a loss burst (or are reordered), used by the encoder to estimate the burst length
+            if (ahead > 1) {
+                ++fecConvolution->loss_bursts;
+            }
         }
 
         // Compute theoretical counter
         __u16 theoretical_counter = fecConvolution->most_recent_encodingSymbolID - fecConvolution->last_encodingSymbolID;
         if (theoretical_counter >= fecConvolution->controller_update) {
-            controller_t controller_info = {0};
+            controller_t controller_stack = {0};
+            controller_t *controller_info = &controller_stack;
+            if (use_ringbuf) {
+                controller_info = reserve_user_space(sizeof(controller_t));
+                if (!controller_info) {
+                    return -1;
+                }
+            }
             
             // 4 => this is a controller message, 2 => controller enabled
-            controller_info.controller_repair = 6;
+            controller_info->controller_repair = 6;
 
             // Set counters
-            controller_info.received_counter = fecConvolution->received_counter;
-            controller_info.theoretical_counter = theoretical_counter;
+            controller_info->received_counter = fecConvolution->received_counter;
+            controller_info->theoretical_counter = theoretical_counter;
+            controller_info->loss_bursts = fecConvolution->loss_bursts;
 
             // Get lightweight structure for the perf output
-            bpf_perf_event_output(skb, map, BPF_F_CURRENT_CPU, &controller_info, sizeof(controller_t));
+            if (use_ringbuf) {
+                submit_user_space(controller_info);
+            } else {
+                send_to_user_space(skb, map, controller_info, sizeof(controller_t));
+            }
             
             // Reset the counter and last update
             fecConvolution->last_encodingSymbolID = fecConvolution->most_recent_encodingSymbolID;
             fecConvolution->received_counter = 0;
+            fecConvolution->loss_bursts = 0;
         }
     }
 
@@ -129,7 +234,6 @@ static __always_inline int receiveSourceSymbol__convolution(struct __sk_buff *sk
 
 static __always_inline int receiveRepairSymbol__convolution(struct __sk_buff *skb, struct ip6_srh_t *srh, int tlv_offset, void *map) {
     int err;
-    int k = 0;
 
     struct tlvRepair__convo_t tlv;
     err = bpf_skb_load_bytes(skb, tlv_offset, &tlv, sizeof(struct tlvRepair__block_t));
@@ -144,9 +248,18 @@ static __always_inline int receiveRepairSymbol__convolution(struct __sk_buff *sk
         return -1;
     }
     __u8 windowSize = tlv.nss;
+    __u8 repairIndex = RLC_REPAIR_INDEX(tlv.repairFecInfo);
+    if (repairIndex >= MAX_RLC_RS_NUMBER) {
+        return -1;
+    }
 
-    // Get pointer to global stucture
-    fecConvolution_t *fecConvolution = bpf_map_lookup_elem(&fecConvolutionInfoMap, &k);
+    // Get pointer to the context of the stream of the symbol
+    decode_context_key_t key;
+    if (decodeContext__encoder(skb, &key) < 0) {
+        return 0;
+    }
+    key.stream = ESI_STREAM(encodingSymbolID);
+    fecConvolution_t *fecConvolution = decodeContext__get(&key);
     if (!fecConvolution) {
         // bpf_printk("Receiver: impossible to get pointer to the structure\n");
         return BPF_ERROR;
@@ -161,43 +274,58 @@ static __always_inline int receiveRepairSymbol__convolution(struct __sk_buff *sk
 
     /* Get pointer to information of the window */
     window_info_t *window_info = &fecConvolution->windowInfoBuffer[windowRingBufferIndex & (RLC_RECEIVER_BUFFER_SIZE - 1)];
-    // TODO: check if already received repair symbol ?
-    struct repairSymbol_t *repairSymbol = &window_info->repairSymbol;
+
+    // The first repair symbol of a window resets the entry of the previous window
+    if (window_info->encodingSymbolID != encodingSymbolID || window_info->repair_mask == 0) {
+        window_info->repair_mask = 0;
+        window_info->received_rs = 0;
+        window_info->encodingSymbolID = encodingSymbolID;
+    } else if (window_info->repair_mask & (1 << repairIndex)) {
+        return 0; // Already received
+    }
 
     // Store repair symbol
-    err = storeRepairSymbol(skb, repairSymbol, srh);
+    err = storeRepairSymbol_pool(skb, srh, RLC_REPAIR_SYMBOL_ID(encodingSymbolID, repairIndex), fecConvolution->share, &repairSymbolPool_small, &repairSymbolPool_medium, &repairSymbolPool_large, RLC_RECEIVER_REPAIR_SLOTS);
     if (err < 0) {
          bpf_printk("Receiver: error from storeRepairSymbol confirmed\n");
         return -1;
-    } else if (err > 0) {
-         bpf_printk("Receiver: confirmed packet too big for protection\n");
-        return -1;
     }
-
-    // (Re)set values of window info: assumes that only one repair symbol is used here
+    window_info->packet_length[repairIndex & (MAX_RLC_RS_NUMBER - 1)] = err;
+    window_info->repair_mask |= 1 << repairIndex;
+    ++window_info->received_rs;
     window_info->received_ss = 0;
-    window_info->received_rs = 1;
-    window_info->encodingSymbolID = encodingSymbolID;
 
     // Copy the TLV for later use
-    memcpy(&repairSymbol->tlv, &tlv, sizeof(struct tlvRepair__convo_t));
+    memcpy(&window_info->tlv[repairIndex & (MAX_RLC_RS_NUMBER - 1)], &tlv, sizeof(struct tlvRepair__convo_t));
 
-    // Iterate over sourceRingBuffer to get information about possible reparation
+    // Iterate over sourceTlvBuffer to get information about possible reparation
     for (__u8 i = 0; i < windowSize && i < MAX_RLC_WINDOW_SIZE; ++i) {
-        __u8 ringBufferIndex = (encodingSymbolID - i) % RLC_RECEIVER_BUFFER_SIZE;
-        struct tlvSource__convo_t *tlv_ss = (struct tlvSource__convo_t *)&fecConvolution->sourceRingBuffer[ringBufferIndex & (RLC_RECEIVER_BUFFER_SIZE - 1)].tlv;
-        if (tlv_ss->encodingSymbolID - i == encodingSymbolID) {
+        __u32 sourceID = ESI_SUB(encodingSymbolID, i);
+        __u8 ringBufferIndex = sourceID % RLC_RECEIVER_BUFFER_SIZE;
+        struct tlvSource__convo_t *tlv_ss = &fecConvolution->sourceTlvBuffer[ringBufferIndex & (RLC_RECEIVER_BUFFER_SIZE - 1)];
+        if (tlv_ss->encodingSymbolID == sourceID && tlv_ss->tlv_type != 0) {
             ++window_info->received_ss;
         }
     }
 
     fecConvolution->encodingSymbolID = encodingSymbolID;
 
-    // For now we give all data to user space to decode and recover from lost symbols
-    // TODO: decode in eBPF kernel program and only send the recovered packets here
-    // but currently not possible due to the verifier limitations */
+    // A single loss of small symbols is recovered here: user space only sends the recovered symbol
+    __u32 recoveredID;
+    if (recover_single__convoRLC(fecConvolution, window_info, &tlv, repairIndex, &sourceSymbolPool_small, &repairSymbolPool_small, &recoveredID) == 0) {
+        ++window_info->received_ss;
+        kernel_recovered_t recovered = {
+            .message_type = RLC_KERNEL_RECOVERED,
+            .share = fecConvolution->share,
+            .encodingSymbolID = recoveredID,
+        };
+        send_to_user_space(skb, map, &recovered, sizeof(kernel_recovered_t));
+    }
+
+    // Give the window to user space only if it has lost symbols that can be recovered
+    // The other losses are not decoded in eBPF due to the verifier limitations
     if (try_to_recover_from_repair__convoRLC(skb, fecConvolution, window_info, &tlv)) {
-        bpf_perf_event_output(skb, map, BPF_F_CURRENT_CPU, fecConvolution, sizeof(fecConvolution_t));
+        send_to_user_space(skb, map, fecConvolution, sizeof(fecConvolution_t));
     }
 
     return 0;
@@ -9,26 +9,134 @@
 #endif
 
 #include "../libseg6.c"
+#include "../events.c"
 #include "../encoder.bpf.h"
 #include "store_packet_sender.c"
+#include "sender_state.c"
+#include "rate_controller.c"
 #include "../fec_scheme/bpf/convo_rlc_sender.c"
 
+// FEC contexts, created by the first packet of their key and deleted by user space when idle.
+// User space sets the maximum number of contexts to the number of streams of encodingSymbolIDs
 struct {
     __uint(type, BPF_MAP_TYPE_HASH);
     __uint(max_entries, 1);
-    __type(key, __u32);
+    __type(key, fec_context_key_t);
     __type(value, fecConvolution_t);
 } fecConvolutionInfoMap SEC(".maps");
 
-typedef struct {
-    __u32 encodingSymbolID;
-    __u16 repairKey;
-    __u8 ringBuffSize; // Number of packets for next coding in the ring buffer
-    struct sourceSymbol_t sourceRingBuffer[RLC_BUFFER_SIZE];
-    struct tlvRepair__convo_t repairTlv[RLC_RS_NUMBER];
-    __u8 currentWindowSize;
-    __u8 currentWindowSlide;
-} for_user_space_t;
+// Parameters of the new contexts, set by user space
+struct {
+    __uint(type, BPF_MAP_TYPE_ARRAY);
+    __uint(max_entries, 1);
+    __type(key, __u32);
+    __type(value, fecConvolution_user_t);
+} fecConvolutionConfig SEC(".maps");
+
+// Owner and sequence of each stream of encodingSymbolIDs: a new context claims a free stream.
+// User space releases the stream of an evicted context
+struct {
+    __uint(type, BPF_MAP_TYPE_ARRAY);
+    __uint(max_entries, MAX_ENCODER_STREAMS);
+    __type(key, __u32);
+    __type(value, context_stream_t);
+} contextStreams SEC(".maps");
+
+// Incremental encoding: user space is notified of each source symbol to encode it as soon as it arrives.
+// Set by user space before loading the program
+const volatile __u8 incremental_encoding = 0;
+// Time after which the source symbols of an incomplete window are protected by a repair symbol over the partial window,
+// see fecFramework__flush(). Set by user space before loading the program, 0 to always wait for a full window
+const volatile __u64 flush_timeout_ns = 0;
+
+// Source symbols of the convolutional window, stored by size class. The maps are mmapped
+// by user space so that only a small window descriptor travels through the perf buffer
+SYMBOL_POOL(sourceSymbolPool, RLC_BUFFER_SIZE)
+
+// Returns the FEC context of the packet, created with its own stream of encodingSymbolIDs if needed.
+// Returns 0 if the context does not exist and cannot be created (no stream left)
+static __always_inline fecConvolution_t *fecFramework__context(struct __sk_buff *skb) {
+    struct ip6_t *ip6 = seg6_get_ipv6(skb);
+    if (!ip6) {
+        return 0;
+    }
+
+    fec_context_key_t key;
+    memset(&key, 0, sizeof(fec_context_key_t));
+    key.sid_hi = ip6->dst_hi;
+    key.sid_lo = ip6->dst_lo;
+    key.flow = sender_state_flow(skb);
+
+    __u64 now = bpf_ktime_get_ns();
+    fecConvolution_t *fecConvolution = bpf_map_lookup_elem(&fecConvolutionInfoMap, &key);
+    if (fecConvolution) {
+        fecConvolution->last_seen = now;
+        return fecConvolution;
+    }
+
+    __u32 k0 = 0;
+    fecConvolution_user_t *config = bpf_map_lookup_elem(&fecConvolutionConfig, &k0);
+    if (!config) {
+        return 0;
+    }
+
+    // Claim a free stream, starting from a position depending on the key to limit the collisions
+    __u32 first = (__u32)(key.sid_lo ^ key.flow) % encoder_streams;
+    for (__u32 i = 0; i < MAX_ENCODER_STREAMS && i < encoder_streams; ++i) {
+        __u32 stream = (first + i) % encoder_streams;
+        context_stream_t *owner = bpf_map_lookup_elem(&contextStreams, &stream);
+        if (!owner) {
+            continue;
+        }
+        bpf_spin_lock(&owner->lock);
+        int claimed = !owner->used;
+        __u32 next_id = owner->next_id;
+        if (claimed) {
+            owner->used = 1;
+            owner->owner = key;
+        }
+        bpf_spin_unlock(&owner->lock);
+        if (!claimed) {
+            continue;
+        }
+
+        fecConvolution_t context;
+        memset(&context, 0, sizeof(fecConvolution_t));
+        memcpy(&context, config, sizeof(fecConvolution_user_t));
+        context.message_type = RLC_WINDOW_DESCRIPTOR;
+        // Continue the sequence of the previous context of the stream, if any
+        context.encodingSymbolID = next_id ? next_id : stream << ESI_SEQ_BITS;
+        context.decoder_hi = key.sid_hi;
+        context.decoder_lo = key.sid_lo;
+        context.last_seen = now;
+        if (bpf_map_update_elem(&fecConvolutionInfoMap, &key, &context, BPF_NOEXIST) < 0) {
+            // Created by another CPU in the meantime
+            bpf_spin_lock(&owner->lock);
+            owner->used = 0;
+            bpf_spin_unlock(&owner->lock);
+        }
+        return bpf_map_lookup_elem(&fecConvolutionInfoMap, &key);
+    }
+
+    return 0;
+}
+
+// Forwards the window descriptor to user space for computation as we cannot perform that is the kernel
+// due to the current limitations. The source symbols are read from the mmapped sourceSymbolPool.
+// *fecConvolution* is a fecConvolution_t or a copy of its fecConvolution_user_t prefix
+static __always_inline int fecFramework__send_window(void *ctx, void *fecConvolution, void *map) {
+    if (use_ringbuf) {
+        fecConvolution_user_t *descriptor = reserve_user_space(sizeof(fecConvolution_user_t));
+        if (!descriptor) {
+            return -1;
+        }
+        memcpy(descriptor, fecConvolution, sizeof(fecConvolution_user_t));
+        submit_user_space(descriptor);
+    } else {
+        send_to_user_space(ctx, map, fecConvolution, sizeof(fecConvolution_user_t));
+    }
+    return 0;
+}
 
 static __always_inline int fecFramework__convolution(struct __sk_buff *skb, void *tlv_void, fecConvolution_t *fecConvolution, void *map) {
     struct tlvSource__convo_t *tlv = (struct tlvSource__convo_t *)tlv_void;
@@ -40,41 +148,39 @@ static __always_inline int fecFramework__convolution(struct __sk_buff *skb, void
         return -1;
     }
 
+    // Apply the decision of the controller before using the parameters of the context
+    rate_controller__receive(fecConvolution);
+
     // Get parameters of the Framework *safely*
-    bpf_spin_lock(&fecConvolution->lock);
+    sender_state_lock(&fecConvolution->lock);
     __u32 encodingSymbolID = fecConvolution->encodingSymbolID;
     __u16 repairKey = fecConvolution->repairKey;
     __u8 ringBuffSize = fecConvolution->ringBuffSize;
     __u8 windowSize = fecConvolution->currentWindowSize;
-    fecConvolution->encodingSymbolID = encodingSymbolID + 1; // Already update the encodingSymbolID for next
+    fecConvolution->encodingSymbolID = ESI_ADD(encodingSymbolID, 1); // Already update the encodingSymbolID for next
+    if (flush_timeout_ns && !fecConvolution->first_unprotected) {
+        fecConvolution->first_unprotected = fecConvolution->last_seen; // Set by fecFramework__context() for this packet
+    }
     // TODO: maybe do the check to update the ring buff size directly here
-    bpf_spin_unlock(&fecConvolution->lock);
+    sender_state_unlock(&fecConvolution->lock);
 
     // Complete the source symbol TLV
     tlv->tlv_type = TLV_CODING_SOURCE;
     tlv->len = sizeof(struct tlvSource__convo_t) - 2;
     tlv->encodingSymbolID = encodingSymbolID;
+    // The decoder identifies the encoder by this SID, whatever the position of the encoder in the SRH
+    #pragma clang loop unroll(full)
+    for (int i = 0; i < 16; ++i) {
+        tlv->encoder[i] = encoder_sid[i];
+    }
     if (fecConvolution->controller_repair & 0x2) {
         tlv->controller_update = fecConvolution->controller_period;
     } else {
         tlv->controller_update = 0;
     }
 
-    // Get pointer in the ring buffer to store the source symbol
-    __u32 ringBufferIndex = encodingSymbolID % windowSize;
-    if (ringBufferIndex < 0 || ringBufferIndex >= windowSize) { // Check for the eBPF verifier
-        if (DEBUG) bpf_printk("Sender: RLC index to ring buffer\n");
-        return -1;
-    }
-    struct sourceSymbol_t *sourceSymbol = &fecConvolution->sourceRingBuffer[ringBufferIndex & (RLC_BUFFER_SIZE - 1)];
-    // Custom memset
-    //__u64 *ss64 = (__u64 *)sourceSymbol->packet;
-    //for (int i = 0; i < MAX_PACKET_SIZE / 8; ++i) {
-    //    ss64[i] = 0;
-    //}
-
-    // Store source symbol
-    ret = storePacket(skb, sourceSymbol);
+    // Store source symbol in the pool
+    ret = storePacket_pool(skb, encodingSymbolID, &sourceSymbolPool_small, &sourceSymbolPool_medium, &sourceSymbolPool_large, RLC_BUFFER_SIZE);
     if (ret < 0) { // Error
         if (DEBUG) bpf_printk("Sender: error from storePacket confirmed\n");
         return -1;
@@ -86,21 +192,72 @@ static __always_inline int fecFramework__convolution(struct __sk_buff *skb, void
     // The ring buffer contains a new source symbol
     ++ringBuffSize;
 
-    // Call coding function
+    // User space adds the symbol to the repair symbols of its windows right away
+    if (incremental_encoding && (fecConvolution->controller_repair & 0x1)) {
+        source_notification_t notification = {
+            .message_type = RLC_SOURCE_NOTIFICATION,
+            .encodingSymbolID = encodingSymbolID,
+            .repairKey = repairKey,
+            .ringBuffSize = ringBuffSize,
+            .windowSize = windowSize,
+            .windowSlide = fecConvolution->currentWindowSlide,
+            .repairSymbols = fecConvolution->repairSymbols,
+        };
+        send_to_user_space(skb, map, &notification, sizeof(source_notification_t));
+    }
+
+    // Call coding function. The window is closed under the lock, like in fecFramework__flush(),
+    // and its descriptor is copied before another packet (or the flush) modifies the repair TLVs
+    fecConvolution_user_t descriptor;
+    sender_state_lock(&fecConvolution->lock);
     ret = fecScheme__convoRLC(skb, fecConvolution, ringBuffSize, encodingSymbolID);
+    if (ret > 0) {
+        memcpy(&descriptor, fecConvolution, sizeof(fecConvolution_user_t));
+    } else if (!ret) {
+        fecConvolution->ringBuffSize = ringBuffSize; // The value is updated by the FEC Scheme if we generate repair symbols
+    }
+    sender_state_unlock(&fecConvolution->lock);
     if (ret < 0) {
         return -1;
     }
 
     // A repair symbol must be generated
-    // Forward all data to user space for computation for now as we cannot perform that is the kernel
-    // due to the current limitations
-    if (ret && (fecConvolution->controller_repair & 0x1)) {
-        fecConvolution_user_t *to_user_space = (fecConvolution_user_t *)fecConvolution;
-        bpf_perf_event_output(skb, map, BPF_F_CURRENT_CPU, fecConvolution, sizeof(fecConvolution_user_t));
-    } else if (!ret) {
-        fecConvolution->ringBuffSize = ringBuffSize; // The value is updated by the FEC Scheme if we generate repair symbols
+    if (ret && (descriptor.controller_repair & 0x1)) {
+        return fecFramework__send_window(skb, &descriptor, map);
+    }
+
+    return 0;
+}
+
+// Protects the source symbols of the current window of the context if the first of them waits for
+// a repair symbol since flush_timeout_ns: the repair symbols cover the partial window (nss < window size).
+// The window itself is not modified, the next full window also covers these symbols.
+// Called by user space through the flush program, as the last packets of a burst do not trigger any program.
+// The flush runs on any CPU: it needs the shared state, where the packets also take the lock of the context
+static __always_inline int fecFramework__flush(void *ctx, fecConvolution_t *fecConvolution, void *map) {
+    __u64 now = bpf_ktime_get_ns();
+
+    if (per_cpu_state) {
+        return 0;
     }
 
+    bpf_spin_lock(&fecConvolution->lock);
+    __u64 first_unprotected = fecConvolution->first_unprotected;
+    __u8 ringBuffSize = fecConvolution->ringBuffSize;
+    if (!first_unprotected || now < first_unprotected + flush_timeout_ns ||
+            ringBuffSize == 0 || ringBuffSize >= fecConvolution->currentWindowSize) {
+        bpf_spin_unlock(&fecConvolution->lock);
+        return 0;
+    }
+    // The window ends with the last source symbol of the context.
+    // The descriptor is copied under the lock: the next packet may overwrite the repair TLVs
+    fecScheme__convoRLC_repairTlvs(fecConvolution, ringBuffSize, ESI_SUB(fecConvolution->encodingSymbolID, 1));
+    fecConvolution_user_t descriptor;
+    memcpy(&descriptor, fecConvolution, sizeof(fecConvolution_user_t));
+    bpf_spin_unlock(&fecConvolution->lock);
+
+    if (descriptor.controller_repair & 0x1) {
+        return fecFramework__send_window(ctx, &descriptor, map);
+    }
     return 0;
 }
\ No newline at end of file
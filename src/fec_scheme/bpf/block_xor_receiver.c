@@ -10,6 +10,7 @@
 
 #include "../../libseg6.c"
 #include "../../decoder.h"
+#include "block_xor_symbol.c"
 
 static __always_inline int can_decode_xor(struct sourceBlock_t *sourceBlock) {
 
@@ -37,31 +38,43 @@ static __always_inline int can_decode_xor(struct sourceBlock_t *sourceBlock) {
 
 }
 
+// Clears the stored source symbol of *xorStruct*, on the error paths after it is stored
+static __always_inline void clear_source_symbol_xor(xorStruct_t *xorStruct) {
+    struct sourceSymbol_t *sourceSymbol = &(xorStruct->sourceSymbol);
+    move_symbol(sourceSymbol->packet, sourceSymbol->packet, sourceSymbol->packet_length, 0);
+    sourceSymbol->packet_length = 0;
+}
+
 static __always_inline int decoding_xor_on_the_line(struct __sk_buff *skb, xorStruct_t *xorStruct, struct sourceBlock_t *sourceBlock) {
     struct sourceSymbol_t *sourceSymbol = &(xorStruct->sourceSymbol);
     struct repairSymbol_t *repairSymbol = &(xorStruct->repairSymbols);
 
+    // Only the size class of the source symbol is processed (the bytes after its length are 0)
+    __u32 length = sourceSymbol->packet_length;
+
     // If this is the first received source symbol and we did not received yet
-    // the repair symbol for this block, we reset the memory of the repair symbol
-    // of this block to 0 
-    if (sourceBlock->receivedSource == 1 && sourceBlock->receivedRepair == 0) {
-        memset(repairSymbol, 0, sizeof(struct repairSymbol_t));
+    // the repair symbol for this block, we reset the repair symbol of this block:
+    // its content is overwritten by the source symbol
+    int reset = sourceBlock->receivedSource == 1 && sourceBlock->receivedRepair == 0;
+    if (reset) {
+        length = length > repairSymbol->packet_length ? length : repairSymbol->packet_length;
+        memset(&repairSymbol->tlv, 0, sizeof(struct tlvRepair__block_t));
+        repairSymbol->packet_length = 0;
     }
 
-    // PERFORM XOR using 64 bites to have less iterations
-    __u64 *source_long = (__u64 *)sourceSymbol->packet;
-    __u64 *repair_long = (__u64 *)repairSymbol->packet;
-
-    #pragma clang loop unroll(full)
-    for (int j = 0; j < MAX_PACKET_SIZE / sizeof(__u64); ++j) {
-        repair_long[j] = repair_long[j] ^ source_long[j];
-    }
+    // PERFORM XOR using 64 bites to have less iterations, the source symbol is cleared for the next packet
+    xor_and_clear_symbol(repairSymbol->packet, sourceSymbol->packet, length, reset);
 
     // Get the repair TLV (which can contain only 0 if no repair symbol is received)
     // and perform the XOR on the length of the packet to be retrieved
     struct tlvRepair__block_t *repair_tlv = (struct tlvRepair__block_t *)&(repairSymbol->tlv);
     repair_tlv->payload_len = repair_tlv->payload_len ^ sourceSymbol->packet_length;
 
+    // Keep the maximum length of the XORed symbols to bound the operations on the repair symbol
+    if (sourceSymbol->packet_length > repairSymbol->packet_length) {
+        repairSymbol->packet_length = sourceSymbol->packet_length;
+    }
+
     // if (DEBUG) bpf_printk("Receiver: decoded on the line a packet\n");
     
     return 0;
@@ -79,14 +92,9 @@ static __always_inline int decoding_xor_on_the_line_repair(struct __sk_buff *skb
         return 0;
     }
 
-    /* PERFORM XOR using 64 bites to have less iterations */
-    __u64 *source_long = (__u64 *)sourceSymbol->packet;
-    __u64 *repair_long = (__u64 *)repairSymbol->packet;
-
-    #pragma clang loop unroll(full)
-    for (int j = 0; j < MAX_PACKET_SIZE / sizeof(__u64); ++j) {
-        repair_long[j] = repair_long[j] ^ source_long[j];
-    }
+    /* PERFORM XOR using 64 bites to have less iterations, bounded by the longest of both symbols */
+    __u32 length = sourceSymbol->packet_length > repairSymbol->packet_length ? sourceSymbol->packet_length : repairSymbol->packet_length;
+    xor_and_clear_symbol(repairSymbol->packet, sourceSymbol->packet, length, 0);
 
     // Get the repair TLV (which can contain only 0 if no repair symbol is received)
     // and perform the XOR on the length of the packet to be retrieved
@@ -10,22 +10,26 @@
 
 #include "../../libseg6.c"
 #include "../../encoder.h"
+#include "block_xor_symbol.c"
 
 #define MAX(a, b) a > b ? a : b
 
-static __always_inline int xor_on_the_line(struct __sk_buff *skb, struct repairSymbol_t *repairSymbol, struct sourceSymbol_t *sourceSymbol) {
+static __always_inline int xor_on_the_line(struct __sk_buff *skb, struct repairSymbol_t *repairSymbol, struct sourceSymbol_t *sourceSymbol, int reset) {
     // if (DEBUG) bpf_printk("Sender: XOR on the line\n");
 
-    // XOR is done by batch of 8 bytes
-    __u64 *source_8 = (__u64 *)sourceSymbol->packet;  
-    __u64 *repair_8 = (__u64 *)repairSymbol->packet;
+    // Only the size class of the source symbol is processed (the bytes after its length are 0)
+    __u32 length = sourceSymbol->packet_length;
 
-    // XOR computation
-    #pragma clang loop unroll(full)
-    for (int j = 0; j < MAX_PACKET_SIZE / sizeof(__u64); ++j) {
-        repair_8[j] ^= source_8[j];
+    // Reset the repair symbol from previous block: its content is overwritten by the source symbol
+    if (reset) {
+        length = MAX(length, repairSymbol->packet_length);
+        memset(&repairSymbol->tlv, 0, sizeof(struct tlvRepair__block_t));
+        repairSymbol->packet_length = 0;
     }
 
+    // XOR computation, the source symbol is cleared for the next packet
+    xor_and_clear_symbol(repairSymbol->packet, sourceSymbol->packet, length, reset);
+
     // Also compute the XOR of the length of the packets that will be stored in the repair TLV
     struct tlvRepair__block_t *repair_tlv = (struct tlvRepair__block_t *)&repairSymbol->tlv;
     repair_tlv->payload_len ^= sourceSymbol->packet_length;
@@ -43,13 +47,8 @@ static __always_inline int fecScheme__blockXOR(struct __sk_buff *skb, fecBlock_t
     struct repairSymbol_t *repairSymbol = &mapStruct->repairSymbol;
     struct sourceSymbol_t *sourceSymbol = &mapStruct->sourceSymbol;
 
-    // Reset the repair symbol from previous block if this is new block
-    if (sourceSymbolCount == 0) {
-        memset(repairSymbol, 0, sizeof(struct repairSymbol_t));
-    }
-
-    // Perform XOR on the line
-    err = xor_on_the_line(skb, repairSymbol, sourceSymbol);
+    // Perform XOR on the line (resetting the repair symbol from previous block if this is new block)
+    err = xor_on_the_line(skb, repairSymbol, sourceSymbol, sourceSymbolCount == 0);
     if (err < 0) {
         // if (DEBUG) bpf_printk("Sender: error in coding on the line\n");
         return -1;
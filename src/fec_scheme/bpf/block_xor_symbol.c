@@ -0,0 +1,83 @@
+#ifndef BLOCK_XOR_SYMBOL_H_
+#define BLOCK_XOR_SYMBOL_H_
+
+#ifndef VMLINUX_H_
+#define VMLINUX_H_
+#include <linux/bpf.h>
+#endif
+
+#ifndef BPF_HELPERS_H_
+#define BPF_HELPERS_H_
+#include <bpf/bpf_helpers.h>
+#endif
+
+#include "../../fec_srv6.h"
+
+// Operations on the symbols of the block XOR scheme, bounded by the length of the symbols.
+// The loops must be unrolled for the verifier, so the length is rounded up to a size class
+// and each class has its own unrolled loop (32, 256, 2048 and 8192 iterations of 8 bytes).
+// The bytes of a symbol after its length must always be 0: the symbols are cleared after use
+#define XOR_SYMBOL_TINY_SIZE 256
+
+// XORs *size* bytes of *source* in *repair* (or copies them if *reset*) and clears *source*
+static __always_inline void xor_and_clear_words(__u64 *repair, __u64 *source, const __u32 size, int reset) {
+    if (reset) {
+        #pragma clang loop unroll(full)
+        for (int j = 0; j < size / sizeof(__u64); ++j) {
+            repair[j] = source[j];
+            source[j] = 0;
+        }
+    } else {
+        #pragma clang loop unroll(full)
+        for (int j = 0; j < size / sizeof(__u64); ++j) {
+            repair[j] ^= source[j];
+            source[j] = 0;
+        }
+    }
+}
+
+// Copies *size* bytes of *from* in *to* (only if *copy*) and clears *from*
+static __always_inline void move_words(__u64 *to, __u64 *from, const __u32 size, int copy) {
+    if (copy) {
+        #pragma clang loop unroll(full)
+        for (int j = 0; j < size / sizeof(__u64); ++j) {
+            to[j] = from[j];
+            from[j] = 0;
+        }
+    } else {
+        #pragma clang loop unroll(full)
+        for (int j = 0; j < size / sizeof(__u64); ++j) {
+            from[j] = 0;
+        }
+    }
+}
+
+// XORs the *length* first bytes of *source* in *repair* and clears *source* for the next symbol.
+// If *reset*, the previous content of *repair* is overwritten instead (*length* must then also cover it)
+static __always_inline void xor_and_clear_symbol(__u8 *repair, __u8 *source, __u32 length, int reset) {
+    if (length <= XOR_SYMBOL_TINY_SIZE) {
+        xor_and_clear_words((__u64 *)repair, (__u64 *)source, XOR_SYMBOL_TINY_SIZE, reset);
+    } else if (length <= SYMBOL_SMALL_SIZE) {
+        xor_and_clear_words((__u64 *)repair, (__u64 *)source, SYMBOL_SMALL_SIZE, reset);
+    } else if (length <= SYMBOL_MEDIUM_SIZE) {
+        xor_and_clear_words((__u64 *)repair, (__u64 *)source, SYMBOL_MEDIUM_SIZE, reset);
+    } else {
+        xor_and_clear_words((__u64 *)repair, (__u64 *)source, MAX_PACKET_SIZE, reset);
+    }
+}
+
+// Moves the *length* first bytes of *from* in *to* (only clears *from* if not *copy*).
+// *to* must already be cleared
+static __always_inline void move_symbol(__u8 *to, __u8 *from, __u32 length, int copy) {
+    if (length <= XOR_SYMBOL_TINY_SIZE) {
+        move_words((__u64 *)to, (__u64 *)from, XOR_SYMBOL_TINY_SIZE, copy);
+    } else if (length <= SYMBOL_SMALL_SIZE) {
+        move_words((__u64 *)to, (__u64 *)from, SYMBOL_SMALL_SIZE, copy);
+    } else if (length <= SYMBOL_MEDIUM_SIZE) {
+        move_words((__u64 *)to, (__u64 *)from, SYMBOL_MEDIUM_SIZE, copy);
+    } else {
+        move_words((__u64 *)to, (__u64 *)from, MAX_PACKET_SIZE, copy);
+    }
+}
+
+#endif
@@ -11,12 +11,140 @@
 #include "../../libseg6.c"
 #include "../../decoder.h"
 
+// Recovers the single losses of the windows of small symbols in the eBPF program, without the round trip through user space.
+// Set by user space before loading the program, it then fills gf256Tables and rlcCoefs
+const volatile __u8 kernel_recovery = 0;
+
+struct {
+    __uint(type, BPF_MAP_TYPE_ARRAY);
+    __uint(max_entries, 1);
+    __type(key, __u32);
+    __type(value, gf256_tables_t);
+} gf256Tables SEC(".maps");
+
+// Indexed by repairKey
+struct {
+    __uint(type, BPF_MAP_TYPE_ARRAY);
+    __uint(max_entries, RLC_KERNEL_COEFS_KEYS);
+    __type(key, __u32);
+    __type(value, rlc_coefs_t);
+} rlcCoefs SEC(".maps");
+
+// Recovers the only lost source symbol of the window of the repair symbol at *repairIndex* (of TLV *tlv*) as
+// (repair - sum(c_j * s_j)) * c^-1, in the small class of the source symbol pool as if it was received.
+// Only if the repair symbol has at most RLC_KERNEL_RECOVERY_SIZE bytes: all the symbols of the window are then in the small classes.
+// Returns 0 and the encodingSymbolID of the recovered symbol in *recoveredID*, or -1 to leave the window to user space
+static __always_inline int recover_single__convoRLC(fecConvolution_t *fecConvolution, window_info_t *window_info, struct tlvRepair__convo_t *tlv, __u8 repairIndex, void *source_small, void *repair_small, __u32 *recoveredID) {
+    __u8 windowSize = tlv->nss;
+    __u16 length = window_info->packet_length[repairIndex & (MAX_RLC_RS_NUMBER - 1)];
+    __u32 share = fecConvolution->share;
+    if (!kernel_recovery || windowSize == 0 || windowSize > MAX_RLC_WINDOW_SIZE || window_info->received_ss + 1 != windowSize ||
+            length == 0 || length > RLC_KERNEL_RECOVERY_SIZE) {
+        return -1;
+    }
+
+    __u32 k0 = 0;
+    __u32 repairKey = tlv->repairFecInfo & 0xffff;
+    __u32 repairSlot = SYMBOL_POOL_INDEX(RLC_REPAIR_SYMBOL_ID(tlv->encodingSymbolID, repairIndex), RLC_RECEIVER_REPAIR_SLOTS, share);
+    gf256_tables_t *gf = bpf_map_lookup_elem(&gf256Tables, &k0);
+    rlc_coefs_t *coefs = bpf_map_lookup_elem(&rlcCoefs, &repairKey);
+    symbol_small_t *repair = bpf_map_lookup_elem(repair_small, &repairSlot);
+    if (!gf || !coefs || !repair || repair->packet_length != length) {
+        return -1;
+    }
+
+    // The coefficients are never 0
+    __u32 firstID = ESI_SUB(tlv->encodingSymbolID, windowSize - 1);
+    __u32 lostID = 0;
+    __u8 lostCoef = 0;
+    for (__u8 j = 0; j < MAX_RLC_WINDOW_SIZE && j < windowSize; ++j) {
+        __u32 sourceID = ESI_ADD(firstID, j);
+        struct tlvSource__convo_t *tlv_ss = &fecConvolution->sourceTlvBuffer[sourceID % RLC_RECEIVER_BUFFER_SIZE];
+        if (tlv_ss->encodingSymbolID != sourceID || tlv_ss->tlv_type == 0) {
+            lostID = sourceID;
+            lostCoef = coefs->coefs[j];
+            break;
+        }
+    }
+    if (lostCoef == 0) {
+        return -1;
+    }
+
+    __u32 lostSlot = SYMBOL_POOL_INDEX(lostID, RLC_RECEIVER_BUFFER_SIZE, share);
+    symbol_small_t *recovered = bpf_map_lookup_elem(source_small, &lostSlot);
+    if (!recovered) {
+        return -1;
+    }
+    // Unused for user space until the symbol is complete
+    recovered->encodingSymbolID = lostID;
+    recovered->packet_length = 0;
+
+    for (__u32 i = 0; i < RLC_KERNEL_RECOVERY_SIZE && i < length; ++i) {
+        recovered->packet[i] = repair->packet[i];
+    }
+    __u16 recoveredLength = tlv->coded_payload_len;
+    for (__u8 j = 0; j < MAX_RLC_WINDOW_SIZE && j < windowSize; ++j) {
+        __u32 sourceID = ESI_ADD(firstID, j);
+        if (sourceID == lostID) {
+            continue;
+        }
+        __u32 sourceSlot = SYMBOL_POOL_INDEX(sourceID, RLC_RECEIVER_BUFFER_SIZE, share);
+        symbol_small_t *source = bpf_map_lookup_elem(source_small, &sourceSlot);
+        if (!source || source->encodingSymbolID != sourceID || source->packet_length > length) {
+            return -1;
+        }
+        __u32 coef = coefs->coefs[j & (MAX_RLC_WINDOW_SIZE - 1)];
+        __u16 sourceLength = source->packet_length;
+        // The length is coded byte per byte, as the payload
+        recoveredLength ^= gf->mul[(coef << 8) | (sourceLength & 0xff)] | (gf->mul[(coef << 8) | (sourceLength >> 8)] << 8);
+        for (__u32 i = 0; i < RLC_KERNEL_RECOVERY_SIZE && i < sourceLength; ++i) {
+            recovered->packet[i] ^= gf->mul[(coef << 8) | source->packet[i]];
+        }
+    }
+
+    __u32 inv = gf->inv[lostCoef];
+    for (__u32 i = 0; i < RLC_KERNEL_RECOVERY_SIZE && i < length; ++i) {
+        recovered->packet[i] = gf->mul[(inv << 8) | recovered->packet[i]];
+    }
+    recoveredLength = gf->mul[(inv << 8) | (recoveredLength & 0xff)] | (gf->mul[(inv << 8) | (recoveredLength >> 8)] << 8);
+    if (recoveredLength == 0 || recoveredLength > length) {
+        return -1;
+    }
+    recovered->packet_length = recoveredLength;
+
+    // Received for the next repair symbols of the context
+    struct tlvSource__convo_t *tlv_lost = &fecConvolution->sourceTlvBuffer[lostID % RLC_RECEIVER_BUFFER_SIZE];
+    tlv_lost->tlv_type = TLV_CODING_SOURCE;
+    tlv_lost->encodingSymbolID = lostID;
+    *recoveredID = lostID;
+    return 0;
+}
+
 static __always_inline int try_to_recover_from_repair__convoRLC(struct __sk_buff *skb, fecConvolution_t *fecConvolution, window_info_t *window_info, struct tlvRepair__convo_t *tlv) {
     // Analyze if we can recover from a lost packet
     // If we can, send the window alongside with the repair symbol(s) to user space
-    if (1 || window_info->received_ss < tlv->nss && window_info->received_rs > 0) {
-        // TODO: improve by not sending the entire structure !
-        return 1;
+    // No lost source symbol in the window: this repair symbol cannot help user space
+    if (window_info->received_ss >= tlv->nss || window_info->received_rs == 0) {
+        return 0;
     }
-    return 0;
+    __u8 lost = tlv->nss - window_info->received_ss;
+
+    // User space combines the repair symbols of up to MAX_WINDOW_CHECK consecutive windows:
+    // there must be at least as many repair symbols as lost source symbols
+    __u8 windowSlide = (tlv->repairFecInfo >> 16) & 0xf;
+    __u32 encodingSymbolID = tlv->encodingSymbolID;
+    __u8 repairs = 0;
+    for (__u8 i = 0; i < MAX_WINDOW_CHECK; ++i) {
+        window_info_t *previous = &fecConvolution->windowInfoBuffer[(encodingSymbolID % RLC_RECEIVER_BUFFER_SIZE) & (RLC_RECEIVER_BUFFER_SIZE - 1)];
+        if (previous->encodingSymbolID != encodingSymbolID || previous->received_rs == 0) {
+            break; // Gap in the repair symbols, user space also stops here
+        }
+        repairs += previous->received_rs;
+        if (windowSlide == 0) {
+            break;
+        }
+        encodingSymbolID = ESI_SUB(encodingSymbolID, windowSlide);
+    }
+
+    return lost <= repairs;
 }
\ No newline at end of file
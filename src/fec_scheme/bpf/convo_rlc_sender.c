@@ -11,29 +11,51 @@
 #include "../../libseg6.c"
 #include "../../encoder.bpf.h"
 
-static __always_inline int fecScheme__convoRLC(struct __sk_buff *skb, fecConvolution_t *fecConvolution, __u8 newRingBuffSize, __u32 encodingSymbolID) {
-    int err;
+// Starts to complete the TLVs of the repair symbols of the window of *nss* source symbols ending with *encodingSymbolID*
+// (the remaining will be done in US) and moves the repair key seed after them
+static __always_inline void fecScheme__convoRLC_repairTlvs(fecConvolution_t *fecConvolution, __u8 nss, __u32 encodingSymbolID) {
     __u16 repairKey = fecConvolution->repairKey;
+    __u8 windowSlide = fecConvolution->currentWindowSlide;
+    __u8 repairSymbols = fecConvolution->repairSymbols;
+
+    for (int i = 0; i < MAX_RLC_RS_NUMBER && i < repairSymbols; ++i) {
+        ++repairKey;
+        struct tlvRepair__convo_t *repairTlv = (struct tlvRepair__convo_t *)&fecConvolution->repairTlv[i];
+        repairTlv->tlv_type = TLV_CODING_REPAIR;
+        repairTlv->len = sizeof(struct tlvRepair__convo_t) - 2;
+        repairTlv->controller_update = fecConvolution->controller_period;
+        repairTlv->encodingSymbolID = encodingSymbolID; // Set to the value of the last source symbol of the window
+        repairTlv->repairFecInfo = (15 << (16 + 8)) + (i << 20) + (windowSlide << 16) + repairKey;
+        repairTlv->nss = nss;
+        repairTlv->nrs = repairSymbols;
+    }
+    fecConvolution->repairKey = repairKey; // Increment the repair key seed
+    fecConvolution->first_unprotected = 0; // All the source symbols of the window are now protected
+}
+
+static __always_inline int fecScheme__convoRLC(struct __sk_buff *skb, fecConvolution_t *fecConvolution, __u8 newRingBuffSize, __u32 encodingSymbolID) {
     __u8 windowSize = fecConvolution->currentWindowSize;
     __u8 windowSlide = fecConvolution->currentWindowSlide;
 
     // Compute the repair symbol if needed 
-    if (newRingBuffSize == windowSize) {
-        for (int i = 0; i < RLC_RS_NUMBER; ++i) {
-            ++repairKey;
-            // Start to complete the TLV for the repair symbol. The remaining will be done in US 
-            struct tlvRepair__convo_t *repairTlv = (struct tlvRepair__convo_t *)&fecConvolution->repairTlv[i];
-            repairTlv->tlv_type = TLV_CODING_REPAIR;
-            repairTlv->len = sizeof(struct tlvRepair__convo_t) - 2;
-            repairTlv->controller_update = fecConvolution->controller_period;
-            repairTlv->encodingSymbolID = encodingSymbolID; // Set to the value of the last source symbol of the window
-            repairTlv->repairFecInfo = (15 << (16 + 8)) + (windowSlide << 16) + repairKey;
-            repairTlv->nss = windowSize;
-            repairTlv->nrs = RLC_RS_NUMBER;
-        }
+    if (newRingBuffSize >= windowSize) {
+        fecScheme__convoRLC_repairTlvs(fecConvolution, windowSize, encodingSymbolID);
         // Reset parameters for the next window 
-        fecConvolution->ringBuffSize = newRingBuffSize - windowSlide; // For next window, already some symbols
-        fecConvolution->repairKey = repairKey; // Increment the repair key seed
+        fecConvolution->ringBuffSize = windowSize - windowSlide; // For next window, already some symbols
+
+        // The controller changed the parameters: the next window starts with the new ones.
+        // It cannot contain more symbols than those already sent
+        __u8 nextWindowSize = fecConvolution->nextWindowSize;
+        __u8 nextWindowSlide = fecConvolution->nextWindowSlide;
+        if (nextWindowSize > 0 && nextWindowSlide > 0 && nextWindowSlide <= nextWindowSize) {
+            fecConvolution->currentWindowSize = nextWindowSize;
+            fecConvolution->currentWindowSlide = nextWindowSlide;
+            fecConvolution->repairSymbols = fecConvolution->nextRepairSymbols;
+            fecConvolution->nextWindowSize = 0;
+            if (nextWindowSize - nextWindowSlide < windowSize) {
+                fecConvolution->ringBuffSize = nextWindowSize - nextWindowSlide;
+            }
+        }
 
         // Indicate to the FEC Framework that a repair symbol has been generated 
         return 1;
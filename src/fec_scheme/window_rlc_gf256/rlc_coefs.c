@@ -0,0 +1,47 @@
+#ifndef RLC_COEFS_H_
+#define RLC_COEFS_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "../../prng/tinymt32.c"
+#include "../../fec_srv6.h"
+
+// Coefficients of the RLC repair symbols, shared by the encoder and the decoder.
+// The coefficients of a window of n symbols are the n first values generated from the repairKey of the repair symbol,
+// so one row of MAX_RLC_WINDOW_SIZE coefficients per repairKey (16 bits) covers every window size.
+// The table is computed once at startup (1 MiB) and is then only read, also by the workers
+#define RLC_COEFS_KEYS (1 << 16)
+
+static uint8_t rlc_coefs_table[RLC_COEFS_KEYS][MAX_RLC_WINDOW_SIZE];
+static bool rlc_coefs_ready = false;
+
+static void rlc__get_coefs(tinymt32_t *prng, uint32_t seed, int n, uint8_t coefs[n]) {
+    tinymt32_init(prng, seed);
+    int i;
+    for (i = 0 ; i < n ; i++) {
+        coefs[i] = (uint8_t) tinymt32_generate_uint32(prng);
+        if (coefs[i] == 0)
+            coefs[i] = 1;
+    }
+}
+
+// Fills the table if it is not already done. Must be called before the workers are started
+static void rlc_coefs__init() {
+    if (rlc_coefs_ready) return;
+    tinymt32_t prng;
+    prng.mat1 = 0x8f7011ee;
+    prng.mat2 = 0xfc78ff1f;
+    prng.tmat = 0x3793fdff;
+    for (uint32_t repairKey = 0; repairKey < RLC_COEFS_KEYS; ++repairKey) {
+        rlc__get_coefs(&prng, repairKey, MAX_RLC_WINDOW_SIZE, rlc_coefs_table[repairKey]);
+    }
+    rlc_coefs_ready = true;
+}
+
+// Returns the coefficients of the source symbols of the window (in order) for the repair symbol of *repairKey*.
+// Only the first windowSize values are used
+static inline const uint8_t *rlc_coefs__get(uint16_t repairKey) {
+    return rlc_coefs_table[repairKey];
+}
+
+#endif
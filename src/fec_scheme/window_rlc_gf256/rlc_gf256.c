@@ -1,95 +1,234 @@
 #include <stdint.h>
-#include "../../prng/tinymt32.c"
+#include "rlc_coefs.c"
 #include "../../gf256/swif_symbol.c"
+#include "../../symbol_pool/symbol_pool.c"
 #include "../../encoder.h"
 #include "../../raw_socket/raw_socket_sender.h"
 #define MIN(a, b) ((a < b) ? a : b)
+#define MAX(a, b) ((a > b) ? a : b)
 
-static void rlc__get_coefs(tinymt32_t *prng, uint32_t seed, int n, uint8_t coefs[n]) {
-    tinymt32_init(prng, seed);
-    int i;
-    for (i = 0 ; i < n ; i++) {
-        coefs[i] = (uint8_t) tinymt32_generate_uint32(prng);
-        if (coefs[i] == 0)
-            coefs[i] = 1;
+// Returns true if the kernel did not overwrite a source symbol of the window
+static bool rlc__window_is_valid(encode_rlc_t *rlc, uint32_t encodingSymbolID, uint8_t windowSize) {
+    for (uint8_t i = 0; i < windowSize; ++i) {
+        if (!symbol_pool__get(&rlc->sourcePool, ESI_STREAM(encodingSymbolID), ESI_ADD(encodingSymbolID, i + 1 - windowSize))) return false;
     }
+    return true;
 }
 
-static int rlc__generate_a_repair_symbol(fecConvolution_user_t *fecConvolution, encode_rlc_t *rlc, int idx) {
+// Generates the *nrs* repair symbols of the window in rlc->repairSymbols with a single pass on the source symbols.
+// The window is processed by tiles of SYMBOL_TILE_SIZE bytes: the tile of each source symbol is read once
+// from memory and added to the tiles of all the repair symbols, which stay in the L1 cache
+static int rlc__generate_window_repair_symbols(fecConvolution_user_t *fecConvolution, encode_rlc_t *rlc, uint8_t nrs) {
+    uint8_t windowSize = fecConvolution->repairTlv[0].nss; // Smaller than the window size if the window was flushed
+    uint32_t encodingSymbolID = fecConvolution->repairTlv[0].encodingSymbolID; // Last source symbol of the window
+    symbol_slot_t *sourceSymbols[MAX_RLC_WINDOW_SIZE];
+    uint8_t coefs[MAX_RLC_WINDOW_SIZE][MAX_RLC_RS_NUMBER]; // Coefficients of each source symbol for each repair symbol
+    uint8_t *packets[MAX_RLC_RS_NUMBER];
+    uint8_t *tiles[MAX_RLC_RS_NUMBER];
+    uint16_t coded_lengths[MAX_RLC_RS_NUMBER];
     uint16_t max_length = 0;
-    uint32_t encodingSymbolID = fecConvolution->encodingSymbolID - 1;
-    struct repairSymbol_t *repairSymbol = rlc->repairSymbol;
-    memset(repairSymbol, 0, sizeof(struct repairSymbol_t));
-    uint8_t windowSize = fecConvolution->currentWindowSize;
-    struct tlvRepair__convo_t *tlv = (struct tlvRepair__convo_t *)&fecConvolution->repairTlv[idx];
-    uint16_t repairKey = tlv->repairFecInfo & 0xffff;
-
-    tinymt32_t prng;
-    prng.mat1 = 0x8f7011ee;
-    prng.mat2 = 0xfc78ff1f;
-    prng.tmat = 0x3793fdff;
 
-    uint8_t *coefs = malloc(sizeof(uint8_t) * windowSize);
-    if (!coefs) return -1;
+    if (windowSize == 0 || windowSize > MAX_RLC_WINDOW_SIZE) return -1;
 
-    rlc__get_coefs(&prng, repairKey, windowSize, coefs);
+    for (uint8_t r = 0; r < nrs; ++r) {
+        const uint8_t *repair_coefs = rlc_coefs__get(fecConvolution->repairTlv[r].repairFecInfo & 0xffff);
+        for (uint8_t i = 0; i < windowSize; ++i) {
+            coefs[i][r] = repair_coefs[i];
+        }
+        packets[r] = rlc->repairSymbols[r]->packet;
+        coded_lengths[r] = 0;
+    }
 
     for (uint8_t i = 0; i < windowSize; ++i) {
-        // Get the source symbol in order in the window
-        uint8_t sourceBufferIndex = (encodingSymbolID - windowSize + i + 1) % windowSize;
-        struct sourceSymbol_t *sourceSymbol = &fecConvolution->sourceRingBuffer[sourceBufferIndex];
+        /* Get the source symbol in order in the window */
+        sourceSymbols[i] = symbol_pool__get(&rlc->sourcePool, ESI_STREAM(encodingSymbolID), ESI_ADD(encodingSymbolID, i + 1 - windowSize));
+        if (!sourceSymbols[i]) { // The kernel already reused a slot of the window
+            return -1;
+        }
+        uint16_t packet_length = sourceSymbols[i]->packet_length;
 
         // Compute the maximum length of the source symbols
-        max_length = sourceSymbol->packet_length > max_length ? sourceSymbol->packet_length : max_length;
+        max_length = packet_length > max_length ? packet_length : max_length;
+
+        // Encode the length of the source symbol
+        for (uint8_t r = 0; r < nrs; ++r) {
+            symbol_add_scaled(&coded_lengths[r], coefs[i][r], &packet_length, sizeof(uint16_t), rlc->muls);
+        }
     }
 
-    uint16_t coded_length = 0;
+    // Only the bytes up to the maximum length are sent
+    for (uint8_t r = 0; r < nrs; ++r) {
+        memset(packets[r], 0, max_length);
+    }
+
+    // Encode the source symbols in the packets
+    for (uint32_t offset = 0; offset < max_length; offset += SYMBOL_TILE_SIZE) {
+        for (uint8_t r = 0; r < nrs; ++r) {
+            tiles[r] = packets[r] + offset;
+        }
+        for (uint8_t i = 0; i < windowSize; ++i) {
+            uint16_t packet_length = sourceSymbols[i]->packet_length;
+            if (packet_length <= offset) continue;
+            uint32_t tile_length = MIN(packet_length - offset, SYMBOL_TILE_SIZE);
+            symbol_add_scaled_multi(tiles, coefs[i], nrs, sourceSymbols[i]->packet + offset, tile_length, rlc->muls);
+        }
+    }
+
+    for (uint8_t r = 0; r < nrs; ++r) {
+        struct repairSymbol_t *repairSymbol = rlc->repairSymbols[r];
+
+        // Now add and complete the TLV
+        memcpy(&repairSymbol->tlv, &fecConvolution->repairTlv[r], sizeof(struct tlvRepair__convo_t));
+
+        // Also add the remaining parameter
+        struct tlvRepair__convo_t *tlv_rs = (struct tlvRepair__convo_t *)&repairSymbol->tlv;
+        tlv_rs->coded_payload_len = coded_lengths[r]; // Get the coded length here
+
+        // And finally the length of the repair symbol is the maximum length instead of the coded length
+        repairSymbol->packet_length = max_length;
+    }
+
+    // The source symbols are read in place from the mmapped maps: the kernel may have
+    // reused a slot of the window while we were coding, the repair symbols are then corrupted
+    if (!rlc__window_is_valid(rlc, encodingSymbolID, windowSize)) {
+        return -1;
+    }
 
-    for (uint8_t i = 0; i < windowSize; ++i) {
-        /* Get the source symbol in order in the window */
-        uint8_t sourceBufferIndex = (encodingSymbolID - windowSize + i + 1) % windowSize;
-        struct sourceSymbol_t *sourceSymbol = &fecConvolution->sourceRingBuffer[sourceBufferIndex];
-        
-        // Encode the source symbol in the packet
-        symbol_add_scaled(repairSymbol->packet, coefs[i], sourceSymbol->packet, sourceSymbol->packet_length, rlc->muls);
-        symbol_add_scaled(&coded_length, coefs[i], &sourceSymbol->packet_length, sizeof(uint16_t), rlc->muls);
-    }
-
-    //printf("Encoding symbol ID: %x\n", encodingSymbolID);
-    /*printf("Packet 1:\n");
-    for (int i = 0; i < MAX_PACKET_SIZE; ++i) {
-        uint8_t sourceBufferIndex = (encodingSymbolID - windowSize + 0 + 1) % windowSize;
-        printf("%x ", fecConvolution->sourceRingBuffer[sourceBufferIndex].packet[i]);
-    }
-    printf("\nSecond\n");
-    for (int i = 0; i < MAX_PACKET_SIZE; ++i) {
-        uint8_t sourceBufferIndex = (encodingSymbolID - windowSize + 1 + 1) % windowSize;
-        printf("%x ", fecConvolution->sourceRingBuffer[sourceBufferIndex].packet[i]);
-    }
-    printf("\n");*/
-    
-    // Now add and complete the TLV
-    memcpy(&repairSymbol->tlv, tlv, sizeof(struct tlvRepair__convo_t));
-
-    // Also add the remaining parameter
-    struct tlvRepair__convo_t *tlv_rs = (struct tlvRepair__convo_t *)&repairSymbol->tlv;
-    tlv_rs->coded_payload_len = coded_length; // Get the coded length here
-
-    // And finally the length of the repair symbol is the maximum length instead of the coded length
-    repairSymbol->packet_length = max_length;
-
-    free(coefs);
-    
     return 0;
 }
 
+// Returns the pending window of the stream of *encodingSymbolID* ending with this symbol, (re)initialized if it
+// was used by another window. Returns NULL if the memory cannot be allocated
+static rlc_pending_window_t *rlc__pending_window(encode_rlc_t *rlc, uint32_t encodingSymbolID, uint16_t repairKey, uint8_t windowSize, uint8_t nrs) {
+    uint32_t stream = ESI_STREAM(encodingSymbolID);
+    if (!rlc->pending[stream]) {
+        rlc->pending[stream] = calloc(RLC_PENDING_WINDOWS, sizeof(rlc_pending_window_t));
+        if (!rlc->pending[stream]) return NULL;
+    }
+    rlc_pending_window_t *window = &rlc->pending[stream][encodingSymbolID % RLC_PENDING_WINDOWS];
+    if (window->folded > 0 && window->encodingSymbolID == encodingSymbolID && window->repairKey == repairKey &&
+            window->windowSize == windowSize && window->repairSymbols == nrs) {
+        return window;
+    }
+
+    // Only the bytes up to the maximum length of the previous window are dirty
+    for (uint8_t r = 0; r < MAX_RLC_RS_NUMBER; ++r) {
+        if (r < nrs && !window->packets[r]) {
+            window->packets[r] = calloc(1, MAX_PACKET_SIZE);
+            if (!window->packets[r]) return NULL;
+        } else if (window->packets[r]) {
+            memset(window->packets[r], 0, window->max_length);
+        }
+    }
+    window->encodingSymbolID = encodingSymbolID;
+    window->repairKey = repairKey;
+    window->windowSize = windowSize;
+    window->repairSymbols = nrs;
+    window->folded = 0;
+    window->valid = 1;
+    window->max_length = 0;
+    memset(window->coded_lengths, 0, sizeof(window->coded_lengths));
+
+    // The coefficients are gathered once for the whole window
+    for (uint8_t r = 0; r < nrs; ++r) {
+        const uint8_t *repair_coefs = rlc_coefs__get(repairKey + r);
+        for (uint8_t i = 0; i < windowSize; ++i) {
+            window->coefs[i][r] = repair_coefs[i];
+        }
+    }
+    return window;
+}
+
+// Incremental encoding: adds the source symbol of *notification* to the repair symbols of all the windows containing it.
+// The current window ends windowSize - ringBuffSize symbols later, and each next one windowSlide symbols later
+void rlc__fold_source_symbol(encode_rlc_t *rlc, source_notification_t *notification) {
+    uint32_t encodingSymbolID = notification->encodingSymbolID;
+    uint8_t windowSize = notification->windowSize;
+    uint8_t windowSlide = notification->windowSlide;
+    uint8_t nrs = MIN(notification->repairSymbols, MAX_RLC_RS_NUMBER);
+    if (!rlc->pending || windowSize == 0 || windowSize > MAX_RLC_WINDOW_SIZE || windowSlide == 0 || nrs == 0 ||
+            notification->ringBuffSize == 0 || notification->ringBuffSize > windowSize) {
+        return;
+    }
+
+    symbol_slot_t *sourceSymbol = symbol_pool__get(&rlc->sourcePool, ESI_STREAM(encodingSymbolID), encodingSymbolID);
+    if (!sourceSymbol) return;
+    uint16_t packet_length = sourceSymbol->packet_length;
+
+    rlc_pending_window_t *windows[RLC_PENDING_WINDOWS];
+    uint8_t nb_windows = 0;
+    uint16_t repairKey = notification->repairKey + 1; // Incremented before each repair symbol by the kernel
+    for (uint8_t distance = windowSize - notification->ringBuffSize; distance < windowSize; distance += windowSlide) {
+        rlc_pending_window_t *window = rlc__pending_window(rlc, ESI_ADD(encodingSymbolID, distance), repairKey, windowSize, nrs);
+        repairKey += nrs;
+        if (!window) continue;
+        uint8_t *coefs = window->coefs[windowSize - 1 - distance];
+        symbol_add_scaled_multi(window->packets, coefs, nrs, sourceSymbol->packet, packet_length, rlc->muls);
+        for (uint8_t r = 0; r < nrs; ++r) {
+            symbol_add_scaled(&window->coded_lengths[r], coefs[r], &packet_length, sizeof(uint16_t), rlc->muls);
+        }
+        window->max_length = MAX(window->max_length, packet_length);
+        ++window->folded;
+        windows[nb_windows++] = window;
+    }
+
+    // The symbol is read in place: the windows are lost if the kernel reused its slot in the meantime
+    if (symbol_pool__get(&rlc->sourcePool, ESI_STREAM(encodingSymbolID), encodingSymbolID) != sourceSymbol || sourceSymbol->packet_length != packet_length) {
+        for (uint8_t i = 0; i < nb_windows; ++i) {
+            windows[i]->valid = 0;
+        }
+    }
+}
+
+// Incremental encoding: moves the repair symbols of the window of *fecConvolution* in rlc->repairSymbols
+// if all its source symbols were folded. Returns false if they must be computed from the source symbols
+static bool rlc__take_pending_window(fecConvolution_user_t *fecConvolution, encode_rlc_t *rlc, uint8_t nrs) {
+    uint32_t encodingSymbolID = fecConvolution->repairTlv[0].encodingSymbolID; // Last source symbol of the window
+    if (!rlc->pending || !rlc->pending[ESI_STREAM(encodingSymbolID)]) {
+        return false;
+    }
+    rlc_pending_window_t *window = &rlc->pending[ESI_STREAM(encodingSymbolID)][encodingSymbolID % RLC_PENDING_WINDOWS];
+    uint8_t windowSize = fecConvolution->repairTlv[0].nss;
+    bool complete = window->folded == windowSize && window->valid &&
+                    window->encodingSymbolID == encodingSymbolID && window->windowSize == windowSize &&
+                    window->repairSymbols == nrs;
+    // The symbols of the window may have been notified with a stale repair key (concurrent CPUs)
+    for (uint8_t r = 0; r < nrs && complete; ++r) {
+        complete = (uint16_t)(window->repairKey + r) == (fecConvolution->repairTlv[r].repairFecInfo & 0xffff);
+    }
+    if (!complete) {
+        return false;
+    }
+
+    for (uint8_t r = 0; r < nrs; ++r) {
+        struct repairSymbol_t *repairSymbol = rlc->repairSymbols[r];
+        memcpy(repairSymbol->packet, window->packets[r], window->max_length);
+        memcpy(&repairSymbol->tlv, &fecConvolution->repairTlv[r], sizeof(struct tlvRepair__convo_t));
+        struct tlvRepair__convo_t *tlv_rs = (struct tlvRepair__convo_t *)&repairSymbol->tlv;
+        tlv_rs->coded_payload_len = window->coded_lengths[r];
+        repairSymbol->packet_length = window->max_length;
+    }
+    window->folded = 0; // Closed: the entry is reinitialized by the next window using it
+    return true;
+}
+
 int rlc__generate_repair_symbols(fecConvolution_user_t *fecConvolution, encode_rlc_t *rlc, int sfd, struct sockaddr_in6 *src, struct sockaddr_in6 *dst) {
     int err;
-    for (int i = 0; i < RLC_RS_NUMBER; ++i) {
-        // Generate repair symbol #i
-        rlc__generate_a_repair_symbol(fecConvolution, rlc, i);
-        struct repairSymbol_t *repairSymbol = rlc->repairSymbol;
-        err = send_raw_socket(sfd, repairSymbol, *src, *dst);
+    uint8_t nrs = MIN(fecConvolution->repairSymbols, MAX_RLC_RS_NUMBER);
+    // The repair symbols are already computed if the source symbols of the window were folded as they arrived
+    if (!rlc__take_pending_window(fecConvolution, rlc, nrs)) {
+        err = rlc__generate_window_repair_symbols(fecConvolution, rlc, nrs);
+        if (err < 0) {
+            return 0;
+        }
+    }
+    for (int i = 0; i < nrs; ++i) {
+        struct repairSymbol_t *repairSymbol = rlc->repairSymbols[i];
+        if (rlc->batch) {
+            err = queue_raw_socket(rlc->batch, repairSymbol, *src, *dst);
+        } else {
+            err = send_raw_socket(sfd, repairSymbol, *src, *dst);
+        }
         if (err < 0) {
             perror("Cannot send repair symbol");
         }
@@ -101,6 +240,9 @@ encode_rlc_t *initialize_rlc() {
     encode_rlc_t *my_rlc = malloc(sizeof(encode_rlc_t));
     if (!my_rlc) return NULL;
 
+    // Shared by all the structures, only computed by the first one
+    rlc_coefs__init();
+
     // Create and fill in the products
     uint8_t *muls = malloc(256 * 256 * sizeof(uint8_t));
     if (!muls) {
@@ -114,21 +256,56 @@ encode_rlc_t *initialize_rlc() {
     }
     my_rlc->muls = muls;
 
-    // Create and set the repair symbol
-    struct repairSymbol_t *repairSymbol = malloc(sizeof(struct repairSymbol_t));
-    if (!repairSymbol) {
-        free(muls);
-        free(my_rlc);
-        return NULL;
+    // Create and set the repair symbols of a window
+    for (int i = 0; i < MAX_RLC_RS_NUMBER; ++i) {
+        struct repairSymbol_t *repairSymbol = malloc(sizeof(struct repairSymbol_t));
+        if (!repairSymbol) {
+            for (int j = 0; j < i; ++j) free(my_rlc->repairSymbols[j]);
+            free(muls);
+            free(my_rlc);
+            return NULL;
+        }
+        memset(repairSymbol, 0, sizeof(struct repairSymbol_t));
+        my_rlc->repairSymbols[i] = repairSymbol;
     }
-    memset(repairSymbol, 0, sizeof(struct repairSymbol_t));
-    my_rlc->repairSymbol = repairSymbol;
+
+    // Set when the sourceSymbolPool maps are mmapped
+    memset(&my_rlc->sourcePool, 0, sizeof(symbol_pool_t));
+
+    // Set by the caller to batch the repair symbols
+    my_rlc->batch = NULL;
+
+    // Set by the caller to encode incrementally
+    my_rlc->pending = NULL;
 
     return my_rlc;
 }
 
+// Enables the incremental encoding: the source symbols notified to rlc__fold_source_symbol() are added to the
+// repair symbols of their windows as they arrive. The memory of a stream is allocated on its first symbol
+int rlc__enable_incremental(encode_rlc_t *rlc) {
+    rlc->pending = calloc(MAX_ENCODER_STREAMS, sizeof(rlc_pending_window_t *));
+    return rlc->pending ? 0 : -1;
+}
+
 void free_rlc(encode_rlc_t *rlc) {
+    if (rlc->pending) {
+        for (uint32_t stream = 0; stream < MAX_ENCODER_STREAMS; ++stream) {
+            if (!rlc->pending[stream]) continue;
+            for (int i = 0; i < RLC_PENDING_WINDOWS; ++i) {
+                for (int r = 0; r < MAX_RLC_RS_NUMBER; ++r) {
+                    free(rlc->pending[stream][i].packets[r]);
+                }
+            }
+            free(rlc->pending[stream]);
+        }
+        free(rlc->pending);
+    }
+    raw_socket_batch__free(rlc->batch);
+    symbol_pool__munmap(&rlc->sourcePool);
     free(rlc->muls);
-    free(rlc->repairSymbol);
+    for (int i = 0; i < MAX_RLC_RS_NUMBER; ++i) {
+        free(rlc->repairSymbols[i]);
+    }
     free(rlc);
 }
\ No newline at end of file
@@ -1,13 +1,50 @@
 #include <stdint.h>
-#include "../../prng/tinymt32.c"
+#include "rlc_coefs.c"
 #include "../../gf256/swif_symbol.c"
 #include "../../decoder.h"
+#include "../../symbol_pool/symbol_pool.c"
 #include "../../raw_socket/raw_socket_receiver.h"
 
 #define MIN(a, b) ((a < b) ? a : b)
 #define MAX(a, b) ((a > b) ? a : b)
-#define MAX_WINDOW_CHECK 5
 #define LOOP for(int ____i = 0; ____i < 1000; ____i++) {}
+#define DECODING_SIZE (MAX_PACKET_SIZE + sizeof(uint16_t)) // Decoding the packet + packet length
+#define MAX_DECODED_SOURCES RLC_RECEIVER_BUFFER_SIZE // The source symbols of the equations must fit in the ring buffers
+#define MAX_SYSTEM_EQUATIONS (2 * MAX_DECODED_SOURCES) // Repair symbols referenced by the rows of a system
+#define SYSTEM_NEW_ROW MAX_DECODED_SOURCES // Row of an equation being inserted in a system
+
+// Repair symbol used as an equation of the system of a decoding context. Its payload stays in the repair pool
+struct rlc_equation {
+    uint32_t repair_id; // RLC_REPAIR_SYMBOL_ID of the repair symbol
+    uint32_t first_id; // encodingSymbolID of the first source symbol of its window
+    uint16_t repairKey;
+    uint16_t packet_length;
+    uint16_t coded_payload_len;
+    uint8_t window_size;
+    bool used;
+};
+
+// System of a decoding context, kept reduced (Gauss-Jordan) from one recovery to the next.
+// The columns are the lost source symbols of the windows of the equations and the row of a column has its pivot in this column.
+// Row u is the linear combination combinations[u] of the equations: only these small matrices are updated when a repair symbol
+// arrives, the symbols are combined once a lost source symbol is solved (see rlc__combine_symbols)
+struct rlc_decode_system {
+    struct rlc_equation equations[MAX_SYSTEM_EQUATIONS];
+    uint32_t unknown_ids[MAX_DECODED_SOURCES]; // encodingSymbolID of the lost source symbol of each used column
+    bool unknown_used[MAX_DECODED_SOURCES];
+    bool has_pivot[MAX_DECODED_SOURCES]; // The row of the column is used
+    uint8_t coefs[MAX_DECODED_SOURCES + 1][MAX_DECODED_SOURCES];
+    uint8_t combinations[MAX_DECODED_SOURCES + 1][MAX_SYSTEM_EQUATIONS];
+    uint32_t latest_id; // Last source symbol of the most recent window, the equations and columns retire behind it
+    bool started;
+    uint32_t dropped_equations; // Repair symbols not added because the system was full. Only the first one is reported
+};
+
+// Memory used by rlc__fec_recover, allocated once and reused for every recovery
+struct rlc_decode_arena {
+    uint8_t unknown_buffers[MAX_DECODED_SOURCES][DECODING_SIZE];
+    recoveredSource_t *spare_recovered; // Replaces the entry of recoveredSources overwritten by a new recovered symbol
+};
 
 // This file is strongly inspired from the FEC plugin of PQUIC: https://github.com/p-quic/pquic/blob/master/plugins/fec/fec_scheme_protoops/rlc_fec_scheme_gf256.c
 
@@ -19,446 +56,481 @@ void print_recovered(recoveredSource_t *recoveredPacket) {
     printf("\n");
 }
 
-void swap(uint8_t **a, int i, int j) {
-    uint8_t *tmp = a[j];
-    a[j] = a[i];
-    a[i] = tmp;
+// Returns the payload of the source symbol *id* of the context if it was received or recovered, and its length.
+// A received symbol is read in the mmapped pool: *slot* is then set to check it again after using it
+static const uint8_t *rlc__source_symbol(fecConvolution_t *fecConvolution, decode_rlc_t *rlc, recoveredSource_t **recoveredSources, uint32_t id, uint16_t *length, symbol_slot_t **slot) {
+    uint32_t idx = id % RLC_RECEIVER_BUFFER_SIZE;
+    struct tlvSource__convo_t *tlv = &fecConvolution->sourceTlvBuffer[idx];
+    *slot = NULL;
+    if (tlv->encodingSymbolID == id && tlv->tlv_type != 0) {
+        *slot = symbol_pool__get(&rlc->sourcePool, fecConvolution->share, id);
+    }
+    if (*slot) {
+        *length = (*slot)->packet_length;
+        return (*slot)->packet;
+    } else if (recoveredSources[idx] && recoveredSources[idx]->encodingSymbolID == id) {
+        *length = recoveredSources[idx]->packet_length;
+        return recoveredSources[idx]->packet;
+    }
+    return NULL;
 }
 
-int cmp_eq_i(uint8_t *a, uint8_t *b, int idx, int n_unknowns) {
-    if (a[idx] < b[idx]) return -1;
-    else if (a[idx] > b[idx]) return 1;
-    else if (a[idx] != 0) return 0;
-    return 0;
+// Row *dst* -= *factor* * row *src*
+static void rlc_system__eliminate(struct rlc_decode_system *sys, int dst, int src, uint8_t factor, uint8_t *mul) {
+    for (int j = 0; j < MAX_DECODED_SOURCES; ++j) {
+        sys->coefs[dst][j] = gf256_sub(sys->coefs[dst][j], gf256_mul(factor, sys->coefs[src][j], mul));
+    }
+    for (int e = 0; e < MAX_SYSTEM_EQUATIONS; ++e) {
+        sys->combinations[dst][e] = gf256_sub(sys->combinations[dst][e], gf256_mul(factor, sys->combinations[src][e], mul));
+    }
+}
+
+static void rlc_system__clear_row(struct rlc_decode_system *sys, int r) {
+    memset(sys->coefs[r], 0, MAX_DECODED_SOURCES);
+    memset(sys->combinations[r], 0, MAX_SYSTEM_EQUATIONS);
+}
+
+// Reduces the row *r* (without pivot) with the rows of the system and moves it to the row of its first remaining unknown,
+// which is removed from the other rows. The row is dropped if it is a combination of the other rows.
+// One row operation per unknown of the row: the previous rows are never reduced again
+static void rlc_system__insert_row(struct rlc_decode_system *sys, int r, uint8_t *mul, uint8_t *inv) {
+    for (int u = 0; u < MAX_DECODED_SOURCES; ++u) {
+        if (sys->has_pivot[u] && sys->coefs[r][u] != 0) {
+            rlc_system__eliminate(sys, r, u, sys->coefs[r][u], mul);
+        }
+    }
+    int f = 0;
+    while (f < MAX_DECODED_SOURCES && (!sys->unknown_used[f] || sys->coefs[r][f] == 0)) {
+        ++f;
+    }
+    if (f == MAX_DECODED_SOURCES) {
+        rlc_system__clear_row(sys, r);
+        return;
+    }
+    if (f != r) {
+        memcpy(sys->coefs[f], sys->coefs[r], MAX_DECODED_SOURCES);
+        memcpy(sys->combinations[f], sys->combinations[r], MAX_SYSTEM_EQUATIONS);
+        rlc_system__clear_row(sys, r);
+    }
+
+    uint8_t pivot_inv = inv[sys->coefs[f][f]];
+    for (int j = 0; j < MAX_DECODED_SOURCES; ++j) {
+        sys->coefs[f][j] = gf256_mul(sys->coefs[f][j], pivot_inv, mul);
+    }
+    for (int e = 0; e < MAX_SYSTEM_EQUATIONS; ++e) {
+        sys->combinations[f][e] = gf256_mul(sys->combinations[f][e], pivot_inv, mul);
+    }
+    for (int u = 0; u < MAX_DECODED_SOURCES; ++u) {
+        if (sys->has_pivot[u] && sys->coefs[u][f] != 0) {
+            rlc_system__eliminate(sys, u, f, sys->coefs[u][f], mul);
+        }
+    }
+    sys->has_pivot[f] = true;
 }
 
-int cmp_eq(uint8_t *a, uint8_t *b, int idx, int n_unknowns) {
-    for (int i = 0 ; i < n_unknowns ; i++) {
-        int cmp = 0;
-        if ((cmp = cmp_eq_i(a, b, i, n_unknowns)) != 0) {
-            return cmp;
+// Frees the equations that are not used by any row anymore
+static void rlc_system__release_equations(struct rlc_decode_system *sys) {
+    for (int e = 0; e < MAX_SYSTEM_EQUATIONS; ++e) {
+        if (!sys->equations[e].used) {
+            continue;
+        }
+        bool referenced = false;
+        for (int u = 0; u < MAX_DECODED_SOURCES && !referenced; ++u) {
+            referenced = sys->has_pivot[u] && sys->combinations[u][e] != 0;
         }
+        sys->equations[e].used = referenced;
     }
-    return 0;
 }
 
-void sort_system(uint8_t **a, uint8_t **constant_terms, int n_eq, int n_unknowns) {
-    for (int i = 0; i < n_eq; ++i) {
-        int max = i;
-        for (int j = i + 1; j < n_eq; ++j) {
-            if (cmp_eq(a[max], a[j], i, n_unknowns) < 0) {
-                max = j;
+// The lost source symbol of column *u* is now known (received late or recovered): its terms are computed from the symbol
+// when combining the equations, so the column is removed. Its row is inserted again with the pivot on another unknown
+static void rlc_system__remove_unknown(struct rlc_decode_system *sys, int u, uint8_t *mul, uint8_t *inv) {
+    sys->unknown_used[u] = false;
+    for (int r = 0; r < MAX_DECODED_SOURCES; ++r) {
+        sys->coefs[r][u] = 0;
+    }
+    if (sys->has_pivot[u]) {
+        sys->has_pivot[u] = false;
+        rlc_system__insert_row(sys, u, mul, inv);
+        rlc_system__release_equations(sys);
+    }
+}
+
+// Retires the equations whose window slid out of the ring buffers of the context, with the rows using them
+// (the other equations of these rows are added again if they are still checked), then the unknowns of these windows
+static void rlc_system__retire(struct rlc_decode_system *sys) {
+    for (int e = 0; e < MAX_SYSTEM_EQUATIONS; ++e) {
+        if (!sys->equations[e].used || ESI_DIFF(sys->latest_id, sys->equations[e].first_id) < RLC_RECEIVER_BUFFER_SIZE) {
+            continue;
+        }
+        for (int u = 0; u < MAX_DECODED_SOURCES; ++u) {
+            if (sys->has_pivot[u] && sys->combinations[u][e] != 0) {
+                sys->has_pivot[u] = false;
+                rlc_system__clear_row(sys, u);
+            }
+        }
+    }
+    rlc_system__release_equations(sys);
+
+    for (int u = 0; u < MAX_DECODED_SOURCES; ++u) {
+        if (sys->unknown_used[u] && ESI_DIFF(sys->latest_id, sys->unknown_ids[u]) >= RLC_RECEIVER_BUFFER_SIZE) {
+            sys->unknown_used[u] = false;
+            sys->has_pivot[u] = false;
+            rlc_system__clear_row(sys, u);
+            for (int r = 0; r < MAX_DECODED_SOURCES; ++r) {
+                sys->coefs[r][u] = 0;
             }
         }
-        swap(a, i, max);
-        swap(constant_terms, i, max);
     }
 }
 
-static void rlc__get_coefs(tinymt32_t *prng, uint32_t seed, int n, uint8_t *coefs) {
-    tinymt32_init(prng, seed);
-    int i;
-    for (i = 0 ; i < n ; i++) {
-        coefs[i] = (uint8_t) tinymt32_generate_uint32(prng);
-        if (coefs[i] == 0)
-            coefs[i] = 1;
+// Returns the column of the lost source symbol *id*, a new one if it is not yet in the system, or -1 if the system is full
+static int rlc_system__unknown(struct rlc_decode_system *sys, uint32_t id) {
+    int free_column = -1;
+    for (int u = 0; u < MAX_DECODED_SOURCES; ++u) {
+        if (sys->unknown_used[u] && sys->unknown_ids[u] == id) {
+            return u;
+        } else if (!sys->unknown_used[u] && free_column < 0) {
+            free_column = u;
+        }
     }
+    if (free_column >= 0) {
+        sys->unknown_used[free_column] = true;
+        sys->unknown_ids[free_column] = id;
+    }
+    return free_column;
 }
 
-int first_non_zero_idx(const uint8_t *a, int n_unknowns) {
-    for (int i = 0 ; i < n_unknowns ; i++) {
-        if (a[i] != 0) {
-            return i;
+// Adds the repair symbol *k* of the window *window_info* to the system if it protects a lost source symbol.
+// Returns false if the system is full
+static bool rlc_system__add_equation(struct rlc_decode_system *sys, fecConvolution_t *fecConvolution, decode_rlc_t *rlc, recoveredSource_t **recoveredSources, window_info_t *window_info, int k) {
+    struct tlvRepair__convo_t *tlv = &window_info->tlv[k];
+    uint8_t window_size = tlv->nss;
+    if (window_size == 0 || window_size > MAX_RLC_WINDOW_SIZE) {
+        return true;
+    }
+    uint32_t first_id = ESI_SUB(window_info->encodingSymbolID, window_size - 1);
+    if (ESI_DIFF(sys->latest_id, first_id) >= RLC_RECEIVER_BUFFER_SIZE) {
+        return true; // Would be retired at once
+    }
+
+    int e = 0;
+    while (e < MAX_SYSTEM_EQUATIONS && sys->equations[e].used) {
+        ++e;
+    }
+    if (e == MAX_SYSTEM_EQUATIONS) {
+        return false;
+    }
+
+    const uint8_t *coefs = rlc_coefs__get(tlv->repairFecInfo & 0xffff);
+    int r = SYSTEM_NEW_ROW;
+    bool protects = false;
+    rlc_system__clear_row(sys, r);
+    sys->combinations[r][e] = 1;
+    for (int j = 0; j < window_size; ++j) {
+        uint32_t id = ESI_ADD(first_id, j);
+        uint16_t length;
+        symbol_slot_t *slot;
+        if (rlc__source_symbol(fecConvolution, rlc, recoveredSources, id, &length, &slot)) {
+            continue;
+        }
+        int u = rlc_system__unknown(sys, id);
+        if (u < 0) {
+            rlc_system__clear_row(sys, r);
+            return false;
         }
+        sys->coefs[r][u] = coefs[j];
+        protects = true;
+    }
+    if (!protects) {
+        rlc_system__clear_row(sys, r);
+        return true;
     }
-    return -1;
+
+    struct rlc_equation *equation = &sys->equations[e];
+    equation->repair_id = RLC_REPAIR_SYMBOL_ID(window_info->encodingSymbolID, k);
+    equation->first_id = first_id;
+    equation->repairKey = tlv->repairFecInfo & 0xffff;
+    equation->packet_length = window_info->packet_length[k];
+    equation->coded_payload_len = tlv->coded_payload_len;
+    equation->window_size = window_size;
+    equation->used = true;
+    rlc_system__insert_row(sys, r, rlc->muls, rlc->table_inv);
+    rlc_system__release_equations(sys); // The equation is released at once if it is redundant
+    return true;
 }
 
-void gaussElimination(int n_eq, int n_unknowns, uint8_t **a, uint8_t *constant_temps[n_eq], uint8_t *x[n_eq], bool undetermined[n_unknowns], uint32_t symbol_size, uint8_t *mul, uint8_t *inv) {
-    sort_system(a, constant_temps, n_eq, n_unknowns);
-    int i, j, k;
-    for (i = 0; i < n_eq - 1; ++i) {
-        for (k = i + 1; k < n_eq; ++k) {
-            if (k > i) { // WTF ?
-                uint8_t mulnum = a[k][i];
-                uint8_t mulden = a[i][i];
-                uint8_t term = gf256_mul(mulnum, inv[mulden], mul);
-                for (j = 0; j < n_unknowns; ++j) {
-                    a[k][j] = gf256_sub(a[k][j], gf256_mul(term, a[i][j], mul));
-                }
-                symbol_sub_scaled(constant_temps[k], term, constant_temps[i], symbol_size, mul);
-            }
+static bool rlc_system__has_equation(struct rlc_decode_system *sys, uint32_t repair_id) {
+    for (int e = 0; e < MAX_SYSTEM_EQUATIONS; ++e) {
+        if (sys->equations[e].used && sys->equations[e].repair_id == repair_id) {
+            return true;
         }
     }
-    
-    sort_system(a, constant_temps, n_eq, n_unknowns);
+    return false;
+}
 
-    for (i = 0 ; i < n_eq-1 ; i++) {
-        int first_nz_id = first_non_zero_idx(a[i], n_unknowns);
-        if (first_nz_id == -1) {
-            break;
+// Computes the *n_outputs* solved unknowns *columns* of the system in arena->unknown_buffers, in a single pass over the repair
+// and source symbols: x = sum(t[e] * b[e]) with b[e] = repair[e] - sum(c[e][j] * s[j]) gives the coefficient of each repair symbol
+// and of each received source symbol in x. The symbols are read in place, once for all the unknowns with the fused kernel.
+// Only the *symbol_size* first bytes of the unknowns are computed: the largest repair symbol of the equations, which covers
+// every source symbol of their windows. The length of the unknowns is computed apart, at MAX_PACKET_SIZE.
+// Returns false if a symbol is not (anymore) available
+static bool rlc__combine_symbols(struct rlc_decode_system *sys, fecConvolution_t *fecConvolution, decode_rlc_t *rlc, recoveredSource_t **recoveredSources, int *columns, int n_outputs, uint16_t symbol_size) {
+    struct rlc_decode_arena *arena = rlc->arena;
+    uint32_t share = fecConvolution->share;
+    uint8_t *outputs[MAX_DECODED_SOURCES];
+    uint8_t output_coefs[MAX_DECODED_SOURCES];
+
+    for (int o = 0; o < n_outputs; ++o) {
+        outputs[o] = arena->unknown_buffers[o];
+        memset(outputs[o], 0, symbol_size);
+        memset(outputs[o] + MAX_PACKET_SIZE, 0, sizeof(uint16_t));
+    }
+
+    // Repair symbols, with their coded length at the place of the length of the source symbols
+    for (int e = 0; e < MAX_SYSTEM_EQUATIONS; ++e) {
+        struct rlc_equation *equation = &sys->equations[e];
+        bool used = false;
+        for (int o = 0; o < n_outputs; ++o) {
+            output_coefs[o] = sys->combinations[columns[o]][e];
+            used |= output_coefs[o] != 0;
         }
-        for (j = first_nz_id + 1 ; j < n_unknowns && a[i][j] != 0; j++) {
-            for (k = i + 1 ; k < n_eq ; k++) {
-                int first_nz_id_below = first_non_zero_idx(a[k], n_unknowns);
-                if (j > first_nz_id_below) {
-                    break;
-                } else if (first_nz_id_below == j) {
-                    uint8_t term = gf256_mul(a[i][j], inv[a[k][j]], mul);
-                    for (int l = j ; l < n_unknowns ; l++) {
-                        a[i][l] = gf256_sub(a[i][l], gf256_mul(term, a[k][l], mul));
-                    }
-                    symbol_sub_scaled(constant_temps[i], term, constant_temps[k], symbol_size, mul);
-                    break;
-                }
-            }
+        if (!equation->used || !used) {
+            continue;
+        }
+        symbol_slot_t *slot = symbol_pool__get(&rlc->repairPool, share, equation->repair_id);
+        if (!slot || slot->packet_length != equation->packet_length) {
+            return false;
+        }
+        for (int o = 0; o < n_outputs; ++o) {
+            symbol_add_scaled(outputs[o] + MAX_PACKET_SIZE, output_coefs[o], &equation->coded_payload_len, sizeof(uint16_t), rlc->muls);
+        }
+        symbol_add_scaled_multi(outputs, output_coefs, n_outputs, slot->packet, equation->packet_length, rlc->muls);
+        if (symbol_pool__get(&rlc->repairPool, share, equation->repair_id) != slot || slot->packet_length != equation->packet_length) {
+            return false; // Overwritten while it was read
         }
     }
 
-    int candidate = n_unknowns - 1;
-    for (i = n_eq - 1; i >= 0; --i) {
-        bool only_zeroes = true;
-        for (j = 0; j < n_unknowns; ++j) {
-            if (a[i][j] != 0) {
-                only_zeroes = false;
-                break;
-            }
+    // Received (or previously recovered) source symbols of the windows of the equations. The lost ones are the unknowns
+    for (int i = 0; i < RLC_RECEIVER_BUFFER_SIZE; ++i) {
+        uint32_t id = ESI_SUB(sys->latest_id, i);
+        bool used = false;
+        for (int u = 0; u < MAX_DECODED_SOURCES && !used; ++u) {
+            used = sys->unknown_used[u] && sys->unknown_ids[u] == id;
         }
-        if (!only_zeroes) {
-            while (a[i][candidate] == 0 && candidate >= 0) {
-                undetermined[candidate--] = true;
-            }
-            if (candidate < 0) {
-                fprintf(stderr, "System partially undetermined\n");
-                break;
-            }
-            memcpy(x[candidate], constant_temps[i], symbol_size);
-            for (j = 0; j < candidate; ++j) {
-                if (a[i][j] != 0) {
-                    undetermined[candidate] = true;
-                    break;
-                }
+        if (used) {
+            continue;
+        }
+        for (int o = 0; o < n_outputs; ++o) {
+            output_coefs[o] = 0;
+        }
+        for (int e = 0; e < MAX_SYSTEM_EQUATIONS; ++e) {
+            struct rlc_equation *equation = &sys->equations[e];
+            uint32_t position = ESI_DIFF(id, equation->first_id);
+            if (!equation->used || position >= equation->window_size) {
+                continue;
             }
-            for (j = candidate + 1; j < n_unknowns; ++j) {
-                if (a[i][j] != 0) {
-                    if (undetermined[j]) {
-                        undetermined[candidate] = true;
-                    } else {
-                        symbol_sub_scaled(x[candidate], a[i][j], x[j], symbol_size, mul);
-                        a[i][j] = 0;
-                    }
-                }
+            uint8_t coef = rlc_coefs__get(equation->repairKey)[position];
+            for (int o = 0; o < n_outputs; ++o) {
+                output_coefs[o] = gf256_add(output_coefs[o], gf256_mul(sys->combinations[columns[o]][e], coef, rlc->muls));
+                used |= output_coefs[o] != 0;
             }
-            if (symbol_is_zero(x[candidate], symbol_size) || a[i][candidate] == 0) {
-                undetermined[candidate] = true;
-            } else if (!undetermined[candidate]) {
-                symbol_mul(x[candidate], inv[a[i][candidate]], symbol_size, mul);
-                a[i][candidate] = gf256_mul(a[i][candidate], inv[a[i][candidate]], mul);
-            } 
-            candidate--;
+        }
+        if (!used) {
+            continue;
+        }
+        uint16_t length;
+        symbol_slot_t *slot;
+        const uint8_t *symbol = rlc__source_symbol(fecConvolution, rlc, recoveredSources, id, &length, &slot);
+        if (!symbol || length > symbol_size) {
+            return false;
+        }
+        for (int o = 0; o < n_outputs; ++o) {
+            symbol_add_scaled(outputs[o] + MAX_PACKET_SIZE, output_coefs[o], &length, sizeof(uint16_t), rlc->muls);
+        }
+        symbol_add_scaled_multi(outputs, output_coefs, n_outputs, symbol, length, rlc->muls);
+        if (slot && (symbol_pool__get(&rlc->sourcePool, share, id) != slot || slot->packet_length != length)) {
+            return false;
         }
     }
-    if (candidate >= 0) {
-        memset(undetermined, true, (candidate + 1) * sizeof(bool));
-    }
+    return true;
 }
 
+// Called for each repair symbol received while source symbols are missing. The new repair symbols of the last windows
+// are eliminated against the reduced system of the context, then the solved source symbols are computed and sent
 static int rlc__fec_recover(fecConvolution_t *fecConvolution, decode_rlc_t *rlc, int sfd, struct sockaddr_in6 local_addr) {
     // ID of the last received repair symbol
     uint32_t encodingSymbolID = fecConvolution->encodingSymbolID;
-    uint32_t decoding_size = MAX_PACKET_SIZE + sizeof(uint16_t); // Decoding the packet + packet length
-    uint8_t rlc_window_size;
-    uint8_t rlc_window_slide;
-    tinymt32_t prng;
-    prng.mat1 = 0x8f7011ee;
-    prng.mat2 = 0xfc78ff1f;
-    prng.tmat = 0x3793fdff;
-    uint16_t max_seen_payload_length = 0;
-
+    uint32_t share = fecConvolution->share;
+    if (share >= rlc->shares) {
+        return -1;
+    }
+    // Symbols recovered in this decoding context
+    recoveredSource_t **recoveredSources = &rlc->recoveredSources[share * RLC_RECEIVER_BUFFER_SIZE];
+    struct rlc_decode_system *sys = &rlc->systems[share];
+    struct rlc_decode_arena *arena = rlc->arena;
     uint8_t *muls = rlc->muls;
 
-    uint8_t effective_window_check = 0;
+    // A late repair symbol does not move the system back
+    if (!sys->started || ESI_DIFF(encodingSymbolID, sys->latest_id) <= (ESI_SEQ_MASK >> 1)) {
+        sys->latest_id = encodingSymbolID;
+        sys->started = true;
+    }
+    rlc_system__retire(sys);
+
+    // The source symbols are not notified to user space: the lost ones received late or recovered are removed here
+    for (int u = 0; u < MAX_DECODED_SOURCES; ++u) {
+        uint16_t length;
+        symbol_slot_t *slot;
+        if (sys->unknown_used[u] && rlc__source_symbol(fecConvolution, rlc, recoveredSources, sys->unknown_ids[u], &length, &slot)) {
+            rlc_system__remove_unknown(sys, u, muls, rlc->table_inv);
+        }
+    }
+
+    // The repair symbols of the previous windows are added if they were missed (reordered, or dropped with a retired row)
     uint32_t current_encodingSymbolID = encodingSymbolID;
     for (int i = 0; i < MAX_WINDOW_CHECK; ++i) {
         window_info_t *window_info = &fecConvolution->windowInfoBuffer[current_encodingSymbolID % RLC_RECEIVER_BUFFER_SIZE];
-        struct tlvRepair__convo_t *repairTLV = (struct tlvRepair__convo_t *)&window_info->repairSymbol.tlv;
-        max_seen_payload_length = MAX(max_seen_payload_length, window_info->repairSymbol.packet_length);
-        if (current_encodingSymbolID == repairTLV->encodingSymbolID) {
-            rlc_window_size = repairTLV->nss; // Assumes that these two values will always be the same
-            rlc_window_slide = (repairTLV->repairFecInfo >> 16) & 0xf; // DT in the 8 highest order bits
-            ++effective_window_check;
-            current_encodingSymbolID -= rlc_window_slide;
-        } else {
-            //printf("%u %u\n", current_encodingSymbolID, repairTLV->encodingSymbolID);
+        if (current_encodingSymbolID != window_info->encodingSymbolID || !window_info->repair_mask) {
             break; // Gap in the repair symbols, we stop
         }
-    }
-    if (effective_window_check == 0) {
-        fprintf(stderr, "No correct repair symbol...\n");
-        return -1;
-    }
-    uint8_t source_symbol_nb = (effective_window_check - 1) * rlc_window_slide + rlc_window_size;
-    // Find all lost symbols in the last 3 windows if we have the repair symbol of the window 
-    uint8_t **source_symbols_array = malloc(source_symbol_nb * sizeof(uint8_t *)); // TODO: check malloc
-    memset(source_symbols_array, 0, sizeof(uint8_t *) * source_symbol_nb);
-    struct repairSymbol_t **repair_symbols_array = malloc(effective_window_check * sizeof(struct repairSymbol_t *)); // TODO: check malloc
-    memset(repair_symbols_array, 0, sizeof(struct repairSymbol_t *) * effective_window_check);
-    for (int i = 0; i < effective_window_check; ++i) {
-        repair_symbols_array[i] = malloc(sizeof(struct repairSymbol_t));
-        memset(repair_symbols_array[i], 0, sizeof(struct repairSymbol_t));
-    }
-
-    uint8_t nb_unknowns = 0;
-    uint8_t *unknowns_idx = malloc(source_symbol_nb); // Mapping x => source symbol
-    memset(unknowns_idx, 0, source_symbol_nb);
-    uint8_t *missing_indexes = malloc(source_symbol_nb); // Mapping source symbol => x
-    memset(missing_indexes, -1, source_symbol_nb);
-
-    bool *protected_symbol = malloc(sizeof(bool) * source_symbol_nb);
-    memset(protected_symbol, 0, source_symbol_nb * sizeof(bool));
-
-    uint32_t id_first_ss_first_window = encodingSymbolID - source_symbol_nb + 1;
-    uint32_t id_first_rs_first_window = encodingSymbolID - (effective_window_check - 1) * rlc_window_slide;
-
-    // Store the source and repair symbols in a new structure to merge US and KS 
-    for (int i = 0; i < effective_window_check; ++i) {
-        uint32_t idx = (id_first_rs_first_window + rlc_window_slide * i) % RLC_RECEIVER_BUFFER_SIZE;
-        memcpy(repair_symbols_array[i], &fecConvolution->windowInfoBuffer[idx].repairSymbol, sizeof(struct repairSymbol_t));
-    }
-    for (int i = 0; i < source_symbol_nb; ++i) {
-        uint32_t idx = (id_first_ss_first_window + i) % RLC_RECEIVER_BUFFER_SIZE;
-        struct tlvSource__convo_t *tlv = (struct tlvSource__convo_t *)&fecConvolution->sourceRingBuffer[idx].tlv;
-        uint32_t id_from_buffer = tlv->encodingSymbolID;
-        uint32_t theoric_id = id_first_ss_first_window + i;
-        if (id_from_buffer == theoric_id && tlv->tlv_type != 0) {
-            source_symbols_array[i] = malloc(decoding_size);
-            memset(source_symbols_array[i], 0, decoding_size);
-            memcpy(source_symbols_array[i], fecConvolution->sourceRingBuffer[idx].packet, fecConvolution->sourceRingBuffer[idx].packet_length);
-            memcpy(source_symbols_array[i] + MAX_PACKET_SIZE, &fecConvolution->sourceRingBuffer[idx].packet_length, sizeof(uint16_t));
-        } else if (rlc->recoveredSources[idx] && rlc->recoveredSources[idx]->encodingSymbolID == theoric_id) {
-            source_symbols_array[i] = malloc(decoding_size);
-            memset(source_symbols_array[i], 0, decoding_size);
-            memcpy(source_symbols_array[i], rlc->recoveredSources[idx]->packet, rlc->recoveredSources[idx]->packet_length);
-            memcpy(source_symbols_array[i] + MAX_PACKET_SIZE, &rlc->recoveredSources[idx]->packet_length, sizeof(uint16_t));
-        } else {
-            unknowns_idx[nb_unknowns] = i; // Store index of the lost packet (unknown for the equation system)
-            missing_indexes[i] = nb_unknowns;
-            ++nb_unknowns;
-        }
-    }
-    if (nb_unknowns == 0) {
-        for (int i = 0; i < source_symbol_nb; ++i) {
-            if (source_symbols_array[i]) free(source_symbols_array[i]);
+        for (int k = 0; k < MAX_RLC_RS_NUMBER; ++k) {
+            if ((window_info->repair_mask & (1 << k)) && !rlc_system__has_equation(sys, RLC_REPAIR_SYMBOL_ID(window_info->encodingSymbolID, k))) {
+                if (!rlc_system__add_equation(sys, fecConvolution, rlc, recoveredSources, window_info, k) && sys->dropped_equations++ == 0) {
+                    fprintf(stderr, "Decoding system of the share %u full, its next repair symbols may be dropped\n", share);
+                }
+            }
         }
-        free(source_symbols_array);
-        for (int i = 0; i < effective_window_check; ++i) {
-            free(repair_symbols_array[i]);
+        // All the repair symbols of a window have the same window parameters, DT in the 8 highest order bits
+        uint8_t window_slide = (window_info->tlv[__builtin_ctz(window_info->repair_mask)].repairFecInfo >> 16) & 0xf;
+        if (window_slide == 0) {
+            break;
         }
-        free(repair_symbols_array);
-        free(unknowns_idx);
-        free(missing_indexes);
-        free(protected_symbol);
-        return 0;
+        current_encodingSymbolID = ESI_SUB(current_encodingSymbolID, window_slide);
     }
 
-    // System is Ax=b
-    int n_eq = MIN(nb_unknowns, effective_window_check);
-    uint8_t *coefs = malloc(rlc_window_size); // changed
-    memset(coefs, 0, rlc_window_size);
-    uint8_t **unknowns = malloc(nb_unknowns * sizeof(uint8_t *)); // Table of (lost) packets to be recovered = x
-    memset(unknowns, 0, nb_unknowns * sizeof(uint8_t *));
-    uint8_t **system_coefs = malloc(n_eq * sizeof(uint8_t *)); // Double dimension array = A
-    memset(system_coefs, 0, n_eq * sizeof(uint8_t *));
-    uint8_t **constant_terms = malloc(nb_unknowns * sizeof(uint8_t *)); // independent term = b
-    memset(constant_terms, 0, nb_unknowns * sizeof(uint8_t *));
-    bool *undetermined = malloc(nb_unknowns * sizeof(bool)); // Indicates which (lost) source symbols could not be recovered
-    memset(undetermined, 0, nb_unknowns * sizeof(bool));
-
-    for (int i = 0 ; i < n_eq ; i++) {
-        system_coefs[i] = malloc(nb_unknowns);
-        if (!system_coefs[i]) {
-            return -1;
-        }
-        memset(system_coefs[i], 0, nb_unknowns);
-    }
-
-    for (int j = 0; j < nb_unknowns; ++j) {
-        unknowns[j] = malloc(decoding_size);
-        memset(unknowns[j], 0, decoding_size);
-    }
-
-    int i = 0;
-
-    for (int rs = 0; rs < effective_window_check; ++rs) {
-        struct repairSymbol_t *repairSymbol = repair_symbols_array[rs];
-        bool protect_at_least_one_ss = false;
-        // Check if this repair symbol protects at least one lost source symbol
-        for (int k = 0; k < rlc_window_size; ++k) {
-            int idx = rs * rlc_window_slide + k;
-            if (!source_symbols_array[idx] && !protected_symbol[idx]) {
-                protect_at_least_one_ss = true;
-                protected_symbol[idx] = true;
-                break;
-            }
+    // An unknown is solved when its row does not depend on another unknown
+    int columns[MAX_DECODED_SOURCES];
+    uint16_t max_seen_payload_length[MAX_DECODED_SOURCES];
+    uint16_t symbol_size = 0; // Largest symbol used by the solved unknowns, bounds the decoding
+    int n_solved = 0;
+    for (int u = 0; u < MAX_DECODED_SOURCES; ++u) {
+        if (!sys->unknown_used[u] || !sys->has_pivot[u]) {
+            continue;
         }
-        if (protect_at_least_one_ss) {
-            constant_terms[i] = malloc(decoding_size);
-            if (!constant_terms[i]) return -1;
-
-            struct tlvRepair__convo_t *repair_tlv = (struct tlvRepair__convo_t *)&repairSymbol->tlv;
-        
-            memset(constant_terms[i], 0, decoding_size);
-            memcpy(constant_terms[i], repairSymbol->packet, repairSymbol->packet_length);
-            memcpy(constant_terms[i] + MAX_PACKET_SIZE, &repair_tlv->coded_payload_len, sizeof(uint16_t));
-            memset(system_coefs[i], 0, nb_unknowns);
-            uint16_t repairKey = ((struct tlvRepair__convo_t *)&repairSymbol->tlv)->repairFecInfo & 0xffff;
-            rlc__get_coefs(&prng, repairKey, rlc_window_size, coefs); // TODO: coefs specific ? line 454
-            int current_unknown = 0;
-            for (int j = 0; j < rlc_window_size; ++j) {
-                int idx = rs * rlc_window_slide + j;
-                if (source_symbols_array[idx]) { // This protected source symbol is received
-                    symbol_sub_scaled(constant_terms[i], coefs[j], source_symbols_array[idx], decoding_size, muls);
-                } else if (current_unknown < nb_unknowns) {
-                    if (missing_indexes[idx] != -1) {
-                        system_coefs[i][missing_indexes[idx]] = coefs[j];
-                    } else {
-                        fprintf(stderr, "Erreur ici 3452\n");
-                    }
-                }
+        bool solved = true;
+        for (int v = 0; v < MAX_DECODED_SOURCES && solved; ++v) {
+            solved = v == u || !sys->unknown_used[v] || sys->coefs[u][v] == 0;
+        }
+        if (!solved) {
+            continue;
+        }
+        max_seen_payload_length[n_solved] = 0;
+        for (int e = 0; e < MAX_SYSTEM_EQUATIONS; ++e) {
+            if (sys->equations[e].used && sys->combinations[u][e] != 0) {
+                max_seen_payload_length[n_solved] = MAX(max_seen_payload_length[n_solved], sys->equations[e].packet_length);
             }
-            ++i;
         }
+        symbol_size = MAX(symbol_size, max_seen_payload_length[n_solved]);
+        columns[n_solved++] = u;
     }
-    free(protected_symbol);
-    int n_effective_equations = i;
-
-    bool can_recover = n_effective_equations >= nb_unknowns;
-    if (can_recover) {
-        gaussElimination(n_effective_equations, nb_unknowns, system_coefs, constant_terms, unknowns, undetermined, decoding_size, muls, rlc->table_inv);
-    } else {
-        //printf("Cannot recover\n");
+    if (n_solved == 0 || !rlc__combine_symbols(sys, fecConvolution, rlc, recoveredSources, columns, n_solved, symbol_size)) {
+        return 0;
     }
-    
-    int current_unknown = 0;
+
     int err = 0;
-    for (int j = 0; j < nb_unknowns; ++j) {
-        int idx = unknowns_idx[j];
-        if (can_recover && !source_symbols_array[idx] && !undetermined[current_unknown] && !symbol_is_zero(unknowns[current_unknown], MAX_PACKET_SIZE)) {
-            recoveredSource_t *recovered = malloc(sizeof(recoveredSource_t));
-            memset(recovered, 0, sizeof(recoveredSource_t));
-            recovered->encodingSymbolID = id_first_ss_first_window + idx;
-            memcpy(recovered->packet, unknowns[current_unknown], MAX_PACKET_SIZE);
-            memcpy(&recovered->packet_length, unknowns[current_unknown] + MAX_PACKET_SIZE, sizeof(uint16_t));
-            if (recovered->packet_length > max_seen_payload_length) {
-                free(recovered);
-                fprintf(stderr, "sisi\n");
-                continue;
-            }
-            //printf("length %u\n", recovered->packet_length);
-            //++total_recovered;
-            //printf("Recovered 1\n");
+    for (int o = 0; o < n_solved; ++o) {
+        uint8_t *unknown = arena->unknown_buffers[o];
+        uint16_t packet_length;
+        memcpy(&packet_length, unknown + MAX_PACKET_SIZE, sizeof(uint16_t));
+        if (symbol_is_zero(unknown, symbol_size)) {
+            continue;
+        } else if (packet_length > max_seen_payload_length[o]) {
+            fprintf(stderr, "sisi\n");
+            continue;
+        }
+        // Only allocated until every entry of recoveredSources is used
+        recoveredSource_t *recovered = arena->spare_recovered ? arena->spare_recovered : malloc(sizeof(recoveredSource_t));
+        if (!recovered) return -1;
+        arena->spare_recovered = recovered;
+        recovered->encodingSymbolID = sys->unknown_ids[columns[o]];
+        recovered->packet_length = packet_length;
+        memcpy(recovered->packet, unknown, packet_length); // The bytes after the length are never read
+        if (rlc->batch) {
+            err = queue_raw_socket_recovered(rlc->batch, recovered, local_addr);
+        } else {
             err = send_raw_socket_recovered(sfd, recovered, local_addr);
-            if (err < 0) {
-                //fprintf(stderr, "VALEUR DE l'ENCODING SYMBOLID: %x\n", recovered->encodingSymbolID);
-                /*fprintf(stderr, "Error during sending the packet, drop\n");
-                printf("Valeur des coefs: ");
-                rlc__get_coefs(&prng, 0, rlc_window_size, coefs);
-                for (int l = 0; l < 4; l++) {
-                    printf("%u ", coefs[l]);
-                }
-                printf("\n");
-                printf("source symbol nb: %u\n", source_symbol_nb);
-                printf("first ss: %x\n", id_first_ss_first_window);
-                printf("first rs: %x\n", id_first_rs_first_window);
-                printf("Unknown idx:\n");
-                for (int l = 0; l < source_symbol_nb; ++l) {
-                    printf("%u ", unknowns_idx[l]);
-                }
-                printf("\n");
-                printf("missing idx:\n");
-                for (int l = 0; l < source_symbol_nb; ++l) {
-                    printf("%u ", missing_indexes[l]);
-                }
-                printf("\n");
-                //print_recovered(recovered);
-                printf("VALEUR DE l'ENCODING SYMBOLID: %x\n", recovered->encodingSymbolID);
-                printf("Montre tout le contenu du buffer:\n");
-                for (int l = 0; l < RLC_RECEIVER_BUFFER_SIZE; ++l) {
-                    struct tlvSource__convo_t *tlv = (struct tlvSource__convo_t *)&fecConvolution->sourceRingBuffer[l].tlv;
-                    printf("%x(%u) ", tlv->encodingSymbolID, fecConvolution->sourceRingBuffer[l].packet_length);
-                }
-                printf("\n");
-                printf("Now the repair symbols:\n");
-                for (int l = 0; l < RLC_RECEIVER_BUFFER_SIZE; ++l) {
-                    window_info_t *window_info = &fecConvolution->windowInfoBuffer[l];
-                    struct tlvRepair__convo_t *repairTLV = (struct tlvRepair__convo_t *)&window_info->repairSymbol.tlv;
-                    printf("%x(%u) ", repairTLV->encodingSymbolID, fecConvolution->windowInfoBuffer[l].repairSymbol.packet_length);
-                }
-                printf("La length recovered est: %u\n", recovered->packet_length);
-                printf("effective window check=%u, nb_unknowns=%u\n", effective_window_check, nb_unknowns);
-
-                printf("Repair symbol:\n");
-                for (int l = 0; l < 512; ++l) {
-                    printf("%x ", fecConvolution->windowInfoBuffer[(recovered->encodingSymbolID + 1) % 32].repairSymbol.packet[l]);
-                }
-                printf("\nDeuxieme symbol:\n");
-                struct tlvSource__convo_t *tlv = (struct tlvSource__convo_t *)&fecConvolution->sourceRingBuffer[(recovered->encodingSymbolID + 1) % 32].tlv;
-                printf("%x(%u) ", tlv->encodingSymbolID, fecConvolution->sourceRingBuffer[(recovered->encodingSymbolID + 1) % 32].packet_length);
-                for (int l = 0; l < 512; ++l) {
-                    printf("%x ", fecConvolution->sourceRingBuffer[(recovered->encodingSymbolID + 1) % 32].packet[l]);
-                }
-
-                printf("\n\n");
-                // print_recovered(recovered);*/
-                free(recovered);
-            } else {
-                // Add the recovered packet in the recovered buffer 
-                int bufferIdx = recovered->encodingSymbolID % RLC_RECEIVER_BUFFER_SIZE;
-                if (rlc->recoveredSources[bufferIdx]) free(rlc->recoveredSources[bufferIdx]);
-                rlc->recoveredSources[recovered->encodingSymbolID % RLC_RECEIVER_BUFFER_SIZE] = recovered;
-            }
         }
-        free(unknowns[current_unknown++]);
+        if (err >= 0) {
+            // Add the recovered packet in the recovered buffer, the previous entry becomes the spare one
+            int bufferIdx = recovered->encodingSymbolID % RLC_RECEIVER_BUFFER_SIZE;
+            arena->spare_recovered = recoveredSources[bufferIdx];
+            recoveredSources[bufferIdx] = recovered;
+            // Known from now on: the other rows do not depend on it
+            rlc_system__remove_unknown(sys, columns[o], muls, rlc->table_inv);
+        }
     }
-    //printf("Total recovered: %u\n", total_recovered);
 
-    // Free the system 
-    for (i = 0; i < n_eq; ++i) {
-        free(system_coefs[i]);
-        if (i < n_effective_equations) {
-            free(constant_terms[i]);
-        }
+    return err;
+}
+
+// Sends the source symbol recovered by the eBPF program (see recover_single__convoRLC), read in the source symbol pool.
+// It is not sent again if user space already recovered it
+int rlc__send_kernel_recovered(decode_rlc_t *rlc, kernel_recovered_t *message, int sfd, struct sockaddr_in6 local_addr) {
+    uint32_t id = message->encodingSymbolID;
+    uint32_t share = message->share;
+    if (share >= rlc->shares) {
+        return -1;
     }
-    for (i = 0; i < source_symbol_nb; ++i) {
-        if (source_symbols_array[i])
-            free(source_symbols_array[i]);
+    recoveredSource_t *previous = rlc->recoveredSources[share * RLC_RECEIVER_BUFFER_SIZE + id % RLC_RECEIVER_BUFFER_SIZE];
+    if (previous && previous->encodingSymbolID == id) {
+        return 0;
     }
-    for (i = 0; i < effective_window_check; ++i) {
-        if (repair_symbols_array[i])
-            free(repair_symbols_array[i]);
+    symbol_slot_t *slot = symbol_pool__get(&rlc->sourcePool, share, id);
+    if (!slot) {
+        return 0; // Already overwritten
     }
-    free(source_symbols_array);
-    free(repair_symbols_array);
-    free(system_coefs);
-    free(constant_terms);
-    free(unknowns);
-    free(coefs);
-    free(undetermined);
-    free(unknowns_idx);
-    free(missing_indexes);
-    return err;
-}
 
+    struct rlc_decode_arena *arena = rlc->arena;
+    recoveredSource_t *recovered = arena->spare_recovered ? arena->spare_recovered : malloc(sizeof(recoveredSource_t));
+    if (!recovered) return -1;
+    arena->spare_recovered = recovered;
+    recovered->encodingSymbolID = id;
+    recovered->packet_length = slot->packet_length;
+    memcpy(recovered->packet, slot->packet, recovered->packet_length);
+    if (symbol_pool__get(&rlc->sourcePool, share, id) != slot || slot->packet_length != recovered->packet_length) {
+        return 0;
+    }
+
+    if (rlc->batch) {
+        return queue_raw_socket_recovered(rlc->batch, recovered, local_addr);
+    }
+    return send_raw_socket_recovered(sfd, recovered, local_addr);
+}
 
-decode_rlc_t *initialize_rlc_decode() {
+// Initializes the decoding structure for *shares* decoding contexts.
+// The GF(256) tables and the decoding memory are shared by all the contexts
+decode_rlc_t *initialize_rlc_decode(uint32_t shares) {
     decode_rlc_t *my_rlc = malloc(sizeof(decode_rlc_t));
     if (!my_rlc) return 0;
 
     memset(my_rlc, 0, sizeof(decode_rlc_t));
 
+    // Shared with the encoder code, computed once
+    rlc_coefs__init();
+
+    // Only the pointers are allocated, the recovered symbols are allocated when needed
+    my_rlc->recoveredSources = calloc(shares * RLC_RECEIVER_BUFFER_SIZE, sizeof(recoveredSource_t *));
+    if (!my_rlc->recoveredSources) {
+        free(my_rlc);
+        return 0;
+    }
+    my_rlc->shares = shares;
+
     // Create and fill the products 
     uint8_t *muls = malloc(256 * 256 * sizeof(uint8_t));
     if (!muls) {
+        free(my_rlc->recoveredSources);
         free(my_rlc);
         return 0;
     }
@@ -474,6 +546,7 @@ decode_rlc_t *initialize_rlc_decode() {
     uint8_t *table_inv = malloc(256 * sizeof(uint8_t));
     if (!table_inv) {
         free(muls);
+        free(my_rlc->recoveredSources);
         free(my_rlc);
         return 0;
     }
@@ -481,14 +554,54 @@ decode_rlc_t *initialize_rlc_decode() {
     assign_inv(table_inv);
     my_rlc->table_inv = table_inv;
 
+    // Preallocate the memory used to decode
+    struct rlc_decode_arena *arena = malloc(sizeof(struct rlc_decode_arena));
+    if (!arena) {
+        free(table_inv);
+        free(muls);
+        free(my_rlc->recoveredSources);
+        free(my_rlc);
+        return 0;
+    }
+    memset(arena, 0, sizeof(struct rlc_decode_arena));
+    my_rlc->arena = arena;
+
+    // The systems of the contexts are kept from one recovery to the next
+    my_rlc->systems = calloc(shares, sizeof(struct rlc_decode_system));
+    if (!my_rlc->systems) {
+        free(arena);
+        free(table_inv);
+        free(muls);
+        free(my_rlc->recoveredSources);
+        free(my_rlc);
+        return 0;
+    }
+
     return my_rlc;
 }
 
+// Forgets the symbols recovered and the system of the decoding context using *share*, before the share is given to a new context
+void rlc_decode__clear_share(decode_rlc_t *rlc, uint32_t share) {
+    memset(&rlc->systems[share], 0, sizeof(struct rlc_decode_system));
+    recoveredSource_t **recoveredSources = &rlc->recoveredSources[share * RLC_RECEIVER_BUFFER_SIZE];
+    for (int i = 0; i < RLC_RECEIVER_BUFFER_SIZE; ++i) {
+        free(recoveredSources[i]);
+        recoveredSources[i] = NULL;
+    }
+}
+
 void free_rlc_decode(decode_rlc_t *rlc) {
+    raw_socket_batch__free(rlc->batch);
+    symbol_pool__munmap(&rlc->sourcePool);
+    symbol_pool__munmap(&rlc->repairPool);
     free(rlc->muls);
     free(rlc->table_inv);
-    for (int i = 0; i < RLC_RECEIVER_BUFFER_SIZE; ++i) {
-        if (rlc->recoveredSources[i]) free(rlc->recoveredSources[i]);
+    free(rlc->arena->spare_recovered);
+    free(rlc->arena);
+    for (uint32_t share = 0; share < rlc->shares; ++share) {
+        rlc_decode__clear_share(rlc, share);
     }
+    free(rlc->recoveredSources);
+    free(rlc->systems);
     free(rlc);
 }
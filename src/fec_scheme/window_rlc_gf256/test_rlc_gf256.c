@@ -0,0 +1,366 @@
+#define _GNU_SOURCE // memfd_create
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h> // Before the eBPF sources, which define memcpy and memset as builtins
+#include <stdbool.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <arpa/inet.h>
+#include "../../fec_framework/store_packet_receiver.c"
+#include "rlc_gf256_decode.c"
+#include "test_rlc_gf256.h"
+
+// Tests of the source symbols of the convolutional framework and of their RLC coding.
+// Built and run with "make test"
+
+#define TEST_SEGMENTS 2
+#define TEST_SRH_OFFSET 40
+#define TEST_TLV_OFFSET (TEST_SRH_OFFSET + 8 + TEST_SEGMENTS * 16) // The TLVs follow the segments
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); \
+        fprintf(stderr, __VA_ARGS__); \
+        fprintf(stderr, "\n"); \
+        ++failures; \
+    } \
+} while (0)
+
+// Returns the offset of the first byte differing between *a* and *b*, -1 if none
+static int test__first_difference(const uint8_t *a, const uint8_t *b, uint32_t length) {
+    for (uint32_t i = 0; i < length; ++i) {
+        if (a[i] != b[i]) return i;
+    }
+    return -1;
+}
+
+// Writes in *packet* an IPv6 packet with an SRH of TEST_SEGMENTS segments (the next one being the decoder)
+// and *payload_length* bytes of UDP payload generated from *seed*. Returns the length of the packet
+static uint16_t test__source_packet(uint8_t *packet, uint16_t payload_length, uint32_t seed) {
+    uint16_t length = TEST_TLV_OFFSET + payload_length;
+    memset(packet, 0, length);
+    struct ip6_t *ip6 = (struct ip6_t *)packet;
+    ip6->ver = 6;
+    ip6->flow_label = seed & 0xfffff;
+    ip6->payload_len = htons(length - 40);
+    ip6->next_header = 43;
+    ip6->hop_limit = 64;
+    ip6->src_hi = 0x00000000000000fc ^ ((uint64_t)seed << 32);
+    ip6->src_lo = 0x0100000000000000;
+    ip6->dst_hi = 0x00000000000000fc; // fc00::a, the encoder
+    ip6->dst_lo = 0x0a00000000000000;
+    struct ip6_srh_t *srh = (struct ip6_srh_t *)(packet + TEST_SRH_OFFSET);
+    srh->nexthdr = 17;
+    srh->hdrlen = TEST_SEGMENTS * 2;
+    srh->type = 4;
+    srh->segments_left = TEST_SEGMENTS;
+    srh->first_segment = TEST_SEGMENTS - 1;
+    memcpy(srh->segments[0].addr, "\xfc\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x09", 16);
+    memcpy(srh->segments[1].addr, "\xfc\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x0a", 16);
+    for (uint16_t i = TEST_TLV_OFFSET; i < length; ++i) {
+        seed = seed * 1103515245 + 12345;
+        packet[i] = seed >> 16;
+    }
+    return length;
+}
+
+// The encoder adds the source TLV of *encodingSymbolID* to *packet* and the packet goes to the next segment (the decoder).
+// Returns the length of the packet received by the decoder
+static uint16_t test__forward_to_decoder(uint8_t *packet, uint16_t length, uint32_t encodingSymbolID) {
+    struct tlvSource__convo_t tlv;
+    memset(&tlv, 0, sizeof(tlv));
+    tlv.tlv_type = TLV_CODING_SOURCE;
+    tlv.len = sizeof(tlv) - 2;
+    tlv.encodingSymbolID = encodingSymbolID;
+    memmove(packet + TEST_TLV_OFFSET + sizeof(tlv), packet + TEST_TLV_OFFSET, length - TEST_TLV_OFFSET);
+    memcpy(packet + TEST_TLV_OFFSET, &tlv, sizeof(tlv));
+    length += sizeof(tlv);
+
+    struct ip6_t *ip6 = (struct ip6_t *)packet;
+    struct ip6_srh_t *srh = (struct ip6_srh_t *)(packet + TEST_SRH_OFFSET);
+    ip6->payload_len = htons(length - 40);
+    srh->hdrlen += sizeof(tlv) >> 3;
+    srh->segments_left -= 1;
+    memcpy(&ip6->dst_hi, srh->segments[srh->segments_left].addr, 16);
+    ip6->hop_limit -= 1;
+    return length;
+}
+
+// The decoder removes the source TLV of *packet* with seg6_delete_tlv2 before storing it (storePacket_decode_pool).
+// bpf_lwt_seg6_adjust_srh updates the length of the IPv6 payload at once, but the SRH length only when the program returns,
+// so the stored packet still has the SRH length with the TLV. Returns the length of the stored packet
+static uint16_t test__store_at_decoder(uint8_t *packet, uint16_t length) {
+    uint16_t tlv_length = sizeof(struct tlvSource__convo_t);
+    memmove(packet + TEST_TLV_OFFSET, packet + TEST_TLV_OFFSET + tlv_length, length - TEST_TLV_OFFSET - tlv_length);
+    length -= tlv_length;
+    ((struct ip6_t *)packet)->payload_len = htons(length - 40);
+    cleanPacket_decode(packet, tlv_length);
+    return length;
+}
+
+// The source symbol stored by the decoder must be the one coded by the encoder
+static void test__source_symbol_round_trip() {
+    static uint8_t packet[MAX_PACKET_SIZE];
+    static uint8_t encoded[MAX_PACKET_SIZE];
+    uint16_t length = test__source_packet(packet, 200, 1);
+
+    // Stored (then coded) by the encoder before it adds the TLV
+    memcpy(encoded, packet, length);
+    test_encoder__clean_packet(encoded);
+
+    uint16_t received_length = test__forward_to_decoder(packet, length, 42);
+    uint16_t stored_length = test__store_at_decoder(packet, received_length);
+    CHECK(stored_length == length, "stored length %u instead of %u", stored_length, length);
+    int diff = test__first_difference(packet, encoded, length);
+    CHECK(diff < 0, "byte %d of the stored source symbol differs from the coded one", diff);
+}
+
+static const size_t test_pool_strides[3] = {
+    SYMBOL_POOL_STRIDE(symbol_small_t), SYMBOL_POOL_STRIDE(symbol_medium_t), SYMBOL_POOL_STRIDE(symbol_large_t),
+};
+
+int test_pool__create(test_pool_t *pool, uint32_t slots, uint32_t shares) {
+    memset(pool, 0, sizeof(test_pool_t));
+    pool->slots = slots;
+    pool->shares = shares;
+    for (int c = 0; c < 3; ++c) {
+        size_t size = shares * slots * test_pool_strides[c];
+        pool->fds[c] = memfd_create("test_pool", 0);
+        if (pool->fds[c] < 0 || ftruncate(pool->fds[c], size) < 0) {
+            test_pool__destroy(pool);
+            return -1;
+        }
+        void *class = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, pool->fds[c], 0);
+        if (class == MAP_FAILED) {
+            test_pool__destroy(pool);
+            return -1;
+        }
+        pool->classes[c] = class;
+    }
+    return 0;
+}
+
+void test_pool__store(test_pool_t *pool, uint32_t share, uint32_t encodingSymbolID, const uint8_t *packet, uint16_t length) {
+    int c = length <= SYMBOL_SMALL_SIZE ? 0 : length <= SYMBOL_MEDIUM_SIZE ? 1 : 2;
+    symbol_slot_t *slot = (symbol_slot_t *)(pool->classes[c] + SYMBOL_POOL_INDEX(encodingSymbolID, pool->slots, share) * test_pool_strides[c]);
+    slot->encodingSymbolID = encodingSymbolID;
+    slot->packet_length = length;
+    memcpy(slot->packet, packet, length);
+}
+
+void test_pool__destroy(test_pool_t *pool) {
+    for (int c = 0; c < 3; ++c) {
+        if (pool->classes[c]) munmap(pool->classes[c], pool->shares * pool->slots * test_pool_strides[c]);
+        if (pool->fds[c] > 0) close(pool->fds[c]);
+    }
+    memset(pool, 0, sizeof(test_pool_t));
+}
+
+// The table gives the coefficients generated from each repairKey for any window size
+static void test__coefficient_table() {
+    const uint16_t keys[] = {0, 1, 2, 255, 4242, 0xffff};
+    const int window_sizes[] = {1, 5, MAX_RLC_WINDOW_SIZE};
+    tinymt32_t prng;
+    prng.mat1 = 0x8f7011ee;
+    prng.mat2 = 0xfc78ff1f;
+    prng.tmat = 0x3793fdff;
+
+    rlc_coefs__init();
+    for (int k = 0; k < sizeof(keys) / sizeof(keys[0]); ++k) {
+        for (int w = 0; w < sizeof(window_sizes) / sizeof(window_sizes[0]); ++w) {
+            uint8_t coefs[MAX_RLC_WINDOW_SIZE];
+            rlc__get_coefs(&prng, keys[k], window_sizes[w], coefs);
+            CHECK(memcmp(coefs, rlc_coefs__get(keys[k]), window_sizes[w]) == 0,
+                  "coefficients of the repairKey %u for a window of %d symbols", keys[k], window_sizes[w]);
+        }
+    }
+    // A null coefficient would remove a source symbol from the repair symbol
+    int zeros = 0;
+    for (uint32_t repairKey = 0; repairKey < RLC_COEFS_KEYS; ++repairKey) {
+        zeros += memchr(rlc_coefs__get(repairKey), 0, MAX_RLC_WINDOW_SIZE) != NULL;
+    }
+    CHECK(zeros == 0, "%d repairKeys with a null coefficient", zeros);
+}
+
+#define TEST_SYMBOLS 48 // More than RLC_RECEIVER_BUFFER_SIZE: the decoder retires its oldest symbols
+#define TEST_MAX_REPAIRS (TEST_SYMBOLS * MAX_RLC_RS_NUMBER)
+
+// Source symbols of a stream as coded by the encoder and as stored by the decoder
+typedef struct {
+    uint8_t *encoded[TEST_SYMBOLS];
+    uint8_t *stored[TEST_SYMBOLS];
+    uint16_t lengths[TEST_SYMBOLS];
+} test_stream_t;
+
+// Some of the symbols do not fit the small class of the pools
+static int test__stream_init(test_stream_t *stream) {
+    static uint8_t packet[MAX_PACKET_SIZE];
+    memset(stream, 0, sizeof(test_stream_t));
+    for (uint32_t i = 0; i < TEST_SYMBOLS; ++i) {
+        stream->encoded[i] = malloc(MAX_PACKET_SIZE);
+        stream->stored[i] = malloc(MAX_PACKET_SIZE);
+        if (!stream->encoded[i] || !stream->stored[i]) return -1;
+        uint16_t length = test__source_packet(packet, 60 + (i * 389) % 2600, i + 1);
+        memcpy(stream->encoded[i], packet, length);
+        test_encoder__clean_packet(stream->encoded[i]);
+        uint16_t received_length = test__forward_to_decoder(packet, length, i);
+        test__store_at_decoder(packet, received_length);
+        memcpy(stream->stored[i], packet, length);
+        stream->lengths[i] = length;
+    }
+    return 0;
+}
+
+static void test__stream_free(test_stream_t *stream) {
+    for (uint32_t i = 0; i < TEST_SYMBOLS; ++i) {
+        free(stream->encoded[i]);
+        free(stream->stored[i]);
+    }
+}
+
+static test_stream_t *test_recovered_stream = NULL; // Expected content of the recovered symbols
+static int test_recovered[TEST_SYMBOLS]; // Number of times each source symbol was recovered
+
+// Checks the recovered symbol instead of sending it
+int send_raw_socket_recovered(int sfd, const void *repairSymbol_void, struct sockaddr_in6 local_addr) {
+    const recoveredSource_t *recovered = (const recoveredSource_t *)repairSymbol_void;
+    uint32_t id = recovered->encodingSymbolID;
+    if (id >= TEST_SYMBOLS) {
+        CHECK(false, "recovered the unknown source symbol %u", id);
+        return -1;
+    }
+    CHECK(recovered->packet_length == test_recovered_stream->lengths[id], "length %u of the recovered source symbol %u instead of %u",
+          recovered->packet_length, id, test_recovered_stream->lengths[id]);
+    int diff = test__first_difference(recovered->packet, test_recovered_stream->stored[id], test_recovered_stream->lengths[id]);
+    CHECK(diff < 0, "byte %d of the recovered source symbol %u differs", diff, id);
+    ++test_recovered[id];
+    return 0;
+}
+
+int queue_raw_socket_recovered(raw_socket_batch_t *batch, const void *repairSymbol_void, struct sockaddr_in6 local_addr) {
+    return send_raw_socket_recovered(-1, repairSymbol_void, local_addr);
+}
+
+void raw_socket_batch__free(raw_socket_batch_t *batch) {
+}
+
+// The decoder receives the source symbols of *stream* and the *nb_repairs* repair symbols *repairs* in order, except the lost ones.
+// They are stored like the eBPF program (receiveRepairSymbol__convolution) and each repair symbol triggers a recovery.
+// The recovered symbols are checked by send_raw_socket_recovered
+static void test__decode(test_stream_t *stream, test_repair_symbol_t *repairs, int nb_repairs, const bool *lost_sources, const bool *lost_repairs) {
+    static fecConvolution_t fecConvolution;
+    test_pool_t sourcePool, repairPool;
+    struct sockaddr_in6 local_addr;
+    memset(&fecConvolution, 0, sizeof(fecConvolution_t));
+    memset(&local_addr, 0, sizeof(local_addr));
+    memset(test_recovered, 0, sizeof(test_recovered));
+    test_recovered_stream = stream;
+
+    decode_rlc_t *rlc = initialize_rlc_decode(1);
+    bool ready = rlc && test_pool__create(&sourcePool, RLC_RECEIVER_BUFFER_SIZE, 1) == 0 &&
+                 test_pool__create(&repairPool, RLC_RECEIVER_REPAIR_SLOTS, 1) == 0 &&
+                 symbol_pool__mmap(&rlc->sourcePool, sourcePool.fds[0], sourcePool.fds[1], sourcePool.fds[2], RLC_RECEIVER_BUFFER_SIZE, 1) == 0 &&
+                 symbol_pool__mmap(&rlc->repairPool, repairPool.fds[0], repairPool.fds[1], repairPool.fds[2], RLC_RECEIVER_REPAIR_SLOTS, 1) == 0;
+    CHECK(ready, "cannot create the decoder");
+
+    int r = 0;
+    for (uint32_t id = 0; id < TEST_SYMBOLS && ready; ++id) {
+        if (!lost_sources[id]) {
+            struct tlvSource__convo_t *tlv = &fecConvolution.sourceTlvBuffer[id % RLC_RECEIVER_BUFFER_SIZE];
+            tlv->tlv_type = TLV_CODING_SOURCE;
+            tlv->encodingSymbolID = id;
+            test_pool__store(&sourcePool, 0, id, stream->stored[id], stream->lengths[id]);
+        }
+        for (; r < nb_repairs && repairs[r].tlv.encodingSymbolID == id; ++r) {
+            if (lost_repairs[r]) continue;
+            uint8_t k = RLC_REPAIR_INDEX(repairs[r].tlv.repairFecInfo);
+            window_info_t *window_info = &fecConvolution.windowInfoBuffer[id % RLC_RECEIVER_BUFFER_SIZE];
+            if (window_info->encodingSymbolID != id || window_info->repair_mask == 0) {
+                window_info->repair_mask = 0;
+                window_info->encodingSymbolID = id;
+            }
+            test_pool__store(&repairPool, 0, RLC_REPAIR_SYMBOL_ID(id, k), repairs[r].packet, repairs[r].packet_length);
+            window_info->packet_length[k] = repairs[r].packet_length;
+            window_info->repair_mask |= 1 << k;
+            memcpy(&window_info->tlv[k], &repairs[r].tlv, sizeof(struct tlvRepair__convo_t));
+            fecConvolution.encodingSymbolID = id;
+            CHECK(rlc__fec_recover(&fecConvolution, rlc, -1, local_addr) >= 0, "recovery error at the repair symbol %d", r);
+        }
+    }
+
+    if (rlc) free_rlc_decode(rlc);
+    test_pool__destroy(&sourcePool);
+    test_pool__destroy(&repairPool);
+}
+
+// Encoding the source symbols as they arrive gives the same repair symbols as encoding each window from the pool
+static void test__incremental_encoding() {
+    static test_stream_t stream;
+    static test_repair_symbol_t full[TEST_MAX_REPAIRS];
+    static test_repair_symbol_t incremental[TEST_MAX_REPAIRS];
+    const uint8_t parameters[][3] = {{4, 2, 1}, {10, 4, 2}, {MAX_RLC_WINDOW_SIZE, 5, MAX_RLC_RS_NUMBER}}; // Size, slide, repair symbols
+    CHECK(test__stream_init(&stream) == 0, "cannot create the stream");
+
+    for (int p = 0; p < sizeof(parameters) / sizeof(parameters[0]); ++p) {
+        int nb_full = test_encoder__encode(stream.encoded, stream.lengths, TEST_SYMBOLS, parameters[p][0], parameters[p][1], parameters[p][2], false, full, TEST_MAX_REPAIRS);
+        int nb_incremental = test_encoder__encode(stream.encoded, stream.lengths, TEST_SYMBOLS, parameters[p][0], parameters[p][1], parameters[p][2], true, incremental, TEST_MAX_REPAIRS);
+        CHECK(nb_full > 0 && nb_full == nb_incremental, "%d repair symbols encoded incrementally instead of %d", nb_incremental, nb_full);
+        for (int r = 0; r < nb_full && r < nb_incremental; ++r) {
+            CHECK(memcmp(&full[r].tlv, &incremental[r].tlv, sizeof(struct tlvRepair__convo_t)) == 0, "TLV of the repair symbol %d (window %d)", r, p);
+            CHECK(full[r].packet_length == incremental[r].packet_length, "length of the repair symbol %d (window %d)", r, p);
+            int diff = test__first_difference(full[r].packet, incremental[r].packet, full[r].packet_length);
+            CHECK(diff < 0, "byte %d of the repair symbol %d differs (window %d)", diff, r, p);
+        }
+    }
+    test__stream_free(&stream);
+}
+
+// The lost source symbols are recovered from the repair symbols, also if some of them are lost or if a burst is not recoverable
+static void test__recover_losses() {
+    static test_stream_t stream;
+    static test_repair_symbol_t repairs[TEST_MAX_REPAIRS];
+    CHECK(test__stream_init(&stream) == 0, "cannot create the stream");
+    // Windows of 10 symbols every 4 symbols, the last ones end with the symbols 41 and 45
+    int nb_repairs = test_encoder__encode(stream.encoded, stream.lengths, TEST_SYMBOLS, 10, 4, 2, false, repairs, TEST_MAX_REPAIRS);
+    CHECK(nb_repairs > 0, "cannot encode the stream");
+
+    // Single losses, bursts and lost repair symbols, after the ring buffers of the decoder wrapped around
+    bool lost_sources[TEST_SYMBOLS] = {false};
+    bool lost_repairs[TEST_MAX_REPAIRS] = {false};
+    const uint32_t losses[] = {3, 12, 13, 20, 21, 22, 34, 37, 41};
+    for (int i = 0; i < sizeof(losses) / sizeof(losses[0]); ++i) {
+        lost_sources[losses[i]] = true;
+    }
+    lost_repairs[6] = true;
+    test__decode(&stream, repairs, nb_repairs, lost_sources, lost_repairs);
+    for (uint32_t id = 0; id < TEST_SYMBOLS; ++id) {
+        CHECK(test_recovered[id] == lost_sources[id], "source symbol %u recovered %d times", id, test_recovered[id]);
+    }
+
+    // A burst longer than the repair symbols of its windows: only the other loss is recovered
+    memset(lost_sources, 0, sizeof(lost_sources));
+    memset(lost_repairs, 0, sizeof(lost_repairs));
+    for (uint32_t id = 16; id < 28; ++id) {
+        lost_sources[id] = true;
+    }
+    lost_sources[5] = true;
+    test__decode(&stream, repairs, nb_repairs, lost_sources, lost_repairs);
+    CHECK(test_recovered[5] == 1, "source symbol 5 recovered %d times", test_recovered[5]);
+    test__stream_free(&stream);
+}
+
+int main() {
+    test__source_symbol_round_trip();
+    test__coefficient_table();
+    test__incremental_encoding();
+    test__recover_losses();
+
+    if (failures) {
+        fprintf(stderr, "%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("All tests passed\n");
+    return 0;
+}
@@ -0,0 +1,44 @@
+#ifndef TEST_RLC_GF256_H_
+#define TEST_RLC_GF256_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <linux/types.h>
+#include "../../fec_srv6.h"
+
+// Encoder side of the tests (test_rlc_gf256_encoder.c). It is a separate translation unit
+// because encoder.h and decoder.h define different structures with the same names
+
+// Repair symbol generated by the encoder, with its TLV as received by the decoder
+typedef struct {
+    struct tlvRepair__convo_t tlv;
+    uint16_t packet_length;
+    uint8_t packet[MAX_PACKET_SIZE];
+} test_repair_symbol_t;
+
+// Writable side of a pool of symbols, i.e. the side of the eBPF programs. The classes are memfds:
+// user space maps them (read-only) with symbol_pool__mmap() like the maps of the programs
+typedef struct {
+    int fds[3]; // Small, medium and large classes
+    uint8_t *classes[3];
+    uint32_t slots;
+    uint32_t shares;
+} test_pool_t;
+
+int test_pool__create(test_pool_t *pool, uint32_t slots, uint32_t shares);
+// Stores the symbol in the smallest class that can hold it, like symbol_pool_store()
+void test_pool__store(test_pool_t *pool, uint32_t share, uint32_t encodingSymbolID, const uint8_t *packet, uint16_t length);
+void test_pool__destroy(test_pool_t *pool);
+
+// Clears the fields of a stored source symbol that vary in the network, like the encoder (cleanPacket)
+void test_encoder__clean_packet(uint8_t *packet);
+
+// Encodes the *n* source symbols *packets* (as stored by the encoder) of the stream 0 like the eBPF program and user space:
+// one window of *window_size* symbols every *window_slide* symbols with *nrs* repair symbols, the first repair key being 1.
+// With *incremental*, the source symbols are folded in the windows as they arrive (rlc__fold_source_symbol), otherwise the
+// windows are encoded from the pool when they are complete. The repair symbols are written in order in *repairs*.
+// Returns their number, or -1 if a window cannot be encoded
+int test_encoder__encode(uint8_t **packets, uint16_t *lengths, int n, uint8_t window_size, uint8_t window_slide, uint8_t nrs,
+                         bool incremental, test_repair_symbol_t *repairs, int max_repairs);
+
+#endif
@@ -0,0 +1,96 @@
+#include <stdlib.h>
+#include <string.h> // Before the eBPF sources, which define memcpy and memset as builtins
+#include "../../fec_framework/store_packet_sender.c"
+#include "rlc_gf256.c"
+#include "test_rlc_gf256.h"
+
+// The repair symbols are taken from rlc->repairSymbols, nothing is sent
+int send_raw_socket(int sfd, const struct repairSymbol_t *repairSymbol, struct sockaddr_in6 src, struct sockaddr_in6 dst) {
+    return -1;
+}
+
+int queue_raw_socket(raw_socket_batch_t *batch, const struct repairSymbol_t *repairSymbol, struct sockaddr_in6 src, struct sockaddr_in6 dst) {
+    return -1;
+}
+
+void test_encoder__clean_packet(uint8_t *packet) {
+    cleanPacket(packet);
+}
+
+// Repair TLVs of the window ending with *encodingSymbolID*, see fecScheme__convoRLC_repairTlvs()
+static void test_encoder__window(fecConvolution_user_t *descriptor, uint32_t encodingSymbolID, uint16_t repairKey,
+                                 uint8_t window_size, uint8_t window_slide, uint8_t nrs) {
+    memset(descriptor, 0, sizeof(fecConvolution_user_t));
+    descriptor->message_type = RLC_WINDOW_DESCRIPTOR;
+    descriptor->encodingSymbolID = encodingSymbolID;
+    descriptor->repairSymbols = nrs;
+    for (uint8_t r = 0; r < nrs; ++r) {
+        struct tlvRepair__convo_t *tlv = &descriptor->repairTlv[r];
+        tlv->tlv_type = TLV_CODING_REPAIR;
+        tlv->len = sizeof(struct tlvRepair__convo_t) - 2;
+        tlv->encodingSymbolID = encodingSymbolID;
+        tlv->repairFecInfo = (15 << (16 + 8)) + (r << 20) + (window_slide << 16) + (uint16_t)(repairKey + r + 1);
+        tlv->nss = window_size;
+        tlv->nrs = nrs;
+    }
+}
+
+int test_encoder__encode(uint8_t **packets, uint16_t *lengths, int n, uint8_t window_size, uint8_t window_slide, uint8_t nrs,
+                         bool incremental, test_repair_symbol_t *repairs, int max_repairs) {
+    test_pool_t pool;
+    encode_rlc_t *rlc = NULL;
+    int nb_repairs = -1;
+    uint16_t repairKey = 0;
+    uint8_t ringBuffSize = 0;
+
+    if (test_pool__create(&pool, RLC_BUFFER_SIZE, 1) < 0) {
+        return -1;
+    }
+    rlc = initialize_rlc();
+    if (!rlc || symbol_pool__mmap(&rlc->sourcePool, pool.fds[0], pool.fds[1], pool.fds[2], RLC_BUFFER_SIZE, 1) < 0 ||
+            (incremental && rlc__enable_incremental(rlc) < 0)) {
+        goto cleanup;
+    }
+
+    nb_repairs = 0;
+    for (uint32_t encodingSymbolID = 0; encodingSymbolID < n; ++encodingSymbolID) {
+        test_pool__store(&pool, 0, encodingSymbolID, packets[encodingSymbolID], lengths[encodingSymbolID]);
+        ++ringBuffSize;
+        if (incremental) {
+            source_notification_t notification = {
+                .message_type = RLC_SOURCE_NOTIFICATION,
+                .encodingSymbolID = encodingSymbolID,
+                .repairKey = repairKey,
+                .ringBuffSize = ringBuffSize,
+                .windowSize = window_size,
+                .windowSlide = window_slide,
+                .repairSymbols = nrs,
+            };
+            rlc__fold_source_symbol(rlc, &notification);
+        }
+        if (ringBuffSize < window_size) {
+            continue;
+        }
+
+        fecConvolution_user_t descriptor;
+        test_encoder__window(&descriptor, encodingSymbolID, repairKey, window_size, window_slide, nrs);
+        repairKey += nrs;
+        ringBuffSize = window_size - window_slide;
+        // The incremental encoding must not fall back on the encoding from the pool
+        if (incremental ? !rlc__take_pending_window(&descriptor, rlc, nrs) : rlc__generate_window_repair_symbols(&descriptor, rlc, nrs) < 0) {
+            nb_repairs = -1;
+            goto cleanup;
+        }
+        for (uint8_t r = 0; r < nrs && nb_repairs < max_repairs; ++r) {
+            test_repair_symbol_t *repair = &repairs[nb_repairs++];
+            memcpy(&repair->tlv, rlc->repairSymbols[r]->tlv, sizeof(struct tlvRepair__convo_t));
+            repair->packet_length = rlc->repairSymbols[r]->packet_length;
+            memcpy(repair->packet, rlc->repairSymbols[r]->packet, repair->packet_length);
+        }
+    }
+
+cleanup:
+    if (rlc) free_rlc(rlc);
+    test_pool__destroy(&pool);
+    return nb_repairs;
+}
@@ -22,8 +22,66 @@
 
 #define BPF_PACKET_HEADER __attribute__((packed))
 
+// An encodingSymbolID is made of the stream of the encoder (high bits) and of the sequence number
+// of the symbol in this stream (low bits). An encoder with per-CPU state has one stream per CPU,
+// else everything is in stream 0. The arithmetic on the IDs must stay in the stream
+#define ESI_SEQ_BITS 24
+#define ESI_SEQ_MASK ((1U << ESI_SEQ_BITS) - 1)
+#define MAX_ENCODER_STREAMS (1U << (32 - ESI_SEQ_BITS))
+#define ESI_STREAM(id) ((__u32)(id) >> ESI_SEQ_BITS)
+#define ESI_ADD(id, n) (((id) & ~ESI_SEQ_MASK) | (((id) + (n)) & ESI_SEQ_MASK))
+#define ESI_SUB(id, n) ESI_ADD(id, -(n))
+#define ESI_DIFF(a, b) (((a) - (b)) & ESI_SEQ_MASK) // Number of symbols from b to a in the same stream
+
+// Size-classed storage of the symbols. A symbol is stored in the smallest class that
+// can hold it, at the slot SYMBOL_POOL_INDEX: the classes are divided in shares, one per stream of
+// encodingSymbolIDs on the encoder and one per decoding context on the decoder.
+// Every class has as many slots per share as the ring of symbols it stores: a window of large symbols
+// must be readable as well as a window of small ones. Only the bytes per slot differ between the classes.
+// The sizes must be powers of 2 for the eBPF verifier.
+#define SYMBOL_SMALL_SIZE 2048 // Fits MTU-sized packets with their SRH
+#define SYMBOL_MEDIUM_SIZE 16384 // Fits jumbo frames
+#define SYMBOL_LARGE_SIZE MAX_PACKET_SIZE
+// The length of a stored symbol is a __u16 and 0 marks an empty slot
+#define MAX_SYMBOL_LENGTH (MAX_PACKET_SIZE - 1)
+// Slot of *id* in the share *share* of a class of *slots* slots per share (a power of 2 dividing 1 << ESI_SEQ_BITS)
+#define SYMBOL_POOL_INDEX(id, slots, share) ((share) * (slots) + (id) % (slots))
+
+// Header of a slot of any class
+typedef struct {
+    __u32 encodingSymbolID; // Of the symbol in the slot, used to detect overwritten slots
+    __u16 packet_length; // 0 if the slot was never used
+    __u16 padding;
+    __u8 packet[];
+} symbol_slot_t;
+
+#define SYMBOL_SLOT(size) struct { \
+    __u32 encodingSymbolID; \
+    __u16 packet_length; \
+    __u16 padding; \
+    __u8 packet[size]; \
+}
+
+typedef SYMBOL_SLOT(SYMBOL_SMALL_SIZE) symbol_small_t;
+typedef SYMBOL_SLOT(SYMBOL_MEDIUM_SIZE) symbol_medium_t;
+typedef SYMBOL_SLOT(SYMBOL_LARGE_SIZE) symbol_large_t;
+
+// User space view of a pool, the classes are mmapped maps (see symbol_pool/symbol_pool.c)
+typedef struct {
+    __u8 *small;
+    __u8 *medium;
+    __u8 *large;
+    __u32 slots; // Number of slots of the small class per share
+    __u32 shares; // Number of shares of the classes
+} symbol_pool_t;
+
 // Block FEC Framework
 #define MAX_BLOCK_SIZE 10
+// Number of blocks kept by the decoder for each stream of the encoder, at the index sourceBlockNb % (MAX_BLOCK * streams)
+#define MAX_BLOCK 5
+// Number of block numbers of each of the *streams* interleaved streams of an encoder. The per-stream counter wraps at a
+// multiple of MAX_BLOCK so that the block numbers of a stream keep their residue class at the decoder
+#define BLOCK_NUMBERS(streams) ((0x10000 / (streams)) / MAX_BLOCK * MAX_BLOCK)
 
 struct tlvSource__block_t {
     __u8 tlv_type;
@@ -49,12 +107,17 @@ struct tlvRepair__block_t {
 #define MAX_RLC_WINDOW_SIZE 16
 #define MAX_RLC_WINDOW_SLIDE 5
 #define MAX_RLC_REPAIR_GEN 8
+// Maximum number of repair symbols per window (a power of 2). The position of a repair symbol
+// in its window is carried in the bits 20 to 23 of repairFecInfo
+#define MAX_RLC_RS_NUMBER 4
+#define RLC_REPAIR_INDEX(repairFecInfo) (((repairFecInfo) >> 20) & 0xf)
 
 struct tlvSource__convo_t {
     __u8 tlv_type;
     __u8 len;
     __u16 controller_update;
     __u32 encodingSymbolID;
+    __u8 encoder[16]; // SID of the encoder, source of its repair symbols. With the stream of encodingSymbolID, identifies the decoding context
 } BPF_PACKET_HEADER;
 
 struct tlvRepair__convo_t {
@@ -72,7 +135,7 @@ struct tlvRepair__convo_t {
 typedef struct {
     __u8 tlv_type;
     __u8 len;
-    __u16 padding;
+    __u16 loss_bursts; // Number of runs of consecutive lost source symbols in the period (0 if not counted by the decoder)
     __u16 received_counter;
     __u16 theoretical_counter;
 } tlv_controller_t;
@@ -6,6 +6,8 @@
 #define gf256_add(a, b) (a^b)
 #define gf256_sub gf256_add
 #include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
 
 uint8_t gf256_mul(uint8_t a, uint8_t b, uint8_t *mul) { 
     return mul[a * 256 + b];
@@ -25,6 +27,349 @@ uint8_t gf256_mul_formula(uint8_t a, uint8_t b) {
     return p;
 }
 
+// Scalar kernels, used as fallback and to process the tail of the symbols in the vectorized kernels
+static void symbol_add_scaled_scalar(uint8_t *data1, uint8_t coef, const uint8_t *data2, uint32_t symbol_size, uint8_t *mul) {
+    for (uint32_t i=0; i<symbol_size; i++) {
+        data1[i] ^= gf256_mul(coef, data2[i], mul);
+    }
+}
+
+static void symbol_mul_scalar(uint8_t *data1, uint8_t coef, uint32_t symbol_size, uint8_t *mul) {
+    for (uint32_t i=0; i<symbol_size; i++) {
+        data1[i] = gf256_mul(coef, data1[i], mul);
+    }
+}
+
+// Maximum number of symbols updated at once by the fused kernels (symbol_add_scaled_multi)
+#define SYMBOL_MAX_FUSED 4
+// The callers of the fused kernels process the symbols by tiles of this size: the tiles of
+// SYMBOL_MAX_FUSED accumulators and of the added symbols stay in a 32 KB L1 cache
+#define SYMBOL_TILE_SIZE 4096
+
+// The vectorized kernels use the split-nibble method: coef * x = coef * (x & 0xf) ^ coef * (x & 0xf0),
+// both products being looked up in a 16-entry table with a byte shuffle (PSHUFB / TBL)
+static void gf256_nibble_tables(uint8_t coef, uint8_t *mul, uint8_t *low, uint8_t *high) {
+    for (int i = 0; i < 16; ++i) {
+        low[i] = gf256_mul(coef, i, mul);
+        high[i] = gf256_mul(coef, i << 4, mul);
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+#define SWIF_SIMD_X86
+
+__attribute__((target("ssse3")))
+static void symbol_add_scaled_ssse3(uint8_t *data1, uint8_t coef, const uint8_t *data2, uint32_t symbol_size, uint8_t *mul) {
+    uint8_t low[16], high[16];
+    gf256_nibble_tables(coef, mul, low, high);
+    const __m128i t_low = _mm_loadu_si128((const __m128i *)low);
+    const __m128i t_high = _mm_loadu_si128((const __m128i *)high);
+    const __m128i mask = _mm_set1_epi8(0x0f);
+    uint32_t i = 0;
+    for (; i + 16 <= symbol_size; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(data2 + i));
+        __m128i l = _mm_shuffle_epi8(t_low, _mm_and_si128(x, mask));
+        __m128i h = _mm_shuffle_epi8(t_high, _mm_and_si128(_mm_srli_epi64(x, 4), mask));
+        __m128i d = _mm_loadu_si128((const __m128i *)(data1 + i));
+        _mm_storeu_si128((__m128i *)(data1 + i), _mm_xor_si128(d, _mm_xor_si128(l, h)));
+    }
+    symbol_add_scaled_scalar(data1 + i, coef, data2 + i, symbol_size - i, mul);
+}
+
+__attribute__((target("ssse3")))
+static void symbol_mul_ssse3(uint8_t *data1, uint8_t coef, uint32_t symbol_size, uint8_t *mul) {
+    uint8_t low[16], high[16];
+    gf256_nibble_tables(coef, mul, low, high);
+    const __m128i t_low = _mm_loadu_si128((const __m128i *)low);
+    const __m128i t_high = _mm_loadu_si128((const __m128i *)high);
+    const __m128i mask = _mm_set1_epi8(0x0f);
+    uint32_t i = 0;
+    for (; i + 16 <= symbol_size; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(data1 + i));
+        __m128i l = _mm_shuffle_epi8(t_low, _mm_and_si128(x, mask));
+        __m128i h = _mm_shuffle_epi8(t_high, _mm_and_si128(_mm_srli_epi64(x, 4), mask));
+        _mm_storeu_si128((__m128i *)(data1 + i), _mm_xor_si128(l, h));
+    }
+    symbol_mul_scalar(data1 + i, coef, symbol_size - i, mul);
+}
+
+// Fused kernels: data1[r] += coefs[r] * data2 for the n (at most SYMBOL_MAX_FUSED) symbols of data1.
+// Each vector of data2 is loaded and split in nibbles once for all the products
+__attribute__((target("ssse3")))
+static void symbol_add_scaled_multi_ssse3(uint8_t **data1, const uint8_t *coefs, int n, const uint8_t *data2, uint32_t symbol_size, uint8_t *mul) {
+    __m128i t_low[SYMBOL_MAX_FUSED], t_high[SYMBOL_MAX_FUSED];
+    for (int r = 0; r < n; ++r) {
+        uint8_t low[16], high[16];
+        gf256_nibble_tables(coefs[r], mul, low, high);
+        t_low[r] = _mm_loadu_si128((const __m128i *)low);
+        t_high[r] = _mm_loadu_si128((const __m128i *)high);
+    }
+    const __m128i mask = _mm_set1_epi8(0x0f);
+    uint32_t i = 0;
+    for (; i + 16 <= symbol_size; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(data2 + i));
+        __m128i x_low = _mm_and_si128(x, mask);
+        __m128i x_high = _mm_and_si128(_mm_srli_epi64(x, 4), mask);
+        for (int r = 0; r < n; ++r) {
+            __m128i p = _mm_xor_si128(_mm_shuffle_epi8(t_low[r], x_low), _mm_shuffle_epi8(t_high[r], x_high));
+            __m128i d = _mm_loadu_si128((const __m128i *)(data1[r] + i));
+            _mm_storeu_si128((__m128i *)(data1[r] + i), _mm_xor_si128(d, p));
+        }
+    }
+    for (int r = 0; r < n; ++r) {
+        symbol_add_scaled_scalar(data1[r] + i, coefs[r], data2 + i, symbol_size - i, mul);
+    }
+}
+
+__attribute__((target("avx2")))
+static void symbol_add_scaled_avx2(uint8_t *data1, uint8_t coef, const uint8_t *data2, uint32_t symbol_size, uint8_t *mul) {
+    uint8_t low[16], high[16];
+    gf256_nibble_tables(coef, mul, low, high);
+    const __m256i t_low = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)low));
+    const __m256i t_high = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)high));
+    const __m256i mask = _mm256_set1_epi8(0x0f);
+    uint32_t i = 0;
+    for (; i + 32 <= symbol_size; i += 32) {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(data2 + i));
+        __m256i l = _mm256_shuffle_epi8(t_low, _mm256_and_si256(x, mask));
+        __m256i h = _mm256_shuffle_epi8(t_high, _mm256_and_si256(_mm256_srli_epi64(x, 4), mask));
+        __m256i d = _mm256_loadu_si256((const __m256i *)(data1 + i));
+        _mm256_storeu_si256((__m256i *)(data1 + i), _mm256_xor_si256(d, _mm256_xor_si256(l, h)));
+    }
+    symbol_add_scaled_scalar(data1 + i, coef, data2 + i, symbol_size - i, mul);
+}
+
+__attribute__((target("avx2")))
+static void symbol_mul_avx2(uint8_t *data1, uint8_t coef, uint32_t symbol_size, uint8_t *mul) {
+    uint8_t low[16], high[16];
+    gf256_nibble_tables(coef, mul, low, high);
+    const __m256i t_low = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)low));
+    const __m256i t_high = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)high));
+    const __m256i mask = _mm256_set1_epi8(0x0f);
+    uint32_t i = 0;
+    for (; i + 32 <= symbol_size; i += 32) {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(data1 + i));
+        __m256i l = _mm256_shuffle_epi8(t_low, _mm256_and_si256(x, mask));
+        __m256i h = _mm256_shuffle_epi8(t_high, _mm256_and_si256(_mm256_srli_epi64(x, 4), mask));
+        _mm256_storeu_si256((__m256i *)(data1 + i), _mm256_xor_si256(l, h));
+    }
+    symbol_mul_scalar(data1 + i, coef, symbol_size - i, mul);
+}
+
+__attribute__((target("avx2")))
+static void symbol_add_scaled_multi_avx2(uint8_t **data1, const uint8_t *coefs, int n, const uint8_t *data2, uint32_t symbol_size, uint8_t *mul) {
+    __m256i t_low[SYMBOL_MAX_FUSED], t_high[SYMBOL_MAX_FUSED];
+    for (int r = 0; r < n; ++r) {
+        uint8_t low[16], high[16];
+        gf256_nibble_tables(coefs[r], mul, low, high);
+        t_low[r] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)low));
+        t_high[r] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)high));
+    }
+    const __m256i mask = _mm256_set1_epi8(0x0f);
+    uint32_t i = 0;
+    for (; i + 32 <= symbol_size; i += 32) {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(data2 + i));
+        __m256i x_low = _mm256_and_si256(x, mask);
+        __m256i x_high = _mm256_and_si256(_mm256_srli_epi64(x, 4), mask);
+        for (int r = 0; r < n; ++r) {
+            __m256i p = _mm256_xor_si256(_mm256_shuffle_epi8(t_low[r], x_low), _mm256_shuffle_epi8(t_high[r], x_high));
+            __m256i d = _mm256_loadu_si256((const __m256i *)(data1[r] + i));
+            _mm256_storeu_si256((__m256i *)(data1[r] + i), _mm256_xor_si256(d, p));
+        }
+    }
+    for (int r = 0; r < n; ++r) {
+        symbol_add_scaled_scalar(data1[r] + i, coefs[r], data2 + i, symbol_size - i, mul);
+    }
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void symbol_add_scaled_avx512(uint8_t *data1, uint8_t coef, const uint8_t *data2, uint32_t symbol_size, uint8_t *mul) {
+    uint8_t low[16], high[16];
+    gf256_nibble_tables(coef, mul, low, high);
+    const __m512i t_low = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *)low));
+    const __m512i t_high = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *)high));
+    const __m512i mask = _mm512_set1_epi8(0x0f);
+    uint32_t i = 0;
+    for (; i + 64 <= symbol_size; i += 64) {
+        __m512i x = _mm512_loadu_si512((const void *)(data2 + i));
+        __m512i l = _mm512_shuffle_epi8(t_low, _mm512_and_si512(x, mask));
+        __m512i h = _mm512_shuffle_epi8(t_high, _mm512_and_si512(_mm512_srli_epi64(x, 4), mask));
+        __m512i d = _mm512_loadu_si512((const void *)(data1 + i));
+        _mm512_storeu_si512((void *)(data1 + i), _mm512_xor_si512(d, _mm512_xor_si512(l, h)));
+    }
+    symbol_add_scaled_scalar(data1 + i, coef, data2 + i, symbol_size - i, mul);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void symbol_mul_avx512(uint8_t *data1, uint8_t coef, uint32_t symbol_size, uint8_t *mul) {
+    uint8_t low[16], high[16];
+    gf256_nibble_tables(coef, mul, low, high);
+    const __m512i t_low = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *)low));
+    const __m512i t_high = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *)high));
+    const __m512i mask = _mm512_set1_epi8(0x0f);
+    uint32_t i = 0;
+    for (; i + 64 <= symbol_size; i += 64) {
+        __m512i x = _mm512_loadu_si512((const void *)(data1 + i));
+        __m512i l = _mm512_shuffle_epi8(t_low, _mm512_and_si512(x, mask));
+        __m512i h = _mm512_shuffle_epi8(t_high, _mm512_and_si512(_mm512_srli_epi64(x, 4), mask));
+        _mm512_storeu_si512((void *)(data1 + i), _mm512_xor_si512(l, h));
+    }
+    symbol_mul_scalar(data1 + i, coef, symbol_size - i, mul);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void symbol_add_scaled_multi_avx512(uint8_t **data1, const uint8_t *coefs, int n, const uint8_t *data2, uint32_t symbol_size, uint8_t *mul) {
+    __m512i t_low[SYMBOL_MAX_FUSED], t_high[SYMBOL_MAX_FUSED];
+    for (int r = 0; r < n; ++r) {
+        uint8_t low[16], high[16];
+        gf256_nibble_tables(coefs[r], mul, low, high);
+        t_low[r] = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *)low));
+        t_high[r] = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *)high));
+    }
+    const __m512i mask = _mm512_set1_epi8(0x0f);
+    uint32_t i = 0;
+    for (; i + 64 <= symbol_size; i += 64) {
+        __m512i x = _mm512_loadu_si512((const void *)(data2 + i));
+        __m512i x_low = _mm512_and_si512(x, mask);
+        __m512i x_high = _mm512_and_si512(_mm512_srli_epi64(x, 4), mask);
+        for (int r = 0; r < n; ++r) {
+            __m512i p = _mm512_xor_si512(_mm512_shuffle_epi8(t_low[r], x_low), _mm512_shuffle_epi8(t_high[r], x_high));
+            __m512i d = _mm512_loadu_si512((const void *)(data1[r] + i));
+            _mm512_storeu_si512((void *)(data1[r] + i), _mm512_xor_si512(d, p));
+        }
+    }
+    for (int r = 0; r < n; ++r) {
+        symbol_add_scaled_scalar(data1[r] + i, coefs[r], data2 + i, symbol_size - i, mul);
+    }
+}
+
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#include <arm_neon.h>
+
+#define SWIF_SIMD_NEON
+
+static void symbol_add_scaled_neon(uint8_t *data1, uint8_t coef, const uint8_t *data2, uint32_t symbol_size, uint8_t *mul) {
+    uint8_t low[16], high[16];
+    gf256_nibble_tables(coef, mul, low, high);
+    const uint8x16_t mask = vdupq_n_u8(0x0f);
+#if defined(__aarch64__)
+    const uint8x16_t t_low = vld1q_u8(low);
+    const uint8x16_t t_high = vld1q_u8(high);
+#else
+    const uint8x8x2_t t_low = {{vld1_u8(low), vld1_u8(low + 8)}};
+    const uint8x8x2_t t_high = {{vld1_u8(high), vld1_u8(high + 8)}};
+#endif
+    uint32_t i = 0;
+    for (; i + 16 <= symbol_size; i += 16) {
+        uint8x16_t x = vld1q_u8(data2 + i);
+        uint8x16_t x_low = vandq_u8(x, mask);
+        uint8x16_t x_high = vshrq_n_u8(x, 4);
+#if defined(__aarch64__)
+        uint8x16_t p = veorq_u8(vqtbl1q_u8(t_low, x_low), vqtbl1q_u8(t_high, x_high));
+#else
+        uint8x16_t p = vcombine_u8(veor_u8(vtbl2_u8(t_low, vget_low_u8(x_low)), vtbl2_u8(t_high, vget_low_u8(x_high))),
+                                   veor_u8(vtbl2_u8(t_low, vget_high_u8(x_low)), vtbl2_u8(t_high, vget_high_u8(x_high))));
+#endif
+        vst1q_u8(data1 + i, veorq_u8(vld1q_u8(data1 + i), p));
+    }
+    symbol_add_scaled_scalar(data1 + i, coef, data2 + i, symbol_size - i, mul);
+}
+
+static void symbol_mul_neon(uint8_t *data1, uint8_t coef, uint32_t symbol_size, uint8_t *mul) {
+    uint8_t low[16], high[16];
+    gf256_nibble_tables(coef, mul, low, high);
+    const uint8x16_t mask = vdupq_n_u8(0x0f);
+#if defined(__aarch64__)
+    const uint8x16_t t_low = vld1q_u8(low);
+    const uint8x16_t t_high = vld1q_u8(high);
+#else
+    const uint8x8x2_t t_low = {{vld1_u8(low), vld1_u8(low + 8)}};
+    const uint8x8x2_t t_high = {{vld1_u8(high), vld1_u8(high + 8)}};
+#endif
+    uint32_t i = 0;
+    for (; i + 16 <= symbol_size; i += 16) {
+        uint8x16_t x = vld1q_u8(data1 + i);
+        uint8x16_t x_low = vandq_u8(x, mask);
+        uint8x16_t x_high = vshrq_n_u8(x, 4);
+#if defined(__aarch64__)
+        uint8x16_t p = veorq_u8(vqtbl1q_u8(t_low, x_low), vqtbl1q_u8(t_high, x_high));
+#else
+        uint8x16_t p = vcombine_u8(veor_u8(vtbl2_u8(t_low, vget_low_u8(x_low)), vtbl2_u8(t_high, vget_low_u8(x_high))),
+                                   veor_u8(vtbl2_u8(t_low, vget_high_u8(x_low)), vtbl2_u8(t_high, vget_high_u8(x_high))));
+#endif
+        vst1q_u8(data1 + i, p);
+    }
+    symbol_mul_scalar(data1 + i, coef, symbol_size - i, mul);
+}
+#endif
+
+typedef void (*symbol_add_scaled_fn)(uint8_t *, uint8_t, const uint8_t *, uint32_t, uint8_t *);
+typedef void (*symbol_mul_fn)(uint8_t *, uint8_t, uint32_t, uint8_t *);
+typedef void (*symbol_add_scaled_multi_fn)(uint8_t **, const uint8_t *, int, const uint8_t *, uint32_t, uint8_t *);
+
+static symbol_add_scaled_fn symbol_add_scaled_kernel = 0;
+static symbol_mul_fn symbol_mul_kernel = 0;
+static symbol_add_scaled_multi_fn symbol_add_scaled_multi_kernel = 0;
+
+// Fused kernel of the CPUs without a vectorized one: one product at a time, only the tiling helps
+static void symbol_add_scaled_multi_single(uint8_t **data1, const uint8_t *coefs, int n, const uint8_t *data2, uint32_t symbol_size, uint8_t *mul) {
+    for (int r = 0; r < n; ++r) {
+        if (coefs[r] != 0) {
+            symbol_add_scaled_kernel(data1[r], coefs[r], data2, symbol_size, mul);
+        }
+    }
+}
+
+static pthread_once_t symbol_kernels_once = PTHREAD_ONCE_INIT;
+
+// Selects the widest kernels supported by the CPU. Called once through symbol_kernels_init(),
+// on the first use of the symbol operations by any thread
+static void symbol_select_kernels() {
+    symbol_add_scaled_fn add = symbol_add_scaled_scalar;
+    symbol_mul_fn mul = symbol_mul_scalar;
+    symbol_add_scaled_multi_fn add_multi = symbol_add_scaled_multi_single;
+#if defined(SWIF_SIMD_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512bw")) {
+        add = symbol_add_scaled_avx512;
+        mul = symbol_mul_avx512;
+        add_multi = symbol_add_scaled_multi_avx512;
+    } else if (__builtin_cpu_supports("avx2")) {
+        add = symbol_add_scaled_avx2;
+        mul = symbol_mul_avx2;
+        add_multi = symbol_add_scaled_multi_avx2;
+    } else if (__builtin_cpu_supports("ssse3")) {
+        add = symbol_add_scaled_ssse3;
+        mul = symbol_mul_ssse3;
+        add_multi = symbol_add_scaled_multi_ssse3;
+    }
+#elif defined(SWIF_SIMD_NEON)
+    add = symbol_add_scaled_neon;
+    mul = symbol_mul_neon;
+#endif
+    symbol_mul_kernel = mul;
+    symbol_add_scaled_multi_kernel = add_multi;
+    symbol_add_scaled_kernel = add;
+}
+
+static inline void symbol_kernels_init() {
+    pthread_once(&symbol_kernels_once, symbol_select_kernels);
+}
+
+static inline void symbol_add_scaled_impl(void *symbol1, uint8_t coef, const void *symbol2, uint32_t symbol_size, uint8_t *mul) {
+    if (coef == 0) return;
+    symbol_kernels_init();
+    symbol_add_scaled_kernel((uint8_t *)symbol1, coef, (const uint8_t *)symbol2, symbol_size, mul);
+}
+
+static inline void symbol_mul_impl(uint8_t *symbol1, uint8_t coef, uint32_t symbol_size, uint8_t *mul) {
+    if (coef == 1) return;
+    symbol_kernels_init();
+    symbol_mul_kernel(symbol1, coef, symbol_size, mul);
+}
+
 /**
  * @brief Take a symbol and add another symbol multiplied by a 
  *        coefficient, e.g. performs the equivalent of: p1 += coef * p2
@@ -33,10 +378,19 @@ uint8_t gf256_mul_formula(uint8_t a, uint8_t b) {
  * @param[in]     p2     Second symbol
  */
 void symbol_add_scaled(void *symbol1, uint8_t coef, void *symbol2, uint32_t symbol_size, uint8_t *mul) {
-    uint8_t *data1 = (uint8_t *) symbol1;
-    uint8_t *data2 = (uint8_t *) symbol2; 
-    for (uint32_t i=0; i<symbol_size; i++) {
-        data1[i] ^= gf256_mul(coef, data2[i], mul);
+    symbol_add_scaled_impl(symbol1, coef, symbol2, symbol_size, mul);
+}
+
+/**
+ * @brief Add a symbol multiplied by a different coefficient to several symbols,
+ *        e.g. performs the equivalent of: p1[i] += coefs[i] * p2 for i < n.
+ *        The symbol p2 is read once from memory for all the products
+ */
+void symbol_add_scaled_multi(uint8_t **symbols1, const uint8_t *coefs, int n, const void *symbol2, uint32_t symbol_size, uint8_t *mul) {
+    symbol_kernels_init();
+    for (int r = 0; r < n; r += SYMBOL_MAX_FUSED) {
+        int fused = n - r < SYMBOL_MAX_FUSED ? n - r : SYMBOL_MAX_FUSED;
+        symbol_add_scaled_multi_kernel(symbols1 + r, coefs + r, fused, (const uint8_t *)symbol2, symbol_size, mul);
     }
 }
 
@@ -54,10 +408,11 @@ bool symbol_is_zero(void *symbol, uint32_t symbol_size) {
 
 
 
+/**
+ * @brief Multiply a symbol by a coefficient, e.g. performs the equivalent of: p1 *= coef
+ */
 void symbol_mul(uint8_t *symbol1, uint8_t coef, uint32_t symbol_size, uint8_t *mul) {
-    for (uint32_t i=0; i<symbol_size; i++) {
-        symbol1[i] = gf256_mul(coef, symbol1[i], mul);
-    }
+    symbol_mul_impl(symbol1, coef, symbol_size, mul);
 }
 
 void assign_inv(uint8_t *array) {
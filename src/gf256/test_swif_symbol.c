@@ -0,0 +1,170 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "swif_symbol.c"
+
+// Tests of the GF(256) symbol operations: each vectorized kernel supported by the CPU
+// and the kernels selected at runtime must give the results of the scalar kernels.
+// Built and run with "make test"
+
+#define TEST_MAX_SIZE (SYMBOL_TILE_SIZE + 77)
+#define TEST_SYMBOLS 6 // More than SYMBOL_MAX_FUSED: symbol_add_scaled_multi splits them
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); \
+        fprintf(stderr, __VA_ARGS__); \
+        fprintf(stderr, "\n"); \
+        ++failures; \
+    } \
+} while (0)
+
+typedef struct {
+    const char *name;
+    bool supported;
+    symbol_add_scaled_fn add;
+    symbol_mul_fn mul;
+    symbol_add_scaled_multi_fn add_multi; // NULL if there is no fused kernel
+} test_kernels_t;
+
+// Sizes around the vector widths, to test the tails processed by the scalar kernels
+static const uint32_t test_sizes[] = {0, 1, 15, 16, 17, 31, 32, 33, 63, 64, 65, 127, 200, TEST_MAX_SIZE};
+static const uint8_t test_coefs[] = {1, 2, 3, 0x1d, 0x80, 0x8e, 0xfe, 0xff};
+
+static uint8_t muls[256 * 256];
+static uint8_t sources[TEST_SYMBOLS][TEST_MAX_SIZE];
+
+static void test__random(uint8_t *data, uint32_t size) {
+    for (uint32_t i = 0; i < size; ++i) {
+        data[i] = rand();
+    }
+}
+
+// The table of the products is the one of the encoder and the decoder, and assign_inv() gives the inverses
+static void test__field() {
+    uint8_t inv[256];
+    assign_inv(inv);
+    for (int a = 1; a < 256; ++a) {
+        CHECK(gf256_mul(a, inv[a], muls) == 1, "%d * inv[%d] = %d", a, a, gf256_mul(a, inv[a], muls));
+        CHECK(gf256_mul(a, 1, muls) == a && gf256_mul(a, 0, muls) == 0, "neutral elements of %d", a);
+    }
+}
+
+static void test__kernels(const test_kernels_t *kernels) {
+    static uint8_t expected[TEST_SYMBOLS][TEST_MAX_SIZE];
+    static uint8_t result[TEST_SYMBOLS][TEST_MAX_SIZE];
+    uint8_t *results[TEST_SYMBOLS];
+    uint8_t coefs[TEST_SYMBOLS];
+
+    for (int s = 0; s < sizeof(test_sizes) / sizeof(test_sizes[0]); ++s) {
+        uint32_t size = test_sizes[s];
+        for (int c = 0; c < sizeof(test_coefs) / sizeof(test_coefs[0]); ++c) {
+            uint8_t coef = test_coefs[c];
+
+            test__random(expected[0], size);
+            memcpy(result[0], expected[0], size);
+            symbol_add_scaled_scalar(expected[0], coef, sources[0], size, muls);
+            kernels->add(result[0], coef, sources[0], size, muls);
+            CHECK(memcmp(expected[0], result[0], size) == 0, "%s: add_scaled of %u bytes by %u", kernels->name, size, coef);
+
+            symbol_mul_scalar(expected[0], coef, size, muls);
+            kernels->mul(result[0], coef, size, muls);
+            CHECK(memcmp(expected[0], result[0], size) == 0, "%s: mul of %u bytes by %u", kernels->name, size, coef);
+        }
+
+        if (!kernels->add_multi) {
+            continue;
+        }
+        for (int n = 1; n <= SYMBOL_MAX_FUSED; ++n) {
+            for (int r = 0; r < n; ++r) {
+                coefs[r] = test_coefs[(s + r) % (sizeof(test_coefs) / sizeof(test_coefs[0]))];
+                test__random(expected[r], size);
+                memcpy(result[r], expected[r], size);
+                symbol_add_scaled_scalar(expected[r], coefs[r], sources[1], size, muls);
+                results[r] = result[r];
+            }
+            kernels->add_multi(results, coefs, n, sources[1], size, muls);
+            for (int r = 0; r < n; ++r) {
+                CHECK(memcmp(expected[r], result[r], size) == 0, "%s: add_scaled_multi of %u bytes in %d symbols, symbol %d", kernels->name, size, n, r);
+            }
+        }
+    }
+}
+
+// The public operations use the kernels selected for the CPU, also for more symbols than a fused kernel,
+// with null coefficients and symbols accumulated from several sources
+static void test__selected_kernels() {
+    static uint8_t expected[TEST_SYMBOLS][TEST_MAX_SIZE];
+    static uint8_t result[TEST_SYMBOLS][TEST_MAX_SIZE];
+    uint8_t *results[TEST_SYMBOLS];
+    uint8_t coefs[TEST_SYMBOLS] = {0};
+
+    for (int r = 0; r < TEST_SYMBOLS; ++r) {
+        memset(expected[r], 0, TEST_MAX_SIZE);
+        memset(result[r], 0, TEST_MAX_SIZE);
+        results[r] = result[r];
+    }
+    for (int i = 0; i < TEST_SYMBOLS; ++i) {
+        for (int r = 0; r < TEST_SYMBOLS; ++r) {
+            coefs[r] = (i + r) % 3 == 0 ? 0 : rand();
+            symbol_add_scaled_scalar(expected[r], coefs[r], sources[i], TEST_MAX_SIZE, muls);
+        }
+        symbol_add_scaled_multi(results, coefs, TEST_SYMBOLS, sources[i], TEST_MAX_SIZE, muls);
+    }
+    for (int r = 0; r < TEST_SYMBOLS; ++r) {
+        CHECK(memcmp(expected[r], result[r], TEST_MAX_SIZE) == 0, "symbol_add_scaled_multi, symbol %d", r);
+    }
+
+    symbol_add_scaled(result[0], 0x53, sources[0], TEST_MAX_SIZE, muls);
+    symbol_add_scaled_scalar(expected[0], 0x53, sources[0], TEST_MAX_SIZE, muls);
+    CHECK(memcmp(expected[0], result[0], TEST_MAX_SIZE) == 0, "symbol_add_scaled");
+    symbol_mul(result[0], 0xca, TEST_MAX_SIZE, muls);
+    symbol_mul_scalar(expected[0], 0xca, TEST_MAX_SIZE, muls);
+    CHECK(memcmp(expected[0], result[0], TEST_MAX_SIZE) == 0, "symbol_mul");
+
+    // Adding a symbol twice cancels it
+    symbol_add_scaled(result[1], 0x35, sources[2], TEST_MAX_SIZE, muls);
+    symbol_add_scaled(result[1], 0x35, sources[2], TEST_MAX_SIZE, muls);
+    CHECK(memcmp(expected[1], result[1], TEST_MAX_SIZE) == 0, "symbol_add_scaled twice");
+}
+
+int main() {
+    for (int i = 0; i < 256; ++i) {
+        for (int j = 0; j < 256; ++j) {
+            muls[i * 256 + j] = gf256_mul_formula(i, j);
+        }
+    }
+    srand(42);
+    for (int i = 0; i < TEST_SYMBOLS; ++i) {
+        test__random(sources[i], TEST_MAX_SIZE);
+    }
+
+    test_kernels_t kernels[] = {
+#if defined(SWIF_SIMD_X86)
+        {"ssse3", __builtin_cpu_supports("ssse3"), symbol_add_scaled_ssse3, symbol_mul_ssse3, symbol_add_scaled_multi_ssse3},
+        {"avx2", __builtin_cpu_supports("avx2"), symbol_add_scaled_avx2, symbol_mul_avx2, symbol_add_scaled_multi_avx2},
+        {"avx512bw", __builtin_cpu_supports("avx512bw"), symbol_add_scaled_avx512, symbol_mul_avx512, symbol_add_scaled_multi_avx512},
+#elif defined(SWIF_SIMD_NEON)
+        {"neon", true, symbol_add_scaled_neon, symbol_mul_neon, NULL},
+#endif
+    };
+
+    test__field();
+    for (int k = 0; k < sizeof(kernels) / sizeof(kernels[0]); ++k) {
+        if (kernels[k].supported) {
+            test__kernels(&kernels[k]);
+        } else {
+            printf("Skipped the %s kernels, not supported by the CPU\n", kernels[k].name);
+        }
+    }
+    test__selected_kernels();
+
+    if (failures) {
+        fprintf(stderr, "%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("All tests passed\n");
+    return 0;
+}
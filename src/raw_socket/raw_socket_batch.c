@@ -0,0 +1,211 @@
+#define _GNU_SOURCE // sendmmsg
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <net/ethernet.h>
+#include <linux/if_packet.h>
+
+#include "raw_socket_batch.h"
+
+// PACKET_TX_RING geometry: RAW_SOCKET_TX_RING_FRAMES frames, each large enough for a packet and its headers
+#define RAW_SOCKET_TX_RING_FRAME_SIZE (1 << 13)
+#define RAW_SOCKET_TX_RING_BLOCK_SIZE (1 << 16)
+#define RAW_SOCKET_TX_RING_FRAMES 256
+#define RAW_SOCKET_TX_RING_DATA_OFFSET (TPACKET2_HDRLEN - sizeof(struct sockaddr_ll))
+
+struct raw_socket_batch {
+    int sfd;
+    unsigned int count;
+    // sendmmsg backend
+    struct mmsghdr msgs[RAW_SOCKET_BATCH_SIZE];
+    struct iovec iovs[RAW_SOCKET_BATCH_SIZE];
+    struct sockaddr_in6 dsts[RAW_SOCKET_BATCH_SIZE];
+    uint8_t (*packets)[RAW_SOCKET_PACKET_SIZE];
+    // PACKET_TX_RING backend (used if ring is not NULL)
+    uint8_t *ring;
+    size_t ring_size;
+    unsigned int ring_head;
+    struct ether_header eth;
+};
+
+raw_socket_batch_t *raw_socket_batch__new(int sfd) {
+    raw_socket_batch_t *batch = malloc(sizeof(raw_socket_batch_t));
+    if (!batch) return NULL;
+    memset(batch, 0, sizeof(raw_socket_batch_t));
+    batch->sfd = sfd;
+
+    batch->packets = malloc(RAW_SOCKET_BATCH_SIZE * RAW_SOCKET_PACKET_SIZE);
+    if (!batch->packets) {
+        free(batch);
+        return NULL;
+    }
+
+    // The messages always point to the same buffers, only the lengths change
+    for (int i = 0; i < RAW_SOCKET_BATCH_SIZE; ++i) {
+        batch->iovs[i].iov_base = batch->packets[i];
+        batch->msgs[i].msg_hdr.msg_iov = &batch->iovs[i];
+        batch->msgs[i].msg_hdr.msg_iovlen = 1;
+        batch->msgs[i].msg_hdr.msg_name = &batch->dsts[i];
+        batch->msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in6);
+    }
+
+    return batch;
+}
+
+raw_socket_batch_t *raw_socket_batch__new_tx_ring(const char *ifname, const uint8_t dst_mac[6]) {
+    raw_socket_batch_t *batch = malloc(sizeof(raw_socket_batch_t));
+    if (!batch) return NULL;
+    memset(batch, 0, sizeof(raw_socket_batch_t));
+
+    batch->sfd = socket(AF_PACKET, SOCK_RAW, 0); // Only used to send, do not receive anything
+    if (batch->sfd < 0) {
+        perror("Cannot create packet socket");
+        goto error;
+    }
+
+    int version = TPACKET_V2;
+    if (setsockopt(batch->sfd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0) {
+        perror("Cannot set TPACKET_V2");
+        goto error;
+    }
+
+    struct tpacket_req req = {
+        .tp_block_size = RAW_SOCKET_TX_RING_BLOCK_SIZE,
+        .tp_block_nr = RAW_SOCKET_TX_RING_FRAMES / (RAW_SOCKET_TX_RING_BLOCK_SIZE / RAW_SOCKET_TX_RING_FRAME_SIZE),
+        .tp_frame_size = RAW_SOCKET_TX_RING_FRAME_SIZE,
+        .tp_frame_nr = RAW_SOCKET_TX_RING_FRAMES,
+    };
+    if (setsockopt(batch->sfd, SOL_PACKET, PACKET_TX_RING, &req, sizeof(req)) < 0) {
+        perror("Cannot create PACKET_TX_RING");
+        goto error;
+    }
+
+    batch->ring_size = (size_t)req.tp_block_size * req.tp_block_nr;
+    batch->ring = mmap(NULL, batch->ring_size, PROT_READ | PROT_WRITE, MAP_SHARED, batch->sfd, 0);
+    if (batch->ring == MAP_FAILED) {
+        batch->ring = NULL;
+        perror("Cannot mmap PACKET_TX_RING");
+        goto error;
+    }
+
+    struct sockaddr_ll addr = {
+        .sll_family = AF_PACKET,
+        .sll_protocol = htons(ETH_P_IPV6),
+        .sll_ifindex = if_nametoindex(ifname),
+    };
+    if (addr.sll_ifindex == 0 || bind(batch->sfd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("Cannot bind packet socket");
+        goto error;
+    }
+
+    // The Ethernet header is the same for all the frames
+    struct ifreq ifr;
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, ifname, IFNAMSIZ - 1);
+    if (ioctl(batch->sfd, SIOCGIFHWADDR, &ifr) < 0) {
+        perror("Cannot get the MAC address of the interface");
+        goto error;
+    }
+    memcpy(batch->eth.ether_shost, ifr.ifr_hwaddr.sa_data, ETH_ALEN);
+    memcpy(batch->eth.ether_dhost, dst_mac, ETH_ALEN);
+    batch->eth.ether_type = htons(ETHERTYPE_IPV6);
+
+    return batch;
+
+error:
+    if (batch->ring) munmap(batch->ring, batch->ring_size);
+    if (batch->sfd >= 0) close(batch->sfd);
+    free(batch);
+    return NULL;
+}
+
+void raw_socket_batch__free(raw_socket_batch_t *batch) {
+    if (!batch) return;
+    raw_socket_batch__flush(batch);
+    if (batch->ring) {
+        munmap(batch->ring, batch->ring_size);
+        close(batch->sfd); // Opened by raw_socket_batch__new_tx_ring
+    }
+    free(batch->packets);
+    free(batch);
+}
+
+static struct tpacket2_hdr *raw_socket_batch__frame(raw_socket_batch_t *batch) {
+    return (struct tpacket2_hdr *)(batch->ring + (size_t)batch->ring_head * RAW_SOCKET_TX_RING_FRAME_SIZE);
+}
+
+uint8_t *raw_socket_batch__next(raw_socket_batch_t *batch) {
+    if (batch->ring) {
+        struct tpacket2_hdr *hdr = raw_socket_batch__frame(batch);
+        if (hdr->tp_status & (TP_STATUS_SEND_REQUEST | TP_STATUS_SENDING)) {
+            // The ring is full: ask the kernel to send the pending frames
+            raw_socket_batch__flush(batch);
+            if (hdr->tp_status & (TP_STATUS_SEND_REQUEST | TP_STATUS_SENDING)) {
+                return NULL;
+            }
+        }
+        uint8_t *frame = (uint8_t *)hdr + RAW_SOCKET_TX_RING_DATA_OFFSET;
+        memcpy(frame, &batch->eth, sizeof(struct ether_header));
+        return frame + sizeof(struct ether_header);
+    }
+
+    if (batch->count == RAW_SOCKET_BATCH_SIZE) {
+        raw_socket_batch__flush(batch);
+    }
+    return batch->packets[batch->count];
+}
+
+void raw_socket_batch__push(raw_socket_batch_t *batch, size_t packet_length, const struct sockaddr_in6 *dst) {
+    if (batch->ring) {
+        // The destination is already in the IPv6 header and the next hop is given by the Ethernet header
+        struct tpacket2_hdr *hdr = raw_socket_batch__frame(batch);
+        hdr->tp_len = sizeof(struct ether_header) + packet_length;
+        __sync_synchronize(); // The frame must be complete before the kernel sees it
+        hdr->tp_status = TP_STATUS_SEND_REQUEST;
+        batch->ring_head = (batch->ring_head + 1) % RAW_SOCKET_TX_RING_FRAMES;
+        ++batch->count;
+        return;
+    }
+
+    batch->iovs[batch->count].iov_len = packet_length;
+    memcpy(&batch->dsts[batch->count], dst, sizeof(struct sockaddr_in6));
+    ++batch->count;
+}
+
+int raw_socket_batch__flush(raw_socket_batch_t *batch) {
+    unsigned int sent = 0;
+
+    if (batch->ring) {
+        if (batch->count == 0) return 0;
+        // A single syscall sends all the frames marked with TP_STATUS_SEND_REQUEST
+        if (send(batch->sfd, NULL, 0, MSG_DONTWAIT) < 0 && errno != EAGAIN && errno != ENOBUFS) {
+            perror("Impossible to send the TX ring");
+            return -1;
+        }
+        sent = batch->count;
+        batch->count = 0;
+        return sent;
+    }
+
+    while (sent < batch->count) {
+        int err = sendmmsg(batch->sfd, &batch->msgs[sent], batch->count - sent, 0);
+        if (err < 0) {
+            if (errno == EINTR) continue;
+            perror("Impossible to send the batch");
+            // Drop the remaining packets, as the unbatched path does
+            batch->count = 0;
+            return -1;
+        }
+        if (err == 0) break;
+        sent += err;
+    }
+    batch->count = 0;
+    return sent;
+}
@@ -0,0 +1,34 @@
+#ifndef RAW_SOCKET_BATCH_H_
+#define RAW_SOCKET_BATCH_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <netinet/in.h>
+
+#define RAW_SOCKET_PACKET_SIZE 4200 // Maximum size of a generated packet
+#define RAW_SOCKET_BATCH_SIZE 32 // Number of packets sent with a single sendmmsg
+
+// Packets built but not sent yet, flushed with sendmmsg when the batch is full
+// or when the caller has no more events to process
+typedef struct raw_socket_batch raw_socket_batch_t;
+
+raw_socket_batch_t *raw_socket_batch__new(int sfd);
+
+// Same as raw_socket_batch__new but the packets are directly built in the frames of a PACKET_TX_RING
+// mapped on *ifname*, bypassing the IPv6 output path. The frames are sent to the next hop *dst_mac*
+raw_socket_batch_t *raw_socket_batch__new_tx_ring(const char *ifname, const uint8_t dst_mac[6]);
+
+// Sends the pending packets (if any) and frees the batch
+void raw_socket_batch__free(raw_socket_batch_t *batch);
+
+// Returns the buffer of RAW_SOCKET_PACKET_SIZE bytes in which the next packet must be built.
+// The batch is flushed first if it is full. Returns NULL if no buffer is available (TX ring still full)
+uint8_t *raw_socket_batch__next(raw_socket_batch_t *batch);
+
+// Queues the packet built in the buffer returned by raw_socket_batch__next
+void raw_socket_batch__push(raw_socket_batch_t *batch, size_t packet_length, const struct sockaddr_in6 *dst);
+
+// Sends all the pending packets. Returns the number of sent packets or -1 in case of error
+int raw_socket_batch__flush(raw_socket_batch_t *batch);
+
+#endif
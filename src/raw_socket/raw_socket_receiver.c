@@ -81,24 +81,18 @@ void compute_udp_checksum(struct ip6_hdr *pIph, uint16_t *buf, uint16_t len) {
     udphdr->uh_sum = ((uint16_t)(~sum));
 }
 
-int send_raw_socket_recovered(int sfd, const void *repairSymbol_void, struct sockaddr_in6 local_addr) {
+// Builds the recovered packet in *packet* (of RAW_SOCKET_PACKET_SIZE bytes) and sets its destination in *dst*.
+// Returns its length
+static int build_raw_socket_recovered(uint8_t *packet, struct sockaddr_in6 *dst, const void *repairSymbol_void, struct sockaddr_in6 local_addr) {
     const struct repairSymbol_t *repairSymbol = (const struct repairSymbol_t *)repairSymbol_void;
-    struct sockaddr_in6 dst;
-    uint8_t packet[4200];
     size_t packet_length;
     struct ip6_hdr *iphdr;
     struct ipv6_sr_hdr *srh;
     size_t ip6_length = 40;
     int next_segment_idx;
-    int bytes; // Number of sent bytes
     int i;
 
-    if (sfd < 0) {
-        fprintf(stderr, "The socket is not initialized\n");
-        return -1;
-    }
-
-    if (repairSymbol->packet_length > sizeof(packet)) {
+    if (repairSymbol->packet_length > RAW_SOCKET_PACKET_SIZE) {
         fprintf(stderr, "I think the packet is wrongly decoded...\n");
         return -1;
     }
@@ -121,7 +115,7 @@ int send_raw_socket_recovered(int sfd, const void *repairSymbol_void, struct soc
     /* Retrieve the next segment after the current node to put as destination address.
      * Also need to update the Segment Routing header segment left entry */
     bool found_current_segment;
-    if (srh->first_segment * 16 > sizeof(packet) || srh->first_segment > 255) {
+    if (srh->first_segment * 16 > RAW_SOCKET_PACKET_SIZE || srh->first_segment > 255) {
         fprintf(stderr, "I think the packet is wrongly decoded 1...\n");
         return -1;
     }
@@ -143,21 +137,21 @@ int send_raw_socket_recovered(int sfd, const void *repairSymbol_void, struct soc
     next_segment_idx = i - 1;
 
     /* Copy the address of the next segment in the Destination Address entry of the IPv6 header */
-    memset(&dst, 0, sizeof(dst));
-    dst.sin6_family = AF_INET6;
-    bcopy(&(srh->segments[next_segment_idx]), &(dst.sin6_addr), 16);
-    bcopy(&dst.sin6_addr, &(iphdr->ip6_dst), 16);
+    memset(dst, 0, sizeof(struct sockaddr_in6));
+    dst->sin6_family = AF_INET6;
+    bcopy(&(srh->segments[next_segment_idx]), &(dst->sin6_addr), 16);
+    bcopy(&dst->sin6_addr, &(iphdr->ip6_dst), 16);
 
     /* Update the value of next segment in the Segment Routing header */
     srh->segments_left = next_segment_idx;
 
     /* Compute the Checksum for IP for now */
     size_t srh_len = 8 + (srh->hdrlen << 3);
-    if (srh_len + ip6_length > sizeof(packet)) {
+    if (srh_len + ip6_length > RAW_SOCKET_PACKET_SIZE) {
         fprintf(stderr, "I think the packet is wrongly decoded 2...\n");
         return -1;
     }
-    if (repairSymbol->packet_length + ip6_length + srh_len > sizeof(packet)) return -1;
+    if (repairSymbol->packet_length + ip6_length + srh_len > RAW_SOCKET_PACKET_SIZE) return -1;
     if (srh->nexthdr == 6) { // TCP
         struct tcphdr *tcp = (struct tcphdr *)&packet[ip6_length + srh_len];
         if (repairSymbol->packet_length < ip6_length + srh_len) {
@@ -178,6 +172,25 @@ int send_raw_socket_recovered(int sfd, const void *repairSymbol_void, struct soc
         compute_udp_checksum(iphdr, (uint16_t *)udp, udp_len);
     }
 
+    return packet_length;
+}
+
+int send_raw_socket_recovered(int sfd, const void *repairSymbol_void, struct sockaddr_in6 local_addr) {
+    struct sockaddr_in6 dst;
+    uint8_t packet[RAW_SOCKET_PACKET_SIZE];
+    int packet_length;
+    int bytes; // Number of sent bytes
+
+    if (sfd < 0) {
+        fprintf(stderr, "The socket is not initialized\n");
+        return -1;
+    }
+
+    packet_length = build_raw_socket_recovered(packet, &dst, repairSymbol_void, local_addr);
+    if (packet_length < 0) {
+        return -1;
+    }
+
     /* Send packet */
     bytes = sendto(sfd, packet, packet_length, 0, (struct sockaddr *)&dst, sizeof(dst));
     if (bytes != packet_length) {
@@ -188,8 +201,22 @@ int send_raw_socket_recovered(int sfd, const void *repairSymbol_void, struct soc
     return 0;
 }
 
-int send_raw_socket_controller(int sfd, struct sockaddr_in6 decoder, struct sockaddr_in6 encoder, controller_t *controller) {
-    uint8_t packet[4200];
+int queue_raw_socket_recovered(raw_socket_batch_t *batch, const void *repairSymbol_void, struct sockaddr_in6 local_addr) {
+    struct sockaddr_in6 dst;
+    uint8_t *packet = raw_socket_batch__next(batch);
+    if (!packet) {
+        return -1;
+    }
+    int packet_length = build_raw_socket_recovered(packet, &dst, repairSymbol_void, local_addr);
+    if (packet_length < 0) {
+        return -1;
+    }
+    raw_socket_batch__push(batch, packet_length, &dst);
+    return 0;
+}
+
+// Builds the controller packet in *packet* (of RAW_SOCKET_PACKET_SIZE bytes). Returns its length
+static int build_raw_socket_controller(uint8_t *packet, struct sockaddr_in6 decoder, struct sockaddr_in6 encoder, controller_t *controller) {
     size_t packet_length;
     struct ip6_hdr *iphdr;
     struct ipv6_sr_hdr *srh;
@@ -199,9 +226,6 @@ int send_raw_socket_controller(int sfd, struct sockaddr_in6 decoder, struct sock
     size_t srh_length;
     size_t tlv_length;
     size_t udp_length = 8;
-    int bytes;
-
-    if (sfd < 0) return -1;
 
     /* IPv6 header */
     iphdr = (struct ip6_hdr *)&packet[0];
@@ -235,7 +259,7 @@ int send_raw_socket_controller(int sfd, struct sockaddr_in6 decoder, struct sock
     tlv = (tlv_controller_t *)&packet[ip6_length + srh_length];
     tlv->tlv_type = TLV_CODING_SOURCE;
     tlv->len = sizeof(tlv_controller_t) - 2;
-    tlv->padding = 0;
+    tlv->loss_bursts = controller->loss_bursts;
     tlv->theoretical_counter = controller->theoretical_counter;
     tlv->received_counter = controller->received_counter;
 
@@ -249,10 +273,32 @@ int send_raw_socket_controller(int sfd, struct sockaddr_in6 decoder, struct sock
     packet_length = ip6_length + srh_length + tlv_length + udp_length;
     iphdr->ip6_plen = htons(srh_length + tlv_length + udp_length);
 
+    return packet_length;
+}
+
+int send_raw_socket_controller(int sfd, struct sockaddr_in6 decoder, struct sockaddr_in6 encoder, controller_t *controller) {
+    uint8_t packet[RAW_SOCKET_PACKET_SIZE];
+    int packet_length;
+    int bytes;
+
+    if (sfd < 0) return -1;
+
+    packet_length = build_raw_socket_controller(packet, decoder, encoder, controller);
+
     bytes = sendto(sfd, packet, packet_length, 0, (struct sockaddr *)&encoder, sizeof(encoder));
     if (bytes != packet_length) {
         return -1;
     }
 
     return 0;
-}
\ No newline at end of file
+}
+
+int queue_raw_socket_controller(raw_socket_batch_t *batch, struct sockaddr_in6 decoder, struct sockaddr_in6 encoder, controller_t *controller) {
+    uint8_t *packet = raw_socket_batch__next(batch);
+    if (!packet) {
+        return -1;
+    }
+    int packet_length = build_raw_socket_controller(packet, decoder, encoder, controller);
+    raw_socket_batch__push(batch, packet_length, &encoder);
+    return 0;
+}
@@ -15,9 +15,15 @@
 #include <linux/seg6.h>
 
 #include "../decoder.h"
+#include "raw_socket_batch.h"
 
 int send_raw_socket_recovered(int sfd, const void *repairSymbol_void, struct sockaddr_in6 local_addr);
 
 int send_raw_socket_controller(int sfd, struct sockaddr_in6 decoder, struct sockaddr_in6 encoder, controller_t *controller);
 
+// Same as send_raw_socket_recovered and send_raw_socket_controller but the packet is queued in *batch* and sent at the next flush
+int queue_raw_socket_recovered(raw_socket_batch_t *batch, const void *repairSymbol_void, struct sockaddr_in6 local_addr);
+
+int queue_raw_socket_controller(raw_socket_batch_t *batch, struct sockaddr_in6 decoder, struct sockaddr_in6 encoder, controller_t *controller);
+
 #endif
\ No newline at end of file
@@ -38,8 +38,8 @@ uint16_t udp_checksum(const void *buff, size_t len, struct in6_addr *src_addr, s
     return((uint16_t)(~sum));
 }
 
-int send_raw_socket(int sfd, const struct repairSymbol_t *repairSymbol, struct sockaddr_in6 src, struct sockaddr_in6 dst) {
-    uint8_t packet[4200];
+// Builds the repair packet in *packet* (of RAW_SOCKET_PACKET_SIZE bytes). Returns its length
+static int build_raw_socket(uint8_t *packet, const struct repairSymbol_t *repairSymbol, struct sockaddr_in6 src, struct sockaddr_in6 dst) {
     size_t packet_length;
     struct ip6_hdr *iphdr;
     struct ipv6_sr_hdr *srh;
@@ -49,10 +49,8 @@ int send_raw_socket(int sfd, const struct repairSymbol_t *repairSymbol, struct s
     size_t tlv_length = 0;
     size_t udp_length = 8;
     size_t pay_length = repairSymbol->packet_length;
-    int bytes; // Number of sent bytes
 
-    if (sfd < 0) {
-        fprintf(stderr, "The socket is not initialized\n");
+    if (ip6_length + sizeof(struct ipv6_sr_hdr) + 32 + sizeof(struct tlvRepair__block_t) + udp_length + pay_length > RAW_SOCKET_PACKET_SIZE) {
         return -1;
     }
 
@@ -105,6 +103,24 @@ int send_raw_socket(int sfd, const struct repairSymbol_t *repairSymbol, struct s
     /* Compute the UDP checksum */
     uhdr->uh_sum = udp_checksum(uhdr, udp_length + pay_length, &src.sin6_addr, &dst.sin6_addr);
 
+    return packet_length;
+}
+
+int send_raw_socket(int sfd, const struct repairSymbol_t *repairSymbol, struct sockaddr_in6 src, struct sockaddr_in6 dst) {
+    uint8_t packet[RAW_SOCKET_PACKET_SIZE];
+    int packet_length;
+    int bytes; // Number of sent bytes
+
+    if (sfd < 0) {
+        fprintf(stderr, "The socket is not initialized\n");
+        return -1;
+    }
+
+    packet_length = build_raw_socket(packet, repairSymbol, src, dst);
+    if (packet_length < 0) {
+        return -1;
+    }
+
     /* Send packet */
     bytes = sendto(sfd, packet, packet_length, 0, (struct sockaddr *)&dst, sizeof(dst));
     //++total;
@@ -113,4 +129,17 @@ int send_raw_socket(int sfd, const struct repairSymbol_t *repairSymbol, struct s
     }
 
     return 0;
-}
\ No newline at end of file
+}
+
+int queue_raw_socket(raw_socket_batch_t *batch, const struct repairSymbol_t *repairSymbol, struct sockaddr_in6 src, struct sockaddr_in6 dst) {
+    uint8_t *packet = raw_socket_batch__next(batch);
+    if (!packet) {
+        return -1;
+    }
+    int packet_length = build_raw_socket(packet, repairSymbol, src, dst);
+    if (packet_length < 0) {
+        return -1;
+    }
+    raw_socket_batch__push(batch, packet_length, &dst);
+    return 0;
+}
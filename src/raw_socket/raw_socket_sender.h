@@ -14,7 +14,11 @@
 #include <linux/seg6.h>
 
 #include "../encoder.h"
+#include "raw_socket_batch.h"
 
 int send_raw_socket(int sfd, const struct repairSymbol_t *repairSymbol, struct sockaddr_in6 src, struct sockaddr_in6 dst);
 
+// Same as send_raw_socket but the packet is queued in *batch* and sent at the next flush
+int queue_raw_socket(raw_socket_batch_t *batch, const struct repairSymbol_t *repairSymbol, struct sockaddr_in6 src, struct sockaddr_in6 dst);
+
 #endif
\ No newline at end of file
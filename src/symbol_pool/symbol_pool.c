@@ -0,0 +1,61 @@
+#ifndef SYMBOL_POOL_USER_H_
+#define SYMBOL_POOL_USER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "../fec_srv6.h"
+
+// User space access to the size-classed pools of symbols stored by the eBPF programs (see fec_framework/symbol_pool.c)
+
+// Entries of an mmapped BPF_MAP_TYPE_ARRAY are rounded up to 8 bytes
+#define SYMBOL_POOL_STRIDE(type) ((sizeof(type) + 7) & ~7)
+
+static uint8_t *symbol_pool__mmap_class(int map_fd, size_t size) {
+    void *class = mmap(NULL, size, PROT_READ, MAP_SHARED, map_fd, 0);
+    return class == MAP_FAILED ? NULL : (uint8_t *)class;
+}
+
+void symbol_pool__munmap(symbol_pool_t *pool) {
+    if (pool->small) munmap(pool->small, pool->shares * pool->slots * SYMBOL_POOL_STRIDE(symbol_small_t));
+    if (pool->medium) munmap(pool->medium, pool->shares * pool->slots * SYMBOL_POOL_STRIDE(symbol_medium_t));
+    if (pool->large) munmap(pool->large, pool->shares * pool->slots * SYMBOL_POOL_STRIDE(symbol_large_t));
+    memset(pool, 0, sizeof(symbol_pool_t));
+}
+
+// Maps the classes of a pool of *shares* shares of *slots* symbols
+int symbol_pool__mmap(symbol_pool_t *pool, int fd_small, int fd_medium, int fd_large, uint32_t slots, uint32_t shares) {
+    pool->slots = slots;
+    pool->shares = shares;
+    pool->small = symbol_pool__mmap_class(fd_small, shares * slots * SYMBOL_POOL_STRIDE(symbol_small_t));
+    pool->medium = symbol_pool__mmap_class(fd_medium, shares * slots * SYMBOL_POOL_STRIDE(symbol_medium_t));
+    pool->large = symbol_pool__mmap_class(fd_large, shares * slots * SYMBOL_POOL_STRIDE(symbol_large_t));
+    if (!pool->small || !pool->medium || !pool->large) {
+        symbol_pool__munmap(pool);
+        return -1;
+    }
+    return 0;
+}
+
+static symbol_slot_t *symbol_pool__slot(uint8_t *class, uint32_t share, uint32_t encodingSymbolID, uint32_t slots, size_t stride) {
+    symbol_slot_t *slot = (symbol_slot_t *)(class + SYMBOL_POOL_INDEX(encodingSymbolID, slots, share) * stride);
+    if (slot->packet_length == 0 || slot->encodingSymbolID != encodingSymbolID) {
+        return NULL;
+    }
+    return slot;
+}
+
+// Returns the slot of the symbol *encodingSymbolID* in the share *share*, or NULL if it is not (anymore) in the pool.
+// The slot may be overwritten by the kernel while it is read: call this function again after
+// using the symbol to ensure that it was not modified in the meantime
+symbol_slot_t *symbol_pool__get(symbol_pool_t *pool, uint32_t share, uint32_t encodingSymbolID) {
+    if (share >= pool->shares) return NULL;
+    symbol_slot_t *slot = symbol_pool__slot(pool->small, share, encodingSymbolID, pool->slots, SYMBOL_POOL_STRIDE(symbol_small_t));
+    if (slot) return slot;
+    slot = symbol_pool__slot(pool->medium, share, encodingSymbolID, pool->slots, SYMBOL_POOL_STRIDE(symbol_medium_t));
+    if (slot) return slot;
+    return symbol_pool__slot(pool->large, share, encodingSymbolID, pool->slots, SYMBOL_POOL_STRIDE(symbol_large_t));
+}
+
+#endif